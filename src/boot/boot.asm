@@ -3,7 +3,7 @@
 ; Distributed under the terms of the MIT License.
 ; ========================================
 ; boot.asm
-; In charge of jumping to kernel and defining GRUB multiboot header
+; In charge of defining GRUB multiboot header, setting up boot paging and jumping to the higher half kernel
 ; ========================================
 
 ; We're in protected mode already
@@ -36,7 +36,30 @@ multiboot2_header_start:
 
 multiboot2_header_end:
 
-section .text
+; Has to match KERNEL_LOAD_ADDRESS, VMM_DIRECT_MAP_SIZE, VMM_FB_ADDR, VMM_KMAP_ADDR and BOOT_PAGING_ADDR in mm/vmm.hpp
+KERNEL_VIRT_BASE equ 0xC0000000
+DIRECT_MAP_SIZE  equ 0x30000000
+FB_WINDOW_ADDR   equ 0xF8000000
+FB_WINDOW_SIZE   equ 0x01000000
+KMAP_ADDR        equ 0xFF600000
+
+; Boot paging structures, placed between the heap and the frame metadata
+BOOT_PAGING_ADDR equ 0x500000
+BOOT_PD          equ BOOT_PAGING_ADDR
+BOOT_KMAP_PT     equ BOOT_PAGING_ADDR + 0x1000       ; Page table of the kmap window
+BOOT_PTS         equ BOOT_PAGING_ADDR + 0x2000       ; Direct map tables for CPUs without PSE
+BOOT_PT_COUNT    equ 5                               ; 20 MiB, holds the kernel, heap and frame metadata for 4 GiB of RAM
+BOOT_FB_PTS      equ BOOT_PTS + BOOT_PT_COUNT * 0x1000
+BOOT_FB_PT_COUNT equ FB_WINDOW_SIZE >> 22
+BOOT_PAGING_SIZE equ BOOT_FB_PTS + BOOT_FB_PT_COUNT * 0x1000 - BOOT_PAGING_ADDR
+
+; Entry flags
+PAGE_PRESENT_RW  equ 0x003
+PAGE_LARGE       equ 0x080
+PAGE_GLOBAL      equ 0x100 ; Only takes effect once the VMM enables CR4.PGE
+
+; Runs at its physical address, before paging is enabled
+section .boot progbits alloc exec nowrite align=16
 
 global _start
 extern kernel_main ; Kernel function that we're jumping to
@@ -46,11 +69,146 @@ _start:
     ; Clear interrupts
     cli
     
-    ; Set up the stack
-    mov esp, stack_top
+    ; Set up the stack at its physical address until paging is on
+    mov esp, stack_top - KERNEL_VIRT_BASE
     
     push ebx ; Multiboot2 info structure pointer
     push eax ; Magic number
+    mov esi, ebx
+
+    ; The boot paging structures aren't part of the kernel image, so they're cleared by hand
+    mov edi, BOOT_PAGING_ADDR
+    xor eax, eax
+    mov ecx, BOOT_PAGING_SIZE / 4
+    rep stosd
+
+    ; The last PD entry points at the PD itself (VMM_RECURSIVE_ADDR) and the kmap window gets its table
+    mov dword [BOOT_PD + 1023 * 4], BOOT_PD + PAGE_PRESENT_RW
+    mov dword [BOOT_PD + (KMAP_ADDR >> 22) * 4], BOOT_KMAP_PT + PAGE_PRESENT_RW
+
+    ; With PSE the whole direct map fits into 4 MiB pages
+    xor ebp, ebp
+    mov eax, 1
+    cpuid
+    test edx, 1 << 3
+    jz .no_pse
+    mov ebp, 1
+    mov eax, cr4
+    or eax, 0x10 ; CR4.PSE
+    mov cr4, eax
+
+    mov eax, PAGE_PRESENT_RW | PAGE_LARGE | PAGE_GLOBAL
+    mov edi, BOOT_PD + (KERNEL_VIRT_BASE >> 22) * 4
+    mov ecx, DIRECT_MAP_SIZE >> 22
+.direct_large:
+    stosd
+    add eax, 0x400000
+    loop .direct_large
+    ; The first 4 MiB are also identity mapped, so this code keeps running once paging is on
+    mov dword [BOOT_PD], PAGE_PRESENT_RW | PAGE_LARGE
+    jmp .find_framebuffer
+
+.no_pse:
+    ; Page tables for the start of the direct map, the first one doubles as the identity mapping
+    mov eax, PAGE_PRESENT_RW | PAGE_GLOBAL
+    mov edi, BOOT_PTS
+    mov ecx, BOOT_PT_COUNT * 1024
+.direct_pages:
+    stosd
+    add eax, 0x1000
+    loop .direct_pages
+
+    mov eax, BOOT_PTS + PAGE_PRESENT_RW
+    mov edi, BOOT_PD + (KERNEL_VIRT_BASE >> 22) * 4
+    mov ecx, BOOT_PT_COUNT
+.direct_tables:
+    stosd
+    add eax, 0x1000
+    loop .direct_tables
+    mov dword [BOOT_PD], BOOT_PTS + PAGE_PRESENT_RW
+
+.find_framebuffer:
+    ; Mapping the framebuffer window, so printing works before the VMM is initialized
+    lea ebx, [esi + 8] ; First tag
+.next_tag:
+    mov eax, [ebx]     ; Tag type
+    test eax, eax
+    jz .enable_paging  ; End tag, there's no framebuffer
+    cmp eax, 8         ; Framebuffer tag
+    je .map_framebuffer
+    mov eax, [ebx + 4] ; Tag size, tags are 8 byte aligned
+    add eax, 7
+    and eax, ~7
+    add ebx, eax
+    jmp .next_tag
+
+.map_framebuffer:
+    cmp dword [ebx + 12], 0 ; Framebuffers above 4 GiB aren't supported
+    jne .enable_paging
+    mov eax, [ebx + 16]     ; Pitch * height
+    mul dword [ebx + 24]
+    ; The window starts at the framebuffer's 4 MiB boundary
+    mov ecx, [ebx + 8]
+    mov edx, ecx
+    and edx, 0x3FFFFF
+    add eax, edx
+    cmp eax, FB_WINDOW_SIZE
+    jbe .window_fits
+    mov eax, FB_WINDOW_SIZE
+.window_fits:
+    and ecx, ~0x3FFFFF
+    test ebp, ebp
+    jz .framebuffer_pages
+
+    add eax, 0x3FFFFF
+    shr eax, 22
+    or ecx, PAGE_PRESENT_RW | PAGE_LARGE | PAGE_GLOBAL
+    mov edi, BOOT_PD + (FB_WINDOW_ADDR >> 22) * 4
+.framebuffer_large:
+    mov [edi], ecx
+    add edi, 4
+    add ecx, 0x400000
+    dec eax
+    jnz .framebuffer_large
+    jmp .enable_paging
+
+.framebuffer_pages:
+    add eax, 0xFFF
+    shr eax, 12
+    or ecx, PAGE_PRESENT_RW | PAGE_GLOBAL
+    mov edi, BOOT_FB_PTS
+.framebuffer_page:
+    mov [edi], ecx
+    add edi, 4
+    add ecx, 0x1000
+    dec eax
+    jnz .framebuffer_page
+
+    mov eax, BOOT_FB_PTS + PAGE_PRESENT_RW
+    mov edi, BOOT_PD + (FB_WINDOW_ADDR >> 22) * 4
+    mov ecx, BOOT_FB_PT_COUNT
+.framebuffer_tables:
+    stosd
+    add eax, 0x1000
+    loop .framebuffer_tables
+
+.enable_paging:
+    mov eax, BOOT_PD
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 1 << 31 ; Set bit 31 (PG bit)
+    mov cr0, eax
+
+    ; Jumping to the higher half, the VMM drops the identity mapping later on
+    mov eax, higher_half
+    jmp eax
+
+section .text
+
+higher_half:
+    ; The stack and the multiboot info are reached through the direct map from now on
+    add esp, KERNEL_VIRT_BASE
+    add dword [esp + 4], KERNEL_VIRT_BASE
     
     ; Call the kernel
     call kernel_main
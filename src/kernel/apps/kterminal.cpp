@@ -144,6 +144,8 @@ void cmd::init(void) {
     vga::set_cursor_updatability(true);
     vga::update_cursor();
     while (true) {
+        // Sleeping until a key comes in instead of polling the buffer
+        kbrd::wait_key_event();
         kterminal_handle_input();
     }
 }
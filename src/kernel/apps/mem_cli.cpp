@@ -9,15 +9,24 @@
 #include <apps/mem_cli.hpp>
 #include <apps/kterminal.hpp>
 #include <mm/heap.hpp>
+#include <mm/slab.hpp>
 #include <mm/pmm.hpp>
 #include <mm/vmm.hpp>
+#include <mm/vmalloc.hpp>
+#include <mm/memtrace.hpp>
 #include <lib/math.hpp>
+#include <lib/mem_util.hpp>
+#include <x86/cpuid.hpp>
 #include <lib/data/list.hpp>
 #include <lib/data/string.hpp>
+#include <drivers/pit.hpp>
 
 void cmd::mem_cli::register_app() {
     cmd::register_command("heapinfo", heapdump, "", " - Prints kernel heap info");
     cmd::register_command("meminfo", meminfo, "", " - Prints system memory info");
+    cmd::register_command("memstat", memstat, "", " - Prints heap and PMM allocation rates and fragmentation");
+    cmd::register_command("memtrace", memtrace, "", " - Traces allocator calls and shows memory held per call site");
+    cmd::register_command("membench", membench, "", " - Measures memcpy/memset bytes per cycle of every implementation");
 }
 
 static void draw_memory_bar(uint64_t used, uint64_t total) {
@@ -42,21 +51,148 @@ void cmd::mem_cli::heapdump() {
         return;
     }
 
-    HeapBlock* current = heap::heap_head; // Setting the current block as the head
     uint64_t bytes_in_use = 0;
     uint32_t allocated_block_num = 0;
 
-    // Itterating through blocks
-    while(current) {
-        if(!current->free) bytes_in_use += current->size;
-        // Getting next block
-        current = current->next;
+    // Itterating through blocks of the initial window and the extension in physical order
+    HeapBlock* arenas[2] = {heap::heap_head, heap::extension_head()};
+    for(HeapBlock* current : arenas) {
+        while(current) {
+            if(!heap::is_free(current)) bytes_in_use += current->requested;
+            // Getting next block
+            current = heap::next_block(current);
+        }
     }
     // Printing final status of heap
+    uint64_t heap_size = HEAP_SIZE + heap::extension_size;
     kprintf("\n--- Heap Memory Usage ---\n");
-    kprintf(RGB_COLOR_LIGHT_GRAY, "Heap size: %C%S\n", default_rgb_color, get_units(HEAP_SIZE));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Heap size: %C%S (%S grown)\n", default_rgb_color, get_units(heap_size), get_units(heap::extension_size));
     kprintf(RGB_COLOR_LIGHT_GRAY, "Heap status: %C%S used\n", default_rgb_color, get_units(bytes_in_use));
-    draw_memory_bar(bytes_in_use, HEAP_SIZE);
+    draw_memory_bar(bytes_in_use, heap_size);
+
+    if(!slab::enabled) return;
+
+    // Printing per size class usage of the slab allocator
+    kprintf("\n--- Slab Size Classes ---\n");
+    uint64_t slab_bytes = 0;
+    for(uint32_t i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabCache* cache = &slab::caches[i];
+        slab_bytes += cache->slab_count * cache->frames_per_slab * FRAME_SIZE;
+
+        // Hits are allocations that didn't have to wait for a fresh slab
+        uint64_t hit_rate = cache->allocs ? udiv64((cache->allocs - cache->refills) * 100, cache->allocs) : 0;
+        kprintf(RGB_COLOR_LIGHT_GRAY, "%u B: %C%u slabs, %u/%u objects, %llu allocs, %llu frees, %llu%% hits\n",
+            cache->object_size, default_rgb_color, cache->slab_count, cache->objects_in_use, cache->objects_total,
+            cache->allocs, cache->frees, hit_rate);
+    }
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Slab memory: %C%S\n", default_rgb_color, get_units(slab_bytes));
+}
+
+// Counters at the last memstat call, used for rates
+static uint64_t last_heap_allocs = 0;
+static uint64_t last_pmm_allocs = 0;
+static uint64_t last_ticks = 0;
+
+// Returns how many events per second happened in a given amount of ticks
+static uint64_t per_second(const uint64_t events, const uint64_t elapsed_ticks) {
+    return elapsed_ticks ? udiv64(events * frequency, elapsed_ticks) : 0;
+}
+
+/// @brief Prints allocation rates, peak usage and fragmentation of the heap and PMM
+void cmd::mem_cli::memstat() {
+    // No parameters expected
+    if(cmd::mem_cli::get_params().count() != 0) {
+        kprintf("memstat: Syntax: memstat\n");
+        return;
+    }
+    uint64_t now = ticks;
+
+    kprintf("\n--- Heap Allocations ---\n");
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Allocations: %C%llu (%llu/s recently, %llu/s since boot)\n", default_rgb_color, heap::stats.allocs,
+        per_second(heap::stats.allocs - last_heap_allocs, now - last_ticks), per_second(heap::stats.allocs, now));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Frees: %C%llu, %llu failed allocations\n", default_rgb_color, heap::stats.frees, heap::stats.failed);
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Block memory: %C%S used, %S peak\n", default_rgb_color,
+        get_units(heap::stats.block_bytes), get_units(heap::stats.peak_block_bytes));
+
+    kprintf("\n--- Heap Free Blocks ---\n");
+    for(uint32_t i = 0; i < HEAP_BIN_COUNT; i++) {
+        if(!heap::stats.free_blocks[i]) continue;
+        kprintf(RGB_COLOR_LIGHT_GRAY, "%S+: %C%u blocks\n", get_units(16 << i), default_rgb_color, heap::stats.free_blocks[i]);
+    }
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Free: %C%S, largest block %S\n", default_rgb_color,
+        get_units(heap::stats.free_bytes), get_units(heap::largest_free_block()));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "External fragmentation: %C%u%%\n", default_rgb_color, heap::fragmentation());
+
+    BuddyStats buddy = pmm::get_buddy_stats();
+    kprintf("\n--- PMM Allocations ---\n");
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Allocations: %C%llu (%llu/s recently, %llu/s since boot)\n", default_rgb_color, pmm::alloc_count,
+        per_second(pmm::alloc_count - last_pmm_allocs, now - last_ticks), per_second(pmm::alloc_count, now));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Frees: %C%llu\n", default_rgb_color, pmm::free_count);
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Used RAM: %C%S used, %S peak\n", default_rgb_color, get_units(pmm::total_used_ram), get_units(pmm::peak_used_ram));
+
+    kprintf("\n--- PMM Free Blocks ---\n");
+    for(uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        if(!buddy.free_blocks[order]) continue;
+        kprintf(RGB_COLOR_LIGHT_GRAY, "%S: %C%u blocks\n", get_units(FRAME_SIZE << order), default_rgb_color, buddy.free_blocks[order]);
+    }
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Free: %C%S, largest block %S\n", default_rgb_color, get_units(buddy.free_bytes), get_units(buddy.largest_free));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Fragmentation (free RAM outside of 4 MiB blocks): %C%u%%\n\n", default_rgb_color, buddy.fragmentation);
+
+    last_heap_allocs = heap::stats.allocs;
+    last_pmm_allocs = pmm::alloc_count;
+    last_ticks = now;
+}
+
+#define MEMTRACE_LOG_LINES 16 // Records printed by memtrace log
+
+static const char* trace_event_names[] = {"kmalloc", "kfree", "alloc_frame", "free_frame"};
+
+// Prints the newest records of the ring buffer
+static void print_trace_log(void) {
+    uint32_t count = memtrace::total < MEMTRACE_LOG_LINES ? uint32_t(memtrace::total) : MEMTRACE_LOG_LINES;
+    for(uint32_t i = count; i > 0; i--) {
+        TraceRecord* rec = &memtrace::records[uint32_t(memtrace::total - i) & (MEMTRACE_RECORDS - 1)];
+        kprintf(RGB_COLOR_LIGHT_GRAY, "[%llu] %C%s(%u) = %x from %x\n", rec->tick, default_rgb_color,
+            trace_event_names[rec->event], rec->size, rec->ptr, rec->caller);
+    }
+}
+
+// Prints live bytes per call site
+static void print_trace_sites(void) {
+    static TraceSite sites[MEMTRACE_MAX_SITES];
+    uint32_t site_count = memtrace::get_sites(sites, MEMTRACE_MAX_SITES);
+
+    kprintf("\n--- Allocation Call Sites ---\n");
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Tracing: %C%s, %llu records (last %u kept)\n", default_rgb_color,
+        memtrace::enabled ? "on" : "off", memtrace::total, MEMTRACE_RECORDS);
+    for(uint32_t i = 0; i < site_count; i++) {
+        TraceSite* site = &sites[i];
+        kprintf(RGB_COLOR_LIGHT_GRAY, "%x (%s): %C%S live in %u/%u allocations\n", site->caller, site->frames ? "frames" : "heap",
+            default_rgb_color, get_units(site->live_bytes), site->live_allocs, site->allocs);
+    }
+    kprintf("\n");
+}
+
+/// @brief Controls allocator call tracing and prints its results
+void cmd::mem_cli::memtrace() {
+    data::list<data::string> params = cmd::mem_cli::get_params();
+
+    if (params.count() > 1 || (params.count() == 1 && (params.at(0) == "-h" || params.at(0) == "--help"))) {
+        kprintf("Usage: memtrace <option>\n");
+        kprintf("Options:\n");
+        kprintf("  (none)           Display live bytes of every allocation call site\n");
+        kprintf("  on, off          Start or stop recording kmalloc/kfree/alloc_frame/free_frame calls\n");
+        kprintf("  clear            Empty the trace buffer\n");
+        kprintf("  log              Display the newest records\n");
+        return;
+    }
+
+    if (params.count() == 0) print_trace_sites();
+    else if (params.at(0) == "on") memtrace::enabled = true;
+    else if (params.at(0) == "off") memtrace::enabled = false;
+    else if (params.at(0) == "clear") memtrace::clear();
+    else if (params.at(0) == "log") print_trace_log();
+    else kprintf("memtrace: invalid option \"%S\". Try -h\n", params.at(0));
 }
 
 static void print_meminfo(bool verbose) {
@@ -77,17 +213,34 @@ static void print_meminfo(bool verbose) {
         kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel physical start address: %C%x\n", default_rgb_color, pmm::get_kernel_addr());
         kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel physical end address: %C%x\n", default_rgb_color, pmm::get_kernel_end());
         kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel size: %C%S\n", default_rgb_color, get_units(pmm::get_kernel_size()));
+        kprintf(RGB_COLOR_LIGHT_GRAY, "Pre-zeroed frames: %C%u/%u\n", default_rgb_color, pmm::zero_pool_count, PMM_ZERO_POOL_SIZE);
         kprintf("\n");
-        kprintf(RGB_COLOR_LIGHT_GRAY, "Kerne's active Page Directory: %C%x\n", default_rgb_color, vmm::get_active_pd());
+        kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel's page directory (CR3): %C%x\n", default_rgb_color, vmm::get_cr3());
         kprintf(RGB_COLOR_LIGHT_GRAY, "Paging status: %C%s; PAE status: %C%s\n", default_rgb_color, vmm::enabled_paging ? "Enabled" : "Disabled", 
             default_rgb_color, vmm::pae_paging ? "Enabled" : "Disabled");
         kprintf("\n");
         kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel heap size: %C%S\n", default_rgb_color, get_units(HEAP_SIZE));
         kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel heap start address: %C%x\n", default_rgb_color, HEAP_START);
+        kprintf(RGB_COLOR_LIGHT_GRAY, "Kernel heap extension: %C%S at %x\n", default_rgb_color, get_units(heap::extension_size), HEAP_EXT_START);
+        kprintf(RGB_COLOR_LIGHT_GRAY, "vmalloc: %C%S mapped at %x\n", default_rgb_color, get_units(uint64_t(vmalloc_stats.mapped_pages) * PAGE_SIZE), VMALLOC_START);
     }
     kprintf("\n");
 }
 
+static void print_buddy_stats(void) {
+    BuddyStats stats = pmm::get_buddy_stats();
+
+    kprintf("\n--- Buddy Allocator ---\n");
+    for(uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+        kprintf(RGB_COLOR_LIGHT_GRAY, "Order %u (%S): %C%u free blocks\n", order, get_units(FRAME_SIZE << order),
+            default_rgb_color, stats.free_blocks[order]);
+    }
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Free memory: %C%S\n", default_rgb_color, get_units(stats.free_bytes));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Largest free block: %C%S\n", default_rgb_color, get_units(stats.largest_free));
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Fragmentation: %C%u%%\n", default_rgb_color, stats.fragmentation);
+    kprintf("\n");
+}
+
 /// @brief Displays memory information
 void cmd::mem_cli::meminfo() {
     data::list<data::string> params = cmd::mem_cli::get_params();
@@ -98,6 +251,7 @@ void cmd::mem_cli::meminfo() {
         kprintf("Flags:\n");
         kprintf("  -v, --verbose    Display detailed hardware and kernel reservations\n");
         kprintf("  --mmap           Displays memory map\n");
+        kprintf("  --buddy          Displays free blocks of every buddy order and fragmentation\n");
         kprintf("  -h, --help       Show this help message\n");
         return;
     }
@@ -118,6 +272,10 @@ void cmd::mem_cli::meminfo() {
             pmm::print_memory_map();
             return;
         }
+        else if (params.at(0) == "--buddy") {
+            print_buddy_stats();
+            return;
+        }
         else {
             kprintf("meminfo: invalid flag \"%S\". Try -h\n", params.at(0));
             return;
@@ -125,4 +283,94 @@ void cmd::mem_cli::meminfo() {
     }
 
     print_meminfo(verbose);
-}
\ No newline at end of file
+}
+
+#define MEMBENCH_BUFFER_SIZE (64 * 1024)       // Largest benchmarked span
+#define MEMBENCH_BYTES_PER_RUN (2 * 1024 * 1024) // Spans get repeated until this many bytes were moved
+
+// A span memcpy/memset get timed on, offsets are added to page aligned buffers
+struct BenchSpan {
+    const char* name;
+    uint32_t size;
+    uint32_t dest_offset;
+    uint32_t src_offset;
+};
+
+static const BenchSpan bench_spans[] = {
+    {"64 B", 64, 0, 0},
+    {"4 KiB page", PAGE_SIZE, 0, 0},
+    {"4 KiB unaligned", PAGE_SIZE, 1, 3},
+    {"64 KiB", MEMBENCH_BUFFER_SIZE, 0, 0}
+};
+
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile("rdtsc" : "=a"(low), "=d"(high));
+    return (uint64_t(high) << 32) | low;
+}
+
+// Returns the cycles a variant takes to move MEMBENCH_BYTES_PER_RUN bytes in spans of a given size
+static uint64_t time_variant(const mem::Variant v, const bool fill, uint8_t* dest, const uint8_t* src, const uint32_t size) {
+    uint32_t runs = MEMBENCH_BYTES_PER_RUN / size;
+    // Warming up caches and TLB
+    if(fill) mem::fill(v, dest, 0xAA, size);
+    else mem::copy(v, dest, src, size);
+
+    uint64_t start = rdtsc();
+    for(uint32_t i = 0; i < runs; i++) {
+        if(fill) mem::fill(v, dest, uint8_t(i), size);
+        else mem::copy(v, dest, src, size);
+    }
+    return rdtsc() - start;
+}
+
+// Prints bytes per cycle with two decimals
+static void print_rate(const uint64_t bytes, const uint64_t cycles) {
+    uint64_t hundredths = cycles ? udiv64(bytes * 100, cycles) : 0;
+    uint64_t fraction = umod64(hundredths, 100);
+    kprintf("%llu.%llu%llu", udiv64(hundredths, 100), udiv64(fraction, 10), umod64(fraction, 10));
+}
+
+/// @brief Measures bytes per cycle of every memcpy/memset variant
+void cmd::mem_cli::membench() {
+    // No parameters expected
+    if(cmd::mem_cli::get_params().count() != 0) {
+        kprintf("membench: Syntax: membench\n");
+        return;
+    }
+    if(!cpu::has_feature(CPUID_FEAT_EDX_TSC)) {
+        kprintf("membench: CPU has no time stamp counter\n");
+        return;
+    }
+
+    // An extra page for the unaligned spans
+    uint8_t* dest = (uint8_t*)vmalloc(MEMBENCH_BUFFER_SIZE + PAGE_SIZE);
+    uint8_t* src = (uint8_t*)vmalloc(MEMBENCH_BUFFER_SIZE + PAGE_SIZE);
+    if(!dest || !src) {
+        kprintf("membench: Couldn't allocate buffers\n");
+        vfree(dest);
+        vfree(src);
+        return;
+    }
+    mem::fill(mem::variant, src, 0x5A, MEMBENCH_BUFFER_SIZE + PAGE_SIZE);
+
+    kprintf("\n--- memcpy/memset Bytes per Cycle ---\n");
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Selected: %C%s\n", default_rgb_color, mem::variant_names[mem::variant]);
+    for(const BenchSpan& span : bench_spans) {
+        uint32_t bytes = (MEMBENCH_BYTES_PER_RUN / span.size) * span.size;
+        for(uint32_t op = 0; op < 2; op++) {
+            bool fill = op == 1;
+            kprintf(RGB_COLOR_LIGHT_GRAY, "%s %s:%C", fill ? "memset" : "memcpy", span.name, default_rgb_color);
+            for(uint32_t v = 0; v < mem::VARIANT_COUNT; v++) {
+                uint64_t cycles = time_variant(mem::Variant(v), fill, dest + span.dest_offset, src + span.src_offset, span.size);
+                kprintf(" %s ", mem::variant_names[v]);
+                print_rate(bytes, cycles);
+            }
+            kprintf("\n");
+        }
+    }
+    kprintf("\n");
+
+    vfree(dest);
+    vfree(src);
+}
@@ -16,6 +16,10 @@
 #include <drivers/pci.hpp>
 #include <drivers/vga.hpp>
 #include <sched/process.hpp>
+#include <sched/scheduler.hpp>
+#include <sched/timer.hpp>
+#include <x86/sched/context.hpp>
+#include <mm/heap.hpp>
 #include <lib/math.hpp>
 
 void cmd::sys_cli::register_app() {
@@ -23,7 +27,9 @@ void cmd::sys_cli::register_app() {
     cmd::register_command("uptime", uptime, "", " - Prints how much time the systems been on since booting");
     cmd::register_command("currtime", currtime, "", " - Prints current time");
     cmd::register_command("lsprcss", lsprocesses, "", " - Lists active processes");
+    cmd::register_command("lscpus", lscpus, "", " - Lists online CPUs with their scheduler load and steal counters");
     cmd::register_command("lspci", lspci, "", " - Lists attached PCI devices");
+    cmd::register_command("ctxbench", ctxbench, "", " - Measures context switches per second of the fast and full switch paths");
 }
 
 void cmd::sys_cli::sysinfo() {
@@ -89,11 +95,77 @@ void cmd::sys_cli::lsprocesses() {
                 break;
         }
 
-        kprintf("PID: %u, Name: %s, Stack: %x, Priority: %u, State: %s\n", p->get_pid(), p->get_name(), p->get_stack(), p->get_priority(), 
-            state);
+        kprintf("PID: %u, Name: %s, Stack: %x, Priority: %u, CPU: %u, State: %s\n", p->get_pid(), p->get_name(), p->get_stack(), p->get_priority(), 
+            p->get_cpu(), state);
     }
 }
 
+void cmd::sys_cli::lscpus() {
+    for(uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if(!smp::cpus[i].online) continue;
+        kprintf("CPU: %u, APIC ID: %u, Load: %u, Stole: %u, Stolen: %u\n", i, smp::cpus[i].apic_id, sched::get_load(i),
+            sched::get_steals(i), sched::get_stolen(i));
+    }
+}
+
+#define CTXBENCH_MS 100 // Time every switch path gets measured for
+
+static context_t bench_main_ctx, bench_partner_ctx;
+static volatile bool bench_fast;
+
+// Switches straight back to the terminal every time it's switched to
+static void bench_partner(void) {
+    for(;;) {
+        if(bench_fast) ctx_switch_fast(&bench_partner_ctx, &bench_main_ctx);
+        else ctx_switch(&bench_partner_ctx, &bench_main_ctx);
+    }
+}
+
+// Returns switches per second between the terminal and a partner thread running on <stack>
+static uint32_t bench_switches(const bool fast, void* stack) {
+    bench_fast = fast;
+    ctx_init_kernel(&bench_partner_ctx, (uint32_t)stack + KERNEL_PROCESS_STACK_SIZE, bench_partner);
+
+    // Every round trip is two switches, timer interrupts keep coming in between
+    uint32_t switches = 0;
+    uint64_t end = ticks + timer::ms_to_ticks(CTXBENCH_MS);
+    while(ticks < end) {
+        if(fast) ctx_switch_fast(&bench_main_ctx, &bench_partner_ctx);
+        else ctx_switch(&bench_main_ctx, &bench_partner_ctx);
+        switches += 2;
+    }
+    return switches * (1000 / CTXBENCH_MS);
+}
+
+/// @brief Measures context switches per second of the fast and full switch paths
+void cmd::sys_cli::ctxbench() {
+    // No parameters expected
+    if(cmd::sys_cli::get_params().count() != 0) {
+        kprintf("ctxbench: Syntax: ctxbench\n");
+        return;
+    }
+
+    // The partner never returns, it's dropped together with its stack
+    void* stack = kmalloc(KERNEL_PROCESS_STACK_SIZE);
+    if(!stack) {
+        kprintf("ctxbench: Couldn't allocate a stack\n");
+        return;
+    }
+
+    uint32_t fast = bench_switches(true, stack);
+    uint32_t full = bench_switches(false, stack);
+    kfree(stack);
+
+    kprintf("\n--- Context Switches per Second ---\n");
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Fast path (callee-saved registers, ESP):%C %u\n", default_rgb_color, fast);
+    kprintf(RGB_COLOR_LIGHT_GRAY, "Full path (segments, CR3, iretd):%C %u\n", default_rgb_color, full);
+    if(full) {
+        uint32_t hundredths = (uint32_t)udiv64(uint64_t(fast) * 100, full);
+        kprintf(RGB_COLOR_LIGHT_GRAY, "Speedup:%C %u.%u%ux\n", default_rgb_color, hundredths / 100, hundredths / 10 % 10, hundredths % 10);
+    }
+    kprintf("\n");
+}
+
 void cmd::sys_cli::lspci() {
     for(PciDevice pci : pci_devices) {
         pci.log_pci_info();
@@ -0,0 +1,101 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// acpi.cpp
+// Finds ACPI tables through the RSDP GRUB hands over
+// ========================================
+
+#include <x86/acpi.hpp>
+#include <multiboot.hpp>
+#include <mm/vmm.hpp>
+#include <mm/pmm.hpp>
+#include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
+
+bool acpi::found = false;
+
+static acpi_sdt_header* root = nullptr; // RSDT or XSDT
+static bool extended = false;           // Root is an XSDT with 64-bit entries
+
+#pragma region Helpers
+
+// Returns if all bytes of a table add up to 0
+static bool checksum_ok(const void* table, const uint32_t length) {
+    uint8_t sum = 0;
+    for(uint32_t i = 0; i < length; i++) sum += ((const uint8_t*)table)[i];
+    return sum == 0;
+}
+
+// Maps <size> bytes at a physical address, memory in the direct map is used as is
+static void* map_physical(const uint32_t phys_addr, const uint32_t size) {
+    if(phys_addr + size > phys_addr && phys_addr + size <= pmm::get_direct_map_end())
+        return (void*)PHYS_TO_VIRT(phys_addr);
+    return vmm::map_mmio(phys_addr, size, PRESENT | WRITABLE);
+}
+
+// Maps a whole table, returns nullptr if its checksum is wrong
+static acpi_sdt_header* map_table(const uint32_t phys_addr) {
+    acpi_sdt_header* header = (acpi_sdt_header*)map_physical(phys_addr, sizeof(acpi_sdt_header));
+    if(!header) return nullptr;
+
+    uint32_t length = header->length;
+    if(length < sizeof(acpi_sdt_header)) return nullptr;
+    // Remapping if the table continues past the mapped page
+    if(PAGE_OFFSET(phys_addr) + length > PAGE_SIZE)
+        header = (acpi_sdt_header*)map_physical(phys_addr, length);
+    if(!header || !checksum_ok(header, length)) return nullptr;
+    return header;
+}
+
+#pragma endregion
+
+/// @brief Finds the RSDP in the multiboot info and maps the RSDT/XSDT
+void acpi::init(void* mb2_info) {
+    multiboot_tag_acpi* tag = Multiboot2::get_acpi(mb2_info);
+    if(!tag) {
+        kprintf(LOG_WARNING, "No ACPI tables found\n");
+        return;
+    }
+
+    acpi_rsdp* rsdp = (acpi_rsdp*)tag->rsdp;
+    if(memcmp(rsdp->signature, "RSD PTR ", 8) != 0 || !checksum_ok(rsdp, 20)) {
+        kprintf(LOG_WARNING, "ACPI RSDP is invalid\n");
+        return;
+    }
+
+    // The XSDT is used when it's reachable from 32-bit, the RSDT otherwise
+    if(rsdp->revision >= 2 && rsdp->xsdt_address && (rsdp->xsdt_address >> 32) == 0) {
+        root = map_table((uint32_t)rsdp->xsdt_address);
+        extended = root != nullptr;
+    }
+    if(!root) root = map_table(rsdp->rsdt_address);
+    if(!root) {
+        kprintf(LOG_WARNING, "ACPI root table is invalid\n");
+        return;
+    }
+
+    found = true;
+    kprintf(LOG_INFO, "Found ACPI %s at %x\n", extended ? "XSDT" : "RSDT", extended ? (uint32_t)rsdp->xsdt_address : rsdp->rsdt_address);
+}
+
+/// @brief Returns the mapped table with a given signature, nullptr if there's none
+acpi_sdt_header* acpi::find_table(const char* signature) {
+    if(!found) return nullptr;
+
+    uint32_t entry_size = extended ? sizeof(uint64_t) : sizeof(uint32_t);
+    uint32_t entries = (root->length - sizeof(acpi_sdt_header)) / entry_size;
+    uint8_t* first = (uint8_t*)root + sizeof(acpi_sdt_header);
+
+    for(uint32_t i = 0; i < entries; i++) {
+        uint64_t address = 0;
+        memcpy(&address, first + i * entry_size, entry_size); // XSDT entries aren't 8 byte aligned
+        if(!address || (address >> 32)) continue;
+
+        // Looking at the signature first, so only the wanted table gets mapped as a whole
+        acpi_sdt_header* header = (acpi_sdt_header*)map_physical((uint32_t)address, sizeof(acpi_sdt_header));
+        if(!header || memcmp(header->signature, signature, 4) != 0) continue;
+        return map_table((uint32_t)address);
+    }
+    return nullptr;
+}
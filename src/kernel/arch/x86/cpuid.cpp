@@ -8,6 +8,7 @@
 
 #include <x86/cpuid.hpp>
 #include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
 
 // Gets the processor model
 void cpu::get_processor_model(char* buffer) {
@@ -55,6 +56,8 @@ void cpu::get_processor_info(void) {
     get_vendor(cpu_vendor);
     // Getting model
     get_processor_model(cpu_model_name);
+    // Picking memcpy/memset for this CPU
+    mem::select_variant();
     return;
 }
 
@@ -71,3 +74,24 @@ CPUIDResult cpu::cpuid(const uint32_t eax_input) {
 
     return result;
 }
+
+// Returns if the CPU reports a CPUID_FEATURES EDX feature
+bool cpu::has_feature(const uint32_t edx_feature) {
+    if(cpuid(CPUID_VENDOR_STRING).eax < CPUID_FEATURES) return false;
+    return cpuid(CPUID_FEATURES).edx & edx_feature;
+}
+
+// Returns if the CPU reports a CPUID_EXTENDED_FEATURES EBX feature
+bool cpu::has_extended_feature(const uint32_t ebx_feature) {
+    if(cpuid(CPUID_VENDOR_STRING).eax < CPUID_EXTENDED_FEATURES) return false;
+    return cpuid(CPUID_EXTENDED_FEATURES).ebx & ebx_feature;
+}
+
+// Returns the CPU family with the extended family added
+uint32_t cpu::get_family(void) {
+    if(cpuid(CPUID_VENDOR_STRING).eax < CPUID_FEATURES) return 4; // Only 486s lack leaf 1
+    uint32_t eax = cpuid(CPUID_FEATURES).eax;
+    uint32_t family = (eax >> 8) & 0xF;
+    if(family == 0xF) family += (eax >> 20) & 0xFF;
+    return family;
+}
@@ -0,0 +1,190 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// fpu.cpp
+// Lazy FPU/SSE state switching and kernel SIMD sections
+// ========================================
+
+#include <x86/fpu.hpp>
+#include <x86/cpuid.hpp>
+#include <sched/scheduler.hpp>
+#include <x86/smp.hpp>
+#include <graphics/vga_print.hpp>
+#include <mm/heap.hpp>
+#include <lib/mem_util.hpp>
+
+bool fpu::enabled = false;
+bool fpu::fxsr = false;
+bool fpu::sse2 = false;
+uint64_t fpu::lazy_restores = 0;
+
+// State after FNINIT, new processes start with it
+alignas(FPU_STATE_ALIGN) static uint8_t initial_state[FPU_STATE_SIZE];
+
+// Every CPU has its own FPU registers, so ownership and kernel SIMD sections are tracked per CPU
+struct FpuCpu {
+    Process* owner;         // Process whose state is in the CPU's FPU registers
+    uint32_t section_depth;
+    uint32_t section_flags; // EFLAGS before the outermost fpu::begin
+};
+static FpuCpu cpu_fpus[SMP_MAX_CPUS];
+
+// Only valid with interrupts off, otherwise the caller could move to another CPU
+static inline FpuCpu* this_fpu(void) {
+    return &cpu_fpus[smp::cpu_index()];
+}
+
+#pragma region Helpers
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(const uint32_t cr0) {
+    asm volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
+}
+
+static inline void clts(void) {
+    asm volatile("clts" ::: "memory");
+}
+
+static inline void stts(void) {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void save(void* state) {
+    if(fpu::fxsr) asm volatile("fxsave (%0)" :: "r"(state) : "memory");
+    else asm volatile("fnsave (%0); fwait" :: "r"(state) : "memory"); // FNSAVE also reinitializes the FPU
+}
+
+static inline void restore(const void* state) {
+    if(fpu::fxsr) asm volatile("fxrstor (%0)" :: "r"(state) : "memory");
+    else asm volatile("frstor (%0)" :: "r"(state) : "memory");
+}
+
+#pragma endregion
+
+// Enables the FPU and SSE, sets CR0.TS so the first user traps
+void fpu::init(void) {
+    if(!cpu::has_feature(CPUID_FEAT_EDX_FPU)) {
+        kprintf(LOG_WARNING, "No FPU found, FPU instructions will fault\n");
+        return;
+    }
+
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+    fxsr = cpu::has_feature(CPUID_FEAT_EDX_FXSR);
+    if(fxsr) {
+        uint32_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR;
+        if(cpu::has_feature(CPUID_FEAT_EDX_SSE)) cr4 |= CR4_OSXMMEXCPT;
+        asm volatile("mov %0, %%cr4" :: "r"(cr4));
+        sse2 = cpu::has_feature(CPUID_FEAT_EDX_SSE2);
+    }
+
+    asm volatile("fninit");
+    save(initial_state);
+
+    // Nobody owns the registers yet, the first FPU instruction traps
+    stts();
+    enabled = true;
+    kprintf(LOG_INFO, "Enabled FPU with lazy %s state switching%s\n", fxsr ? "FXSAVE" : "FNSAVE", sse2 ? ", SSE2 available" : "");
+}
+
+// Resets the FPU of an AP, CR0 and CR4 already came from the boot CPU
+void fpu::init_cpu(void) {
+    if(!enabled) return;
+    clts();
+    asm volatile("fninit");
+    stts();
+}
+
+// Returns the process whose state is in this CPU's FPU registers
+Process* fpu::get_owner(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    Process* owner = this_fpu()->owner;
+    if(flags & 0x200) asm volatile("sti" ::: "memory");
+    return owner;
+}
+
+/* Returns if <proc>'s state is in the FPU registers of <cpu>. Only the process running on a CPU
+ * can become its owner, so a queued process that isn't the owner can't turn into it */
+bool fpu::held_by(const uint32_t cpu, Process* proc) {
+    return enabled && cpu_fpus[cpu].owner == proc;
+}
+
+// Called on every task switch, sets CR0.TS unless <next> still owns the FPU registers
+void fpu::switch_to(Process* next) {
+    if(!enabled) return;
+    if(next == this_fpu()->owner) clts();
+    else stts();
+}
+
+// #NM handler, loads the current process' state. Returns false if there's no FPU to switch
+bool fpu::handle_device_not_available(void) {
+    if(!enabled) return false;
+    clts();
+
+    FpuCpu* cpu = this_fpu();
+    Process* proc = sched::current();
+    if(proc == cpu->owner) return true;
+
+    // The registers still hold the previous owner's state
+    if(cpu->owner) save(cpu->owner->get_fpu_state());
+    cpu->owner = nullptr;
+    // Code running before the scheduler just keeps the registers
+    if(!proc) return true;
+
+    // Processes get their state on first use
+    void* state = proc->get_fpu_state();
+    if(!state) {
+        state = kmalloc_aligned(FPU_STATE_SIZE, FPU_STATE_ALIGN);
+        if(!state) return false;
+        memcpy(state, initial_state, FPU_STATE_SIZE);
+        proc->set_fpu_state(state);
+    }
+    restore(state);
+
+    cpu->owner = proc;
+    lazy_restores++;
+    return true;
+}
+
+// Forgets a terminated process' state
+void fpu::release(Process* proc) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    if(this_fpu()->owner == proc) this_fpu()->owner = nullptr;
+    if(flags & 0x200) asm volatile("sti" ::: "memory");
+}
+
+/* Lets kernel code use SSE2 until fpu::end, the registers of their owner get saved first.
+ * Interrupts stay off in between, so sections should be short */
+bool fpu::begin(void) {
+    if(!sse2) return false;
+
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    FpuCpu* cpu = this_fpu();
+    if(cpu->section_depth++ == 0) {
+        cpu->section_flags = flags;
+        clts();
+        // The owner's next FPU instruction traps and loads its state again
+        if(cpu->owner) save(cpu->owner->get_fpu_state());
+        cpu->owner = nullptr;
+    }
+    return true;
+}
+
+void fpu::end(void) {
+    FpuCpu* cpu = this_fpu();
+    if(--cpu->section_depth) return;
+    // Whoever uses the FPU next traps and loads their own state
+    stts();
+    if(cpu->section_flags & 0x200) asm volatile("sti" ::: "memory");
+}
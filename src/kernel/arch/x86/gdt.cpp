@@ -7,30 +7,15 @@
 // ========================================
 
 #include <x86/gdt.hpp>
+#include <x86/smp.hpp>
 #include <graphics/vga_print.hpp>
 #include <lib/mem_util.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
 
-// Arrays and variables
-__attribute__((aligned(8))) gdt_entry gdt_entries[GDT_SEGMENT_QUANTITY];
-gdt_ptr _gdt_ptr;
-tss_entry _tss_entry;
-
 void gdt::init(void) {
-    // Set up GDT pointer
-    _gdt_ptr.limit = (sizeof(struct gdt_entry) * GDT_SEGMENT_QUANTITY) - 1;
-    _gdt_ptr.base = uint32_t(&gdt_entries); // Address of gdt_entries[0]
-
-    // Setting up GDT registers
-    set_gdt_gate(0, 0, 0, 0, 0); //Null segment
-    set_gdt_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); // Kernel code segment
-    set_gdt_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF); // Kernel data segment
-    set_gdt_gate(3, 0, 0xFFFFFFFF, 0xFA, 0xCF); // User code segment
-    set_gdt_gate(4, 0, 0xFFFFFFFF, 0xF2, 0xCF); // User data segment
-    write_tss(5, 0x10, 0x0); // TSS
+    // The boot CPU is always smp::cpus[0]
+    init_cpu(&smp::cpus[0]);
 
-    // Flushing GDT and TSS
-    gdt_flush((uint32_t)&_gdt_ptr);
     // Checking DS to confirm GDT flush
     uint8_t value;
     asm volatile ("mov %%ds, %0" : "=m"(value));
@@ -39,38 +24,56 @@ void gdt::init(void) {
         kernel_panic("Fatal component failed to initialize!");
     }
     else kprintf(LOG_INFO, "Implemented Global Descriptor Table\n");
+}
 
-    // coords = vga::printf("[ ");
-    // vga::printf(" ]    Implementing Task State Segment\n");
-    // tss_flush();
-    // vga::insert(coords.row, coords.col, " OK ", false, PRINT_COLOR_GREEN | (PRINT_COLOR_BLACK << 4));
+/// @brief Builds and loads the GDT and TSS of the running CPU, GS ends up pointing at <cpu>
+void gdt::init_cpu(Cpu* cpu) {
+    cpu->self = cpu;
+
+    // Set up GDT pointer
+    cpu->gdtr.limit = (sizeof(struct gdt_entry) * GDT_SEGMENT_QUANTITY) - 1;
+    cpu->gdtr.base = uint32_t(&cpu->gdt); // Address of the CPU's gdt[0]
+
+    // Setting up GDT registers
+    set_gdt_gate(cpu->gdt, 0, 0, 0, 0, 0); //Null segment
+    set_gdt_gate(cpu->gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF); // Kernel code segment
+    set_gdt_gate(cpu->gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF); // Kernel data segment
+    set_gdt_gate(cpu->gdt, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF); // User code segment
+    set_gdt_gate(cpu->gdt, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF); // User data segment
+    write_tss(cpu, 5, 0x10, 0x0); // TSS
+    set_gdt_gate(cpu->gdt, 6, uint32_t(cpu), sizeof(Cpu) - 1, 0x92, 0x40); // CPU segment, byte granular
+
+    // Flushing GDT and TSS
+    gdt_flush((uint32_t)&cpu->gdtr);
+    tss_flush();
+    asm volatile("mov %0, %%gs" :: "r"((uint16_t)GDT_CPU_SELECTOR) : "memory");
 }
 
-void gdt::set_gdt_gate(const uint32_t num, const uint32_t base, const uint32_t limit, const uint8_t access, const uint8_t gran) {
+void gdt::set_gdt_gate(gdt_entry* gdt, const uint32_t num, const uint32_t base, const uint32_t limit, const uint8_t access, const uint8_t gran) {
     // Setting up bases
-    gdt_entries[num].base_low = (base & 0xFFFF);
-    gdt_entries[num].base_middle = (base >> 16) & 0xFF;
-    gdt_entries[num].base_high = (base >> 24) & 0xFF;
+    gdt[num].base_low = (base & 0xFFFF);
+    gdt[num].base_middle = (base >> 16) & 0xFF;
+    gdt[num].base_high = (base >> 24) & 0xFF;
 
     // Flags, limit and access flags
-    gdt_entries[num].limit = (limit & 0xFFFF);
-    gdt_entries[num].flags = (limit >> 16) & 0x0F;
-    gdt_entries[num].flags |= (gran & 0xF0); // Granuality
-    gdt_entries[num].access = access;
+    gdt[num].limit = (limit & 0xFFFF);
+    gdt[num].flags = (limit >> 16) & 0x0F;
+    gdt[num].flags |= (gran & 0xF0); // Granuality
+    gdt[num].access = access;
 
 }
 
-void gdt::write_tss(const uint32_t num, const uint16_t ss0, const uint32_t esp0) {
-    uint32_t base = (uint32_t)&_tss_entry; // TSS address
-    uint32_t limit = base + sizeof(_tss_entry);
+void gdt::write_tss(Cpu* cpu, const uint32_t num, const uint16_t ss0, const uint32_t esp0) {
+    uint32_t base = (uint32_t)&cpu->tss; // TSS address
+    uint32_t limit = sizeof(cpu->tss) - 1;
 
     // Setting in GDT
-    gdt::set_gdt_gate(num, base, limit, 0xE9, 0x00);
-    memset(&_tss_entry, 0, sizeof(_tss_entry));
+    gdt::set_gdt_gate(cpu->gdt, num, base, limit, 0xE9, 0x00);
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
 
     // Setting TSS flags/properties
-    _tss_entry.ss0 = ss0;
-    _tss_entry.esp0 = esp0;
-    _tss_entry.cs = 0x08 | 0x3;
-    _tss_entry.ss = _tss_entry.ds = _tss_entry.es = _tss_entry.fs = _tss_entry.gs = 0x10 | 0x3;
+    cpu->tss.ss0 = ss0;
+    cpu->tss.esp0 = esp0;
+    cpu->tss.cs = 0x08 | 0x3;
+    cpu->tss.ss = cpu->tss.ds = cpu->tss.es = cpu->tss.fs = cpu->tss.gs = 0x10 | 0x3;
 }
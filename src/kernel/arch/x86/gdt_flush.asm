@@ -32,10 +32,10 @@ gdt_flush:
     .flush:
         ret ; Returning
 
-; Legacy TSS flush, before userland
-; tss_flush:
-;     mov ax, 0x28 ; TSS segment in GDT (6th segment)
-;     ltr ax
+; Loads the running CPU's TSS, every CPU has its own in its own GDT
+tss_flush:
+    mov ax, 0x28 ; TSS segment in GDT (6th segment)
+    ltr ax
 
-;     ret
+    ret
     
\ No newline at end of file
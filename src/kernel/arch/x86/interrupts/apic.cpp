@@ -0,0 +1,292 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// apic.cpp
+// Local APIC, IOAPIC routing and the LAPIC timer
+// ========================================
+
+#include <x86/interrupts/apic.hpp>
+#include <x86/interrupts/idt.hpp>
+#include <x86/interrupts/pic.hpp>
+#include <x86/acpi.hpp>
+#include <x86/cpuid.hpp>
+#include <x86/io.hpp>
+#include <drivers/pit.hpp>
+#include <sched/scheduler.hpp>
+#include <sched/spinlock.hpp>
+#include <x86/smp.hpp>
+#include <mm/vmm.hpp>
+#include <graphics/vga_print.hpp>
+
+bool apic::enabled = false;
+bool apic::timer_enabled = false;
+uint32_t apic::timer_counts_per_tick = 0;
+uint8_t apic::cpu_ids[APIC_MAX_CPUS];
+uint32_t apic::cpu_count = 0;
+
+static volatile uint32_t* lapic = nullptr;
+
+struct IOApic {
+    volatile uint32_t* regs;
+    uint32_t gsi_base;
+    uint32_t pins;
+};
+static IOApic ioapics[APIC_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+static Spinlock ioapic_lock; // IOREGSEL/IOWIN pairs can't interleave between CPUs
+static uint8_t boot_apic_id = 0; // ISA IRQs always go here, whichever CPU (un)masks them
+
+// Where an ISA IRQ ends up, after the MADT's interrupt overrides
+struct IsaRoute {
+    uint32_t gsi;
+    uint32_t flags; // Polarity and trigger mode bits of the redirection entry
+};
+static IsaRoute isa_routes[ISA_IRQ_COUNT];
+
+#pragma region Helpers
+
+static inline uint32_t lapic_read(const uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(const uint32_t reg, const uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static inline uint32_t ioapic_read(IOApic* io, const uint32_t reg) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    return io->regs[IOAPIC_WIN / 4];
+}
+
+static inline void ioapic_write(IOApic* io, const uint32_t reg, const uint32_t value) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    io->regs[IOAPIC_WIN / 4] = value;
+}
+
+static inline uint64_t rdmsr(const uint32_t msr) {
+    uint32_t low, high;
+    asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+    return ((uint64_t)high << 32) | low;
+}
+
+static inline void wrmsr(const uint32_t msr, const uint64_t value) {
+    asm volatile("wrmsr" :: "a"((uint32_t)value), "d"((uint32_t)(value >> 32)), "c"(msr));
+}
+
+// Returns the IOAPIC handling a GSI and its pin on it, nullptr if no IOAPIC does
+static IOApic* ioapic_of(const uint32_t gsi, uint32_t* pin) {
+    for(uint32_t i = 0; i < ioapic_count; i++) {
+        if(gsi < ioapics[i].gsi_base || gsi >= ioapics[i].gsi_base + ioapics[i].pins) continue;
+        *pin = gsi - ioapics[i].gsi_base;
+        return &ioapics[i];
+    }
+    return nullptr;
+}
+
+// Writes the redirection entry of an ISA IRQ, it's delivered to the boot CPU as vector 32 + irq
+static void route_isa_irq(const uint8_t irq, const bool masked) {
+    uint32_t pin;
+    IOApic* io = ioapic_of(isa_routes[irq].gsi, &pin);
+    if(!io) return;
+
+    uint32_t low = (32 + irq) | isa_routes[irq].flags | (masked ? IOAPIC_MASKED : 0);
+    uint32_t flags = ioapic_lock.lock_irqsave();
+    ioapic_write(io, IOAPIC_REDTBL(pin) + 1, (uint32_t)boot_apic_id << 24);
+    ioapic_write(io, IOAPIC_REDTBL(pin), low);
+    ioapic_lock.unlock_irqrestore(flags);
+}
+
+// Collects the LAPIC address, CPUs, IOAPICs and ISA overrides, returns false if the MADT is unusable
+static bool parse_madt(acpi_madt* madt) {
+    uint64_t lapic_phys = madt->lapic_address;
+    for(uint32_t irq = 0; irq < ISA_IRQ_COUNT; irq++) isa_routes[irq] = {irq, 0}; // Identity, edge triggered and active high
+
+    uint8_t* entry = (uint8_t*)madt + sizeof(acpi_madt);
+    uint8_t* end = (uint8_t*)madt + madt->header.length;
+    while(entry + sizeof(madt_entry) <= end) {
+        madt_entry* header = (madt_entry*)entry;
+        if(header->length < sizeof(madt_entry)) break;
+
+        switch(header->type) {
+            case MADT_LAPIC: {
+                madt_lapic* cpu = (madt_lapic*)entry;
+                if((cpu->flags & 1) && apic::cpu_count < APIC_MAX_CPUS) apic::cpu_ids[apic::cpu_count++] = cpu->apic_id;
+                break;
+            }
+            case MADT_IOAPIC: {
+                madt_ioapic* io = (madt_ioapic*)entry;
+                if(ioapic_count >= APIC_MAX_IOAPICS) break;
+                IOApic* ioapic = &ioapics[ioapic_count];
+                ioapic->regs = (volatile uint32_t*)vmm::map_mmio(io->address, PAGE_SIZE, PRESENT | WRITABLE | NOTCACHABLE);
+                if(!ioapic->regs) break;
+                ioapic->gsi_base = io->gsi_base;
+                ioapic->pins = ((ioapic_read(ioapic, IOAPIC_VERSION) >> 16) & 0xFF) + 1;
+                ioapic_count++;
+                break;
+            }
+            case MADT_INTERRUPT_OVERRIDE: {
+                madt_interrupt_override* iso = (madt_interrupt_override*)entry;
+                if(iso->bus != 0 || iso->source >= ISA_IRQ_COUNT) break;
+                uint32_t flags = 0;
+                if((iso->flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW) flags |= IOAPIC_ACTIVE_LOW;
+                if((iso->flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) flags |= IOAPIC_LEVEL;
+                isa_routes[iso->source] = {iso->gsi, flags};
+                break;
+            }
+            case MADT_LAPIC_ADDRESS_OVERRIDE:
+                lapic_phys = ((madt_lapic_address_override*)entry)->address;
+                break;
+        }
+        entry += header->length;
+    }
+
+    if(ioapic_count == 0 || (lapic_phys >> 32)) return false;
+    lapic = (volatile uint32_t*)vmm::map_mmio((uint32_t)lapic_phys, PAGE_SIZE, PRESENT | WRITABLE | NOTCACHABLE);
+    return lapic != nullptr;
+}
+
+// Enables the running CPU's LAPIC, the PIC's virtual wire (LINT0) is masked and LINT1 delivers NMIs
+static void enable_lapic(void) {
+    wrmsr(IA32_APIC_BASE_MSR, rdmsr(IA32_APIC_BASE_MSR) | IA32_APIC_BASE_ENABLE);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+// Starts the running CPU's LAPIC timer in periodic mode at the calibrated rate
+static void start_timer(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | (32 + APIC_TIMER_IRQ));
+    lapic_write(LAPIC_TIMER_INIT, apic::timer_counts_per_tick);
+}
+
+// LAPIC timer tick, the boot CPU keeps time and the others only schedule
+static void on_timer(InterruptRegisters* regs) {
+    if(smp::cpu_index() == 0) pit::tick();
+    else sched::tick();
+}
+
+#pragma endregion
+
+/// @brief Enables the LAPIC and routes ISA IRQs through the IOAPIC, keeps the 8259 PIC if there's no MADT
+void apic::init(void) {
+    if(!cpu::has_feature(CPUID_FEAT_EDX_APIC)) {
+        kprintf(LOG_WARNING, "CPU has no APIC, using the 8259 PIC\n");
+        return;
+    }
+    acpi_madt* madt = (acpi_madt*)acpi::find_table(ACPI_SIG_MADT);
+    if(!madt || !parse_madt(madt)) {
+        kprintf(LOG_WARNING, "No usable ACPI MADT, using the 8259 PIC\n");
+        return;
+    }
+
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+
+    // Both PICs get fully masked, they keep their vectors 32-47 in case of spurious interrupts
+    io::outPortB(PIC_MASTER_DATA, 0xFF);
+    io::outPortB(PIC_SLAVE_DATA, 0xFF);
+
+    enable_lapic();
+    boot_apic_id = get_id();
+
+    // Every IOAPIC pin starts masked
+    for(uint32_t i = 0; i < ioapic_count; i++)
+        for(uint32_t pin = 0; pin < ioapics[i].pins; pin++)
+            ioapic_write(&ioapics[i], IOAPIC_REDTBL(pin), IOAPIC_MASKED);
+
+    /* ISA IRQs are unmasked like they were on the PIC, except level triggered ones (like the ACPI SCI)
+     * that would fire again and again until a driver unmasks and handles them. IRQ 2 is the PIC cascade */
+    for(uint8_t irq = 0; irq < ISA_IRQ_COUNT; irq++) {
+        if(irq == 2) continue;
+        route_isa_irq(irq, isa_routes[irq].flags & IOAPIC_LEVEL);
+    }
+    enabled = true;
+
+    if(flags & 0x200) asm volatile("sti" ::: "memory");
+    kprintf(LOG_INFO, "Implemented APIC with %u CPU(s) and %u IOAPIC(s), LAPIC ID %u\n", cpu_count, ioapic_count, get_id());
+}
+
+/// @brief Calibrates the LAPIC timer against the PIT and moves the scheduler tick to it
+void apic::init_timer(void) {
+    if(!enabled) return;
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r"(flags));
+    if(!(flags & 0x200)) {
+        kprintf(LOG_WARNING, "LAPIC timer can't be calibrated with interrupts off, the PIT keeps the tick\n");
+        return;
+    }
+
+    // Counting down from the maximum in one shot mode for APIC_CALIBRATION_TICKS, starting on a tick edge
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | (32 + APIC_TIMER_IRQ));
+    uint64_t start = ticks;
+    while(ticks == start) asm volatile("hlt");
+    start = ticks;
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    while(ticks - start < APIC_CALIBRATION_TICKS) asm volatile("hlt");
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    timer_counts_per_tick = elapsed / APIC_CALIBRATION_TICKS;
+    if(timer_counts_per_tick == 0) {
+        kprintf(LOG_WARNING, "LAPIC timer didn't count, the PIT keeps the tick\n");
+        return;
+    }
+
+    // Switching the tick over, the PIT keeps running but its IRQ is masked
+    idt::irq_install_handler(APIC_TIMER_IRQ, on_timer);
+    asm volatile("cli" ::: "memory");
+    mask_irq(PIT_IRQ);
+    start_timer();
+    timer_enabled = true;
+    asm volatile("sti" ::: "memory");
+
+    kprintf(LOG_INFO, "LAPIC timer drives the tick at %u Hz (%u counts per tick)\n", frequency, timer_counts_per_tick);
+}
+
+/// @brief Enables the LAPIC of an AP and starts its timer with the boot CPU's calibration
+void apic::init_cpu(void) {
+    if(!enabled) return;
+    enable_lapic();
+    if(timer_enabled) start_timer();
+}
+
+/// @brief Acknowledges the interrupt in service, a single MMIO write
+void apic::send_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/// @brief Masks an ISA IRQ at the IOAPIC
+void apic::mask_irq(const uint8_t irq) {
+    if(irq >= ISA_IRQ_COUNT) return;
+    route_isa_irq(irq, true);
+}
+
+/// @brief Unmasks an ISA IRQ at the IOAPIC
+void apic::unmask_irq(const uint8_t irq) {
+    if(irq >= ISA_IRQ_COUNT) return;
+    route_isa_irq(irq, false);
+}
+
+/// @brief Returns the APIC ID of the running CPU
+uint8_t apic::get_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/// @brief Sends an IPI to one CPU, or to every other CPU with LAPIC_ICR_ALL_BUT_SELF
+void apic::send_ipi(const uint8_t apic_id, const uint32_t command) {
+    // Both ICR halves have to be written without another IPI in between
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while(lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) asm volatile("pause");
+    if(flags & 0x200) asm volatile("sti" ::: "memory");
+}
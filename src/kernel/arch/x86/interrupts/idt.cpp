@@ -10,6 +10,9 @@
 #include <graphics/vga_print.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
 #include <x86/interrupts/pic.hpp>
+#include <x86/interrupts/apic.hpp>
+#include <x86/smp.hpp>
+#include <x86/fpu.hpp>
 #include <x86/io.hpp>
 #include <lib/mem_util.hpp>
 
@@ -98,6 +101,8 @@ void idt::init() {
     set_idt_gate(45, uint32_t(irq13), 0x08, 0x8E);
     set_idt_gate(46, uint32_t(irq14), 0x08, 0x8E);
     set_idt_gate(47, uint32_t(irq15), 0x08, 0x8E);
+    set_idt_gate(48, uint32_t(irq16), 0x08, 0x8E);
+    set_idt_gate(APIC_SPURIOUS_VECTOR, uint32_t(isr_spurious), 0x08, 0x8E);
 
     // Flushing IDT
     idt_flush((uint32_t)&idt_ptr);
@@ -114,6 +119,11 @@ void idt::init() {
     else kprintf(LOG_INFO, "Implemented Interrupt Descriptor Table\n");
 }
 
+// Loads the IDT on an AP, every CPU shares the same one
+void idt::load(void) {
+    idt_load((uint32_t)&idt_ptr);
+}
+
 // Sets an IDT gate
 void idt::set_idt_gate(const uint8_t num, const uint32_t base, const uint16_t selector, const uint8_t flags) {
     // Offsets
@@ -165,6 +175,11 @@ const char* idt::exception_messages[] = {
 
 // Interrupt Service Routine error message
 extern "C" void isr_handler(InterruptRegisters* regs) {
+    // Raised by the first FPU/SSE instruction after a task switch, loads the process' FPU state
+    if(regs->interr_no == DEVICE_NOT_AVAILABLE_INDEX && fpu::handle_device_not_available()) return;
+    // Other CPUs send NMIs to have this one flush its TLB
+    if(regs->interr_no == NMI_INDEX && smp::handle_nmi()) return;
+
     // Throwing kernel panic error
     if(regs->interr_no < 32) {
         kernel_panic(idt::exception_messages[regs->interr_no], regs);
@@ -179,16 +194,14 @@ void dummy_irq_stub(InterruptRegisters* regs) {
     if (regs->interr_no == 33) { // IRQ1 = IDT entry 32 + 1
         io::inPortB(0x60); // Read and discard keyboard data
     }
-
-    // Send End of Interrupt (EOI)
-    pic::send_eoi(regs->interr_no);
 }
 
 // Array
 void* irq_routines[IRQ_QUANTITY] = {
     // Zeroing all
     0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0
 };
 
 // Checks if an IRQ is installed
@@ -196,6 +209,18 @@ bool idt::check_irq(int irq_num, void (*handler)(InterruptRegisters* regs)) {
     return irq_routines[irq_num] == (void*)handler;
 }
 
+// Acknowledges an IRQ at the interrupt controller in use (LAPIC or 8259 PIC)
+void idt::send_eoi(const uint8_t irq) {
+    if(apic::enabled) apic::send_eoi();
+    else pic::send_eoi(irq);
+}
+
+// Unmasks an ISA IRQ at the interrupt controller in use
+void idt::unmask_irq(const uint8_t irq) {
+    if(apic::enabled) apic::unmask_irq(irq);
+    else pic::unmask_irq(irq);
+}
+
 // IRQ handler functions
 
 extern "C" void irq_install_handler(int irq_num, void (*handler)(InterruptRegisters* regs)) {
@@ -212,15 +237,17 @@ extern "C" void irq_uninstall_handler(int irq_num) {
 extern "C" void irq_handler(InterruptRegisters* regs) {
     void (*handler)(InterruptRegisters* regs);
 
+    uint8_t irq = regs->interr_no - 32;
     // Getting value from irq_routines
-    handler = (void (*)(InterruptRegisters*))irq_routines[regs->interr_no - 32];
+    handler = (void (*)(InterruptRegisters*))irq_routines[irq];
+
+    /* EOI signal, sent once and before the handler since handlers like the timer tick may switch
+     * to another process. Interrupts stay off until iret, so the IRQ can't nest meanwhile */
+    idt::send_eoi(irq);
 
     if(handler) {
         handler(regs);
     }
-
-    // EOI signal
-    pic::send_eoi(regs->interr_no);
 }
 
 #pragma endregion
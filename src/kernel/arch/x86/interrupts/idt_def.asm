@@ -20,6 +20,13 @@ idt_flush:
     sti ; Enables interrupts
     ret
 
+; Loads the IDT on an AP, interrupts stay off until it's ready for them
+global idt_load
+idt_load:
+    mov eax, [esp + 4]
+    lidt [eax]
+    ret
+
 
 ; Macros
 
@@ -108,6 +115,12 @@ idt_flush:
     IRQ 13, 45
     IRQ 14, 46
     IRQ 15, 47
+    IRQ 16, 48 ; LAPIC timer
+
+; Spurious LAPIC interrupts aren't in service, so there's nothing to acknowledge
+global isr_spurious
+isr_spurious:
+    iret
 
 
 ; Hanldelers
@@ -123,11 +136,11 @@ isr_common_stub:
     mov eax, cr2
     push eax
 
+    ; GS is left alone, it always holds the running CPU's segment (GDT_CPU_SELECTOR)
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     push esp                 ; Pass pointer to struct (InterruptRegisters*)
     call isr_handler
@@ -138,7 +151,6 @@ isr_common_stub:
     mov ds, bx
     mov es, bx
     mov fs, bx
-    mov gs, bx
 
     popa
     add esp, 8
@@ -157,12 +169,11 @@ irq_common_stub:
     mov eax, cr2
     push eax 
 
-    ; Setting up segments
+    ; Setting up segments, GS keeps the running CPU's segment
     mov ax, 0x10 
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
 
     push esp
     call irq_handler
@@ -174,7 +185,6 @@ irq_common_stub:
     mov ds, bx
     mov es, bx
     mov fs, bx
-    mov gs, bx
 
     popa
     add esp, 8
@@ -0,0 +1,45 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// context.cpp
+// Sets up the contexts of new kernel threads
+// ========================================
+
+#include <x86/sched/context.hpp>
+#include <x86/gdt.hpp>
+#include <sched/process.hpp>
+#include <mm/vmm.hpp>
+
+// context_switch.asm, enables interrupts and returns into the thread's entry point
+extern "C" void ctx_thread_start(void);
+
+/// @brief Sets up a kernel thread that starts at <entry> with interrupts on
+/// @param stack_top Top of the thread's stack, what the caller put there is where <entry> returns to
+void ctx_init_kernel(context_t* ctx, uint32_t stack_top, void (*entry)()) {
+    // Laid out like ctx_switch_fast leaves a stack, so both switch paths can start the thread
+    uint32_t* stack = (uint32_t*)stack_top;
+    *--stack = (uint32_t)entry;
+    *--stack = (uint32_t)ctx_thread_start;
+    for(uint32_t i = 0; i < 4; i++) *--stack = 0; // ebp, ebx, esi, edi
+
+    ctx->esp = (uint32_t)stack;
+    ctx->fast = 1;
+    ctx->eip = (uint32_t)entry;
+    ctx->eflags = KERNEL_PROCESS_EFLAGS;
+    ctx->cs = 0x08;
+    ctx->ds = 0x10;
+    ctx->es = 0x10;
+    ctx->fs = 0x10;
+    ctx->gs = GDT_CPU_SELECTOR; // Every CPU's GDT has it, so it points at whichever CPU runs the thread
+    ctx->ss = 0x10;
+    ctx->cr3 = vmm::get_cr3();
+    // Initialize general purpose registers to zero
+    ctx->eax = 0;
+    ctx->ebx = 0;
+    ctx->ecx = 0;
+    ctx->edx = 0;
+    ctx->esi = 0;
+    ctx->edi = 0;
+    ctx->ebp = 0;
+}
@@ -10,6 +10,8 @@
 
 SECTION .text
 global ctx_switch
+global ctx_switch_fast
+global ctx_thread_start
 
 ; Offsets in cpu_context_t structure (must match task.hpp)
 CONTEXT_EAX    equ 0
@@ -29,6 +31,7 @@ CONTEXT_FS     equ 52
 CONTEXT_GS     equ 56
 CONTEXT_SS     equ 60
 CONTEXT_CR3    equ 64
+CONTEXT_FAST   equ 68
 
 ; void ctx_switch(context_t* old_ctx, context_t* new_ctx)
 ctx_switch:
@@ -88,6 +91,7 @@ ctx_switch:
     ; Save CR3 (page directory)
     mov ebx, cr3
     mov [eax + CONTEXT_CR3], ebx
+    mov dword [eax + CONTEXT_FAST], 0
 
 .load_next:
     ; Load next task context
@@ -109,6 +113,10 @@ ctx_switch:
     mov fs, bx
     mov bx, [eax + CONTEXT_GS]
     mov gs, bx
+
+    ; Contexts saved by ctx_switch_fast keep their registers on their stack
+    cmp dword [eax + CONTEXT_FAST], 0
+    jne .load_fast
     
     ; Load general purpose registers
     mov ebx, [eax + CONTEXT_EBX]
@@ -131,4 +139,41 @@ ctx_switch:
     mov eax, [eax + CONTEXT_EAX]
     
     ; Return to new task
-    iretd
\ No newline at end of file
+    iretd
+
+.load_fast:
+    mov esp, [eax + CONTEXT_ESP]
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; void ctx_switch_fast(context_t* old_ctx, context_t* new_ctx)
+; Kernel threads in the same address space: segments, CR3 and EFLAGS stay as they are.
+; Only the callee-saved registers are pushed onto the old stack, everything else the
+; caller already expects to be clobbered. new_ctx has to be saved by this function or
+; set up by ctx_init_kernel
+ctx_switch_fast:
+    mov eax, [esp + 4]          ; eax = old context pointer
+    mov edx, [esp + 8]          ; edx = new context pointer
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax + CONTEXT_ESP], esp
+    mov dword [eax + CONTEXT_FAST], 1
+
+    mov esp, [edx + CONTEXT_ESP]
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret                         ; Into the new thread's ctx_switch_fast caller
+
+; First code a new kernel thread runs, switches leave interrupts off.
+; Returns into the entry point ctx_init_kernel put above it
+ctx_thread_start:
+    sti
+    ret
\ No newline at end of file
@@ -0,0 +1,175 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// smp.cpp
+// Starts the application processors and keeps their TLBs in sync
+// ========================================
+
+#include <x86/smp.hpp>
+#include <x86/gdt.hpp>
+#include <x86/fpu.hpp>
+#include <x86/interrupts/idt.hpp>
+#include <x86/interrupts/apic.hpp>
+#include <sched/scheduler.hpp>
+#include <sched/spinlock.hpp>
+#include <drivers/pit.hpp>
+#include <mm/vmm.hpp>
+#include <mm/pmm.hpp>
+#include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
+#include <stddef.h>
+
+static_assert(offsetof(Cpu, self) == CPU_OFFSET_SELF, "Cpu::self has to match CPU_OFFSET_SELF");
+static_assert(offsetof(Cpu, index) == CPU_OFFSET_INDEX, "Cpu::index has to match CPU_OFFSET_INDEX");
+static_assert(offsetof(Cpu, current) == CPU_OFFSET_CURRENT, "Cpu::current has to match CPU_OFFSET_CURRENT");
+
+Cpu smp::cpus[SMP_MAX_CPUS];
+uint32_t smp::cpu_count = 1;
+
+// smp_trampoline.asm, copied to SMP_TRAMPOLINE_ADDR before an AP is started
+extern "C" uint8_t ap_trampoline_start[];
+extern "C" uint8_t ap_trampoline_end[];
+extern "C" uint8_t ap_trampoline_data[];
+
+// TLB shootdowns, one at a time
+static Spinlock shootdown_lock;
+static volatile bool shootdown_pending[SMP_MAX_CPUS];
+
+#pragma region Helpers
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline uint32_t read_cr4(void) {
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+// Where the trampoline's data block ends up once it's copied
+static inline ap_trampoline_data_t* trampoline_data(void) {
+    return (ap_trampoline_data_t*)PHYS_TO_VIRT(SMP_TRAMPOLINE_ADDR + (ap_trampoline_data - ap_trampoline_start));
+}
+
+// Waits up to <ms> milliseconds for a CPU to say it's online
+static bool wait_online(Cpu* cpu, const uint32_t ms) {
+    for(uint32_t waited = 0; waited < ms && !cpu->online; waited++) pit::delay(1);
+    return cpu->online;
+}
+
+// First C++ code an AP runs, on the stack of its idle process. Interrupts are off until it idles
+static void ap_main(Cpu* cpu) {
+    gdt::init_cpu(cpu);
+    idt::load();
+    fpu::init_cpu();
+    apic::init_cpu();
+
+    cpu->online = true;
+    sched::run_idle();
+}
+
+/* Holds an AP that didn't come online in time in wait-for-SIPI with an INIT IPI. A late start would run on data
+ * and an idle stack meant for the next AP, or on the trampoline once it's unmapped */
+static void stop_ap(Cpu* cpu) {
+    apic::send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    pit::delay(10);
+    sched::destroy_idle(cpu->index);
+    uint32_t index = cpu->index;
+    memset(cpu, 0, sizeof(Cpu));
+    cpu->index = index;
+}
+
+// Starts one AP with INIT-SIPI-SIPI, returns if it came online
+static bool start_ap(Cpu* cpu) {
+    Process* idle = sched::create_idle(cpu->index);
+    if(!idle) return false;
+
+    ap_trampoline_data_t* data = trampoline_data();
+    data->cr3 = vmm::get_cr3();
+    data->cr4 = read_cr4();
+    data->cr0 = read_cr0();
+    data->stack_top = (uint32_t)idle->get_stack() + KERNEL_PROCESS_STACK_SIZE;
+    data->entry = (uint32_t)ap_main;
+    data->cpu = cpu;
+
+    // The startup IPI's vector is the page the AP starts executing in real mode
+    apic::send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    pit::delay(10);
+    apic::send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12));
+    if(wait_online(cpu, 1)) return true;
+    // Some CPUs miss the first startup IPI
+    apic::send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> 12));
+    if(wait_online(cpu, SMP_STARTUP_TIMEOUT_MS)) return true;
+
+    stop_ap(cpu);
+    return false;
+}
+
+#pragma endregion
+
+/// @brief Starts every AP the MADT lists, they idle until processes get placed on them
+void smp::init(void) {
+    cpus[0].index = 0;
+    cpus[0].online = true;
+    if(!apic::enabled || !apic::timer_enabled) {
+        kprintf(LOG_WARNING, "SMP needs the LAPIC and its timer, running on the boot CPU only\n");
+        return;
+    }
+    cpus[0].apic_id = apic::get_id();
+    if(apic::cpu_count < 2) return;
+
+    // The trampoline runs identity mapped until it jumps to ap_main
+    uint32_t size = ap_trampoline_end - ap_trampoline_start;
+    memcpy((void*)PHYS_TO_VIRT(SMP_TRAMPOLINE_ADDR), ap_trampoline_start, size);
+    vmm::alloc_page(SMP_TRAMPOLINE_ADDR, SMP_TRAMPOLINE_ADDR, PRESENT | WRITABLE);
+
+    // APs are started one at a time, they share the trampoline's data block
+    uint32_t next = 1;
+    for(uint32_t i = 0; i < apic::cpu_count && next < SMP_MAX_CPUS; i++) {
+        if(apic::cpu_ids[i] == cpus[0].apic_id) continue;
+
+        // A CPU that didn't start gives its slot to the next one
+        Cpu* cpu = &cpus[next];
+        cpu->self = cpu;
+        cpu->index = next;
+        cpu->apic_id = apic::cpu_ids[i];
+        if(start_ap(cpu)) {
+            cpu_count++;
+            next++;
+        }
+        else kprintf(LOG_WARNING, "CPU with LAPIC ID %u didn't start\n", apic::cpu_ids[i]);
+    }
+
+    vmm::free_page(SMP_TRAMPOLINE_ADDR);
+    kprintf(LOG_INFO, "Started %u application processor(s), %u CPU(s) online\n", cpu_count - 1, cpu_count);
+}
+
+/// @brief Makes every other online CPU flush its whole TLB and waits until they did
+void smp::shootdown_tlb(void) {
+    if(cpu_count < 2) return;
+
+    // NMIs get through even when the other CPU waits for a lock with interrupts off
+    uint32_t flags = shootdown_lock.lock_irqsave();
+    uint32_t self = cpu_index();
+    for(uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if(i == self || !cpus[i].online) continue;
+        shootdown_pending[i] = true;
+        apic::send_ipi(cpus[i].apic_id, LAPIC_ICR_NMI | LAPIC_ICR_ASSERT);
+    }
+    for(uint32_t i = 0; i < SMP_MAX_CPUS; i++)
+        while(shootdown_pending[i]) asm volatile("pause");
+    shootdown_lock.unlock_irqrestore(flags);
+}
+
+/// @brief Called for NMIs, returns true if it was a TLB shootdown
+bool smp::handle_nmi(void) {
+    uint32_t self = cpu_index();
+    if(!shootdown_pending[self]) return false;
+    flush_tlb();
+    shootdown_pending[self] = false;
+    return true;
+}
@@ -0,0 +1,76 @@
+; ========================================
+; Copyright Ioane Baidoshvili 2025.
+; Distributed under the terms of the MIT License.
+; ========================================
+; smp_trampoline.asm
+; Real mode entry of the application processors, copied to SMP_TRAMPOLINE_ADDR
+; ========================================
+
+SMP_TRAMPOLINE_ADDR equ 0x8000 ; Must match smp.hpp, the startup IPI vector is this address >> 12
+
+; Address of a trampoline label once it's copied
+%define TRAMPOLINE(label) (SMP_TRAMPOLINE_ADDR + (label) - ap_trampoline_start)
+
+section .text
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_data
+
+[BITS 16]
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    ; Into protected mode with the trampoline's flat GDT
+    lgdt [TRAMPOLINE(trampoline_gdtr)]
+    mov eax, cr0
+    or eax, 1 ; PE
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(ap_protected)
+
+[BITS 32]
+ap_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Paging exactly like the boot CPU, the trampoline page is identity mapped while APs start
+    mov eax, [TRAMPOLINE(ap_trampoline_data) + 4]  ; CR4
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(ap_trampoline_data)]      ; CR3
+    mov cr3, eax
+    mov eax, [TRAMPOLINE(ap_trampoline_data) + 8]  ; CR0
+    mov cr0, eax
+
+    ; On the stack of the CPU's idle process, ap_main(Cpu*) never returns
+    mov esp, [TRAMPOLINE(ap_trampoline_data) + 12]
+    push dword [TRAMPOLINE(ap_trampoline_data) + 20]
+    push 0 ; Return address
+    mov eax, [TRAMPOLINE(ap_trampoline_data) + 16]
+    jmp eax
+
+align 8
+trampoline_gdt:
+    dq 0                  ; Null segment
+    dq 0x00CF9A000000FFFF ; Flat code segment
+    dq 0x00CF92000000FFFF ; Flat data segment
+trampoline_gdtr:
+    dw trampoline_gdtr - trampoline_gdt - 1
+    dd TRAMPOLINE(trampoline_gdt)
+
+; Filled in by smp::init for every AP, see ap_trampoline_data_t
+align 4
+ap_trampoline_data:
+    dd 0 ; CR3
+    dd 0 ; CR4
+    dd 0 ; CR0
+    dd 0 ; Stack top
+    dd 0 ; Entry (ap_main)
+    dd 0 ; Cpu*
+ap_trampoline_end:
@@ -10,6 +10,7 @@
 #include <mm/heap.hpp>
 #include <mm/vmm.hpp>
 #include <mm/pmm.hpp>
+#include <mm/dma.hpp>
 #include <drivers/pit.hpp>
 #include <device.hpp>
 #include <lib/data/list.hpp>
@@ -28,8 +29,7 @@ void AhciDriver::init_dev(PciDevice* pci_dev) {
 
     // Getting HBA
     uint32_t bar_base = pci_dev->get_bar(5);
-    vmm::identity_map_region(bar_base, bar_base + 2 * PAGE_SIZE, PRESENT | WRITABLE | NOTCACHABLE);
-    driver->hba = (HBA_MEM*)bar_base;
+    driver->hba = (HBA_MEM*)vmm::map_mmio(bar_base, 2 * PAGE_SIZE, PRESENT | WRITABLE | NOTCACHABLE);
 
     /* The following code follows Intel's serial-ata-ahci-spec-rev1-3-1
      * 10.1.2 System Software Specific Initialization sequence */
@@ -104,40 +104,54 @@ void AhciDriver::init_dev(PciDevice* pci_dev) {
         if (!(pi & (1 << i))) continue;
         HBA_PORT* port = &driver->hba->ports[i];
 
-        // Allocating frame for Command List and FIS
-        uint32_t frame_addr = (uint32_t)pmm::alloc_frame(1);
-        memset((void*)frame_addr, 0, FRAME_SIZE);
+        // Command List and FIS are packed densely into the DMA pool, which is always below 4GiB
+        DmaBuffer cmd_list = dma::alloc(AHCI_CMD_LIST_SIZE, AHCI_CMD_LIST_SIZE);
+        DmaBuffer fis = dma::alloc(AHCI_FIS_SIZE, AHCI_FIS_SIZE);
+        if (!cmd_list.virt || !fis.virt) {
+            kprintf(LOG_ERROR, "AHCI: Couldn't allocate memory for port %u\n", i);
+            dma::free(cmd_list); dma::free(fis);
+            pi &= ~(1 << i);
+            continue;
+        }
 
         // Command List Base
-        port->clb = frame_addr;
-        if(driver->hba->cap & (1 << 31)) port->clbu = frame_addr >> 32;
+        port->clb = cmd_list.phys;
+        if(driver->hba->cap & (1 << 31)) port->clbu = 0;
 
         // FIS Base
-        uint32_t fb_phys_addr = frame_addr + 1024;
-        port->fb = fb_phys_addr;
-        if(driver->hba->cap & (1 << 31)) port->fbu = fb_phys_addr >> 32;
-
-        // Allocating Command Tables (Fix: Required for read/write operations)
-        // 32 slots * ~256 bytes per slot = ~8KB (2 pages)
-        uint32_t cmd_tbl_addr = (uint32_t)pmm::alloc_frame(2); 
-        memset((void*)cmd_tbl_addr, 0, PAGE_SIZE * 2);
-
-        HBA_CMD_HEADER* header_array = (HBA_CMD_HEADER*)port->clb;
-
-        for (int j = 0; j < 32; j++) {
-            header_array[j].prdtl = 8; // 8 PRDT entries per command
-            
-            // Calculate address for this specific table (256 byte steps)
-            uint32_t tbl_addr = cmd_tbl_addr + (j * 256);
+        port->fb = fis.phys;
+        if(driver->hba->cap & (1 << 31)) port->fbu = 0;
+
+        HBA_CMD_HEADER* header_array = (HBA_CMD_HEADER*)cmd_list.virt;
+
+        // Allocating Command Tables (Required for read/write operations), only for slots the HBA implements
+        DmaBuffer cmd_tbls[32];
+        int allocated = 0;
+        for (; allocated <= ncs; allocated++) {
+            cmd_tbls[allocated] = dma::alloc(AHCI_CMD_TBL_SIZE, 128);
+            if (!cmd_tbls[allocated].virt) break;
+            header_array[allocated].prdtl = AHCI_PRDT_ENTRIES;
             
             // Link the header to the table
-            header_array[j].ctba = tbl_addr;
-            if(driver->hba->cap & (1 << 31)) header_array[j].ctbau = tbl_addr >> 32;
+            header_array[allocated].ctba = cmd_tbls[allocated].phys;
+            if(driver->hba->cap & (1 << 31)) header_array[allocated].ctbau = 0;
+        }
+
+        // find_cmdslot hands out every slot the HBA implements, so a port missing a table can't be used at all
+        if (allocated <= ncs) {
+            kprintf(LOG_ERROR, "AHCI: Couldn't allocate command table %u for port %u\n", allocated, i);
+            port->clb = 0;
+            port->fb = 0;
+            for (int j = 0; j < allocated; j++) dma::free(cmd_tbls[j]);
+            dma::free(cmd_list); dma::free(fis);
+            pi &= ~(1 << i);
+            continue;
         }
 
         // "After setting PxFB and PxFBU ... set PxCMD.FRE to ‘1’"
         port->cmd |= PxCMD_FRE;
     }
+    driver->ports = pi;
 
     /* 6. For each implemented port, clear the PxSERR register, 
      * by writing ‘1s’ to each implemented bit location. */
@@ -202,7 +216,8 @@ bool AhciDriver::stop_cmd(HBA_PORT* port) {
 
 /// @brief Probes implemented ports for connected devices
 void AhciDriver::probe_ports() {
-    uint32_t pi = hba->pi; 
+    // Ports init_dev couldn't set up are left out
+    uint32_t pi = ports;
 
     for(int i = 0; i < 32; i++) {
         if (!(pi & (1 << i))) continue;
@@ -246,8 +261,12 @@ static void swap_string(char* str, int length) {
 /// @brief Configures a found drive and prints identity
 void AhciDriver::configure_drive(HBA_PORT* port) {
     // Allocate a buffer for Identify (must be phys contiguous)
-    SATA_IDENTIFY_DATA* buffer = (SATA_IDENTIFY_DATA*)pmm::alloc_frame(1); 
-    memset(buffer, 0, 512);
+    DmaBuffer identify_buffer = dma::alloc(sizeof(SATA_IDENTIFY_DATA), 2);
+    SATA_IDENTIFY_DATA* buffer = (SATA_IDENTIFY_DATA*)identify_buffer.virt;
+    if (!buffer) {
+        kprintf(LOG_ERROR, "AHCI: Couldn't allocate identify buffer.\n");
+        return;
+    }
 
     if (identify(port, buffer)) {
         char model_str[41];
@@ -279,7 +298,7 @@ void AhciDriver::configure_drive(HBA_PORT* port) {
         kprintf(LOG_ERROR, "AHCI: Identify failed for device.\n");
     }
 
-    pmm::free_frame(buffer);
+    dma::free(identify_buffer);
 }
 
 #pragma endregion
@@ -298,7 +317,7 @@ bool AhciDriver::identify(HBA_PORT* port, SATA_IDENTIFY_DATA* buffer) {
     if (slot == -1) return false;
 
     // 3. Get Command Header
-    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)port->clb;
+    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)PHYS_TO_VIRT(port->clb); // DMA buffers are in the direct map
     cmd_header += slot;
 
     // 4. Setup Header
@@ -307,11 +326,11 @@ bool AhciDriver::identify(HBA_PORT* port, SATA_IDENTIFY_DATA* buffer) {
     cmd_header->prdtl = 1;  
 
     // 5. Get Command Table
-    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)(cmd_header->ctba);
+    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)PHYS_TO_VIRT(cmd_header->ctba);
     memset(cmd_tbl, 0, sizeof(HBA_CMD_TBL));
 
     // 6. Setup PRDT
-    cmd_tbl->prdt_entry[0].dba = (uint32_t)buffer;
+    cmd_tbl->prdt_entry[0].dba = (uint32_t)vmm::virtual_to_physical((uint32_t)buffer);
     cmd_tbl->prdt_entry[0].dbau = 0; 
     cmd_tbl->prdt_entry[0].dbc = 511; 
     cmd_tbl->prdt_entry[0].i = 1;     
@@ -344,27 +363,58 @@ bool AhciDriver::identify(HBA_PORT* port, SATA_IDENTIFY_DATA* buffer) {
     return true;
 }
 
+/// @brief Fills a command table's PRDT with the physical ranges behind a buffer
+/// @return Amount of PRDT entries used, 0 if the buffer needs more than AHCI_PRDT_ENTRIES
+static uint16_t build_prdt(HBA_CMD_TBL* cmd_tbl, void* buffer, uint32_t bytes) {
+    uint16_t entries = 0;
+    uint32_t virt = (uint32_t)buffer;
+    uint32_t last_end = 0;
+
+    // Heap buffers can span pages that aren't physically next to each other
+    while (bytes) {
+        uint32_t chunk = PAGE_SIZE - PAGE_OFFSET(virt);
+        if (chunk > bytes) chunk = bytes;
+        uint32_t phys = (uint32_t)vmm::virtual_to_physical(virt);
+
+        // Extending the last entry while the pages are physically contiguous
+        if (entries && phys == last_end && cmd_tbl->prdt_entry[entries - 1].dbc + 1 + chunk <= AHCI_PRDT_MAX_BYTES) {
+            cmd_tbl->prdt_entry[entries - 1].dbc += chunk;
+        }
+        else {
+            if (entries == AHCI_PRDT_ENTRIES) return 0;
+            HBA_PRDT_ENTRY* entry = &cmd_tbl->prdt_entry[entries++];
+            entry->dba = phys;
+            entry->dbau = 0;
+            entry->dbc = chunk - 1;
+        }
+
+        last_end = phys + chunk;
+        virt += chunk;
+        bytes -= chunk;
+    }
+
+    if (entries) cmd_tbl->prdt_entry[entries - 1].i = 1;
+    return entries;
+}
+
 /// @brief Read using DMA LBA48
 bool AhciDriver::read(HBA_PORT* port, uint64_t sector, uint32_t count, void* buffer) {
     port->is = 0xFFFFFFFF; // Clear interrupts
     int slot = find_cmdslot(port);
     if (slot == -1) return false;
 
-    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)port->clb;
+    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)PHYS_TO_VIRT(port->clb); // DMA buffers are in the direct map
     cmd_header += slot;
 
     cmd_header->cfl = sizeof(FIS_REG_H2D) / sizeof(uint32_t);
     cmd_header->w = 0;      // Read
-    cmd_header->prdtl = 1;  // Assuming contiguous buffer for simplicity
 
-    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)(cmd_header->ctba);
-    memset(cmd_tbl, 0, sizeof(HBA_CMD_TBL));
+    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)PHYS_TO_VIRT(cmd_header->ctba);
+    memset(cmd_tbl, 0, AHCI_CMD_TBL_SIZE);
 
-    // PRDT Setup
-    cmd_tbl->prdt_entry[0].dba = (uint32_t)buffer;
-    cmd_tbl->prdt_entry[0].dbau = 0; 
-    cmd_tbl->prdt_entry[0].dbc = (count * 512) - 1; // 512 bytes per sector
-    cmd_tbl->prdt_entry[0].i = 1;
+    // PRDT Setup, 512 bytes per sector
+    cmd_header->prdtl = build_prdt(cmd_tbl, buffer, count * 512);
+    if (!cmd_header->prdtl) return false;
 
     // FIS Setup
     FIS_REG_H2D* cmd_fis = (FIS_REG_H2D*)(&cmd_tbl->cfis);
@@ -403,20 +453,17 @@ bool AhciDriver::write(HBA_PORT* port, uint64_t sector, uint32_t count, void* bu
     int slot = find_cmdslot(port);
     if (slot == -1) return false;
 
-    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)port->clb;
+    HBA_CMD_HEADER* cmd_header = (HBA_CMD_HEADER*)PHYS_TO_VIRT(port->clb); // DMA buffers are in the direct map
     cmd_header += slot;
 
     cmd_header->cfl = sizeof(FIS_REG_H2D) / sizeof(uint32_t);
     cmd_header->w = 1; // Write bit set
-    cmd_header->prdtl = 1;
 
-    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)(cmd_header->ctba);
-    memset(cmd_tbl, 0, sizeof(HBA_CMD_TBL));
+    HBA_CMD_TBL* cmd_tbl = (HBA_CMD_TBL*)PHYS_TO_VIRT(cmd_header->ctba);
+    memset(cmd_tbl, 0, AHCI_CMD_TBL_SIZE);
 
-    cmd_tbl->prdt_entry[0].dba = (uint32_t)buffer;
-    cmd_tbl->prdt_entry[0].dbau = 0;
-    cmd_tbl->prdt_entry[0].dbc = (count * 512) - 1;
-    cmd_tbl->prdt_entry[0].i = 1;
+    cmd_header->prdtl = build_prdt(cmd_tbl, buffer, count * 512);
+    if (!cmd_header->prdtl) return false;
 
     FIS_REG_H2D* cmd_fis = (FIS_REG_H2D*)(&cmd_tbl->cfis);
     cmd_fis->fis_type = FIS_TYPE_REG_H2D;
@@ -530,9 +577,10 @@ bool AhciDriver::wait_bit_clear(uint32_t reg, uint32_t mask, int timeout_ms) {
 /// @param port Port to find on
 /// @return 0-31 or -1 if none
 int8_t AhciDriver::find_cmdslot(HBA_PORT *port) {
-    // If not set in SACT and CI, the slot is free
+    // If not set in SACT and CI, the slot is free. Only implemented slots have a command table
     uint32_t slots = (port->sact | port->ci);
-    for (int i = 0; i < 32; i++) {
+    int slot_count = ((hba->cap >> 8) & 0x1F) + 1;
+    for (int i = 0; i < slot_count; i++) {
         if ((slots & 1) == 0)
             return i;
         slots >>= 1;
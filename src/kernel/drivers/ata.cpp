@@ -9,43 +9,63 @@
 #include <drivers/ata.hpp>
 #include <drivers/pit.hpp>
 #include <device.hpp>
-#include <x86/interrupts/pic.hpp>
 #include <x86/interrupts/idt.hpp>
 #include <graphics/vga_print.hpp>
 #include <x86/io.hpp>
 #include <lib/string_util.hpp>
 #include <lib/data/string.hpp>
+#include <sched/sync.hpp>
+#include <sched/timer.hpp>
+#include <sched/workqueue.hpp>
 
 using namespace io;
 
-// IRQ handlers
-volatile bool primary_irq_received = false;
-volatile bool secondary_irq_received = false;
+// Per bus IRQ state, the wait queue's lock guards irq_received
+struct AtaBus {
+    bool irq_received;
+    WaitQueue irq_waiters;
+    Mutex mutex;   // One command at a time per bus
+    Work irq_work; // Wakes the waiters from the kernel worker
+};
+static AtaBus ata_buses[2];
+
+// Kernel worker side of the IRQ handlers
+static void signal_irq(void* data) {
+    AtaBus* bus = (AtaBus*)data;
+    uint32_t flags = bus->irq_waiters.lock.lock_irqsave();
+    bus->irq_received = true;
+    bus->irq_waiters.wake_all_locked();
+    bus->irq_waiters.lock.unlock_irqrestore(flags);
+}
 
+// IRQ handlers, reading the status register acknowledges the drive and waking the waiter is left to the kernel worker
 void primary_ata_handler(InterruptRegisters* regs) {
-    primary_irq_received = true;
-    // Sending EOI
-    pic::send_eoi(PRIMARY_IDE_IRQ);
+    inPortB(PRIMARY_STATUS);
+    work::queue(&ata_buses[0].irq_work, signal_irq, &ata_buses[0]);
 }
 
 void secondary_ata_handler(InterruptRegisters* regs) {
-    secondary_irq_received = true;
-    // Sending EOI
-    pic::send_eoi(SECONDARY_IDE_IRQ);
+    inPortB(SECONDARY_STATUS);
+    work::queue(&ata_buses[1].irq_work, signal_irq, &ata_buses[1]);
 }
 
+// Blocks until the bus' IRQ comes in, before the scheduler runs it's polled
 void ata_irq_wait(const bool secondary) {
-    volatile bool* irq_ptr = secondary ? &secondary_irq_received : &primary_irq_received;
+    AtaBus* bus = &ata_buses[secondary];
 
     // Wait for IRQ with timeout
-    int timeout = 2000;
-    while (!*irq_ptr && --timeout) pit::delay(1);
-    if (timeout <= 0) {
-        kprintf(LOG_ERROR, "ATA IRQ timout\n");
-        return;
+    uint64_t deadline = ticks + timer::ms_to_ticks(ATA_IRQ_TIMEOUT_MS);
+    uint32_t flags = bus->irq_waiters.lock.lock_irqsave();
+    while (!bus->irq_received) {
+        if (!bus->irq_waiters.wait_locked(flags, deadline)) {
+            bus->irq_waiters.lock.unlock_irqrestore(flags);
+            kprintf(LOG_ERROR, "ATA IRQ timout\n");
+            return;
+        }
     }
 
-    *irq_ptr = false;
+    bus->irq_received = false;
+    bus->irq_waiters.lock.unlock_irqrestore(flags);
 }
 
 // Initializes ATA driver for 28-bit PIO mode
@@ -58,8 +78,8 @@ void ata::init(void) {
     outPortW(SECONDARY_DEVICE_CONTROL, 0x00);
     
     // Unmasking IRQs
-    pic::unmask_irq(PRIMARY_IDE_IRQ);
-    pic::unmask_irq(SECONDARY_IDE_IRQ);
+    idt::unmask_irq(PRIMARY_IDE_IRQ);
+    idt::unmask_irq(SECONDARY_IDE_IRQ);
 
     // Probing ATA
     ata::probe();
@@ -209,18 +229,18 @@ namespace pio_28 {
             return false;
         }
 
-        for(int i = 0; i < sectors; i++) {
-            read_one_sector(dev->bus, dev->drive, lba + i, buffer);
-            buffer += 256;
-        }
-        return true;
+        return read_sector(dev->bus, dev->drive, lba, buffer, sectors);
     }
 
     bool read_sector(ata::Bus bus, ata::Drive drive, uint32_t lba, uint16_t* buffer, uint32_t sectors) {
+        // Processes using the same bus wait for the whole transfer
+        Mutex* mutex = &ata_buses[bus == ata::Bus::Secondary].mutex;
+        mutex->lock();
         for(int i = 0; i < sectors; i++) {
             read_one_sector(bus, drive, lba + i, buffer);
             buffer += 256;
         }
+        mutex->unlock();
 
         // if(sectors >= SECTORS_WRITTEN_FOR_CACHE_FLUSH) 
         //     pio_28::flush_cache(dev->bus, dev->drive);
@@ -295,21 +315,17 @@ namespace pio_28 {
             return false;
         }
 
-        for(int i = 0; i < sectors; i++) {
-            write_one_sector(dev->bus, dev->drive, lba + i, buffer);
-            buffer += 256;
-        }
-
-        // if(sectors >= SECTORS_WRITTEN_FOR_CACHE_FLUSH) 
-        //     pio_28::flush_cache(dev->bus, dev->drive);
-        return true;
+        return write_sector(dev->bus, dev->drive, lba, buffer, sectors);
     }
 
     bool write_sector(ata::Bus bus, ata::Drive drive, uint32_t lba, uint16_t* buffer, uint32_t sectors) {
+        Mutex* mutex = &ata_buses[bus == ata::Bus::Secondary].mutex;
+        mutex->lock();
         for(int i = 0; i < sectors; i++) {
             write_one_sector(bus, drive, lba + i, buffer);
             buffer += 256;
         }
+        mutex->unlock();
 
         // if(sectors >= SECTORS_WRITTEN_FOR_CACHE_FLUSH) 
         //     pio_28::flush_cache(dev->bus, dev->drive);
@@ -11,6 +11,8 @@
 #include <graphics/vga_print.hpp>
 #include <x86/interrupts/idt.hpp>
 #include <lib/string_util.hpp>
+#include <sched/sync.hpp>
+#include <sched/workqueue.hpp>
 
 using namespace kbrd;
 
@@ -41,31 +43,60 @@ uint32_t get_terminal_key(uint8_t scancode, bool shift, bool capsLock) {
 KeyEvent keyboardBuffer[KEYBOARD_BUFFER_SIZE];
 int kb_buf_head = 0; // Where the next event will be inserted
 int kb_buf_tail = 0; // Where the next event will be read from
+static WaitQueue key_waiters; // Processes waiting for input, its lock guards the buffer
+
+// Raw scancodes the IRQ handler read, translated in the kernel worker
+static uint8_t scancode_buffer[KEYBOARD_SCANCODE_BUFFER_SIZE];
+static int sc_buf_head = 0, sc_buf_tail = 0;
+static Spinlock scancode_lock;
+static Work scancode_work;
 
 // Adds a key event to the buffer (called by the keyboard driver / ISR)
 void kbrd::push_key_event(KeyEvent ev) {
+    uint32_t flags = key_waiters.lock.lock_irqsave();
     int next = (kb_buf_head + 1) % KEYBOARD_BUFFER_SIZE;
     if (next != kb_buf_tail) {  // Not full
         keyboardBuffer[kb_buf_head] = ev;
         kb_buf_head = next;
+        key_waiters.wake_all_locked();
     }
+    key_waiters.lock.unlock_irqrestore(flags);
 }
 
 // Removes a key event from the buffer and returns it in 'out'
 // Returns true if successful, false if buffer was empty
 bool kbrd::pop_key_event(KeyEvent& out) {
-    if (kb_buf_head == kb_buf_tail)
-        return false; // Empty
+    uint32_t flags = key_waiters.lock.lock_irqsave();
+    bool found = kb_buf_head != kb_buf_tail;
+    if (found) {
+        out = keyboardBuffer[kb_buf_tail];
+        kb_buf_tail = (kb_buf_tail + 1) % KEYBOARD_BUFFER_SIZE;
+    }
+    key_waiters.lock.unlock_irqrestore(flags);
+    return found;
+}
 
-    out = keyboardBuffer[kb_buf_tail];
-    kb_buf_tail = (kb_buf_tail + 1) % KEYBOARD_BUFFER_SIZE;
-    return true;
+// Blocks the current process until the buffer holds a key event
+void kbrd::wait_key_event(void) {
+    uint32_t flags = key_waiters.lock.lock_irqsave();
+    while (kb_buf_head == kb_buf_tail) key_waiters.wait_locked(flags, 0);
+    key_waiters.lock.unlock_irqrestore(flags);
 }
 
-// Handles input
-void keyboardHandler(InterruptRegisters* regs) {
-    // Getting data
-    uint8_t raw_scancode = io::inPortB(KBD_DATA_PORT);
+// Takes the oldest raw scancode, returns false if there was none
+static bool pop_scancode(uint8_t& out) {
+    uint32_t flags = scancode_lock.lock_irqsave();
+    bool found = sc_buf_head != sc_buf_tail;
+    if (found) {
+        out = scancode_buffer[sc_buf_tail];
+        sc_buf_tail = (sc_buf_tail + 1) % KEYBOARD_SCANCODE_BUFFER_SIZE;
+    }
+    scancode_lock.unlock_irqrestore(flags);
+    return found;
+}
+
+// Translates one raw scancode into a key event, work runs one at a time so the modifier state needs no lock
+static void handle_scancode(uint8_t raw_scancode) {
     uint8_t scancode = raw_scancode & 0x7F;
     uint8_t press_state = raw_scancode & 0x80;
 
@@ -107,6 +138,27 @@ void keyboardHandler(InterruptRegisters* regs) {
     push_key_event(event);
 }
 
+// Kernel worker side of the keyboard IRQ
+static void process_scancodes(void* data) {
+    uint8_t raw_scancode;
+    while (pop_scancode(raw_scancode)) handle_scancode(raw_scancode);
+}
+
+// Handles input, reading the scancode acknowledges the controller and the rest is left to the kernel worker
+void keyboardHandler(InterruptRegisters* regs) {
+    uint8_t raw_scancode = io::inPortB(KBD_DATA_PORT);
+
+    uint32_t flags = scancode_lock.lock_irqsave();
+    int next = (sc_buf_head + 1) % KEYBOARD_SCANCODE_BUFFER_SIZE;
+    if (next != sc_buf_tail) {  // Not full
+        scancode_buffer[sc_buf_head] = raw_scancode;
+        sc_buf_head = next;
+    }
+    scancode_lock.unlock_irqrestore(flags);
+
+    work::queue(&scancode_work, process_scancodes, nullptr);
+}
+
 // Sets IRQ1 to the keyboard handler
 void kbrd::init(void) {
     // Setting to lowercase originally
@@ -11,8 +11,8 @@
 #include <x86/interrupts/kernel_panic.hpp>
 #include <graphics/vga_print.hpp>
 #include <x86/io.hpp>
-#include <x86/interrupts/pic.hpp>
 #include <sched/scheduler.hpp>
+#include <sched/timer.hpp>
 #include <lib/math.hpp>
 
 volatile uint64_t ticks;  
@@ -20,22 +20,18 @@ const uint32_t frequency = 1000; // Hz
 
 // PIT is IRQ0
 void onIrq0(InterruptRegisters* regs) {
-    ticks++;
+    // irq_handler already acknowledged the interrupt, so a task switch doesn't leave IRQ0 blocked
+    pit::tick();
+}
 
-    // Acknowledge the interrupt BEFORE scheduling.
-    // If we switch tasks, the new task needs to be able to receive interrupts.
-    // If we don't EOI, the PIC remains blocked on IRQ0.
-    pic::send_eoi(PIT_IRQ);
+/// @brief Advances the kernel tick, called by the PIT or the LAPIC timer once it took over
+void pit::tick(void) {
+    ticks++;
 
-    // Decrement current task's time slice
-    if (curr_process && curr_process->get_state() == PROCESS_RUNNING) {
-        curr_process->decrement_time_slice();
-        
-        // If time slice expired, trigger rescheduling
-        if (curr_process->get_time_slice() == 0) {
-            sched::schedule();
-        }
-    }
+    // Expired timers wake their processes before the scheduler picks who runs
+    timer::tick();
+    // Time slices, aging and preemption
+    sched::tick();
 }
 
 void pit::init(void) {
@@ -58,13 +54,20 @@ void pit::init(void) {
 }
 
 void pit::delay(const uint64_t ms) {
-    // A simple delay that waits for `ms` milliseconds (approximated)
-    uint32_t start = ticks;
-    uint64_t targetTicks = start + udiv64((ms * frequency), 1000);  // Target ticks to achieve the delay
+    // Processes sleep, so other processes run in the meantime
+    if (sched::can_block()) {
+        sched::sleep_ms(ms);
+        return;
+    }
 
-    // Wait until the target number of ticks has passed
+    // Before the scheduler runs (or in the idle process) the CPU halts until the target tick
+    uint64_t targetTicks = ticks + timer::ms_to_ticks(ms);
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r"(flags));
     while (ticks < targetTicks) {
-        __asm__("nop");
+        // hlt needs interrupts to wake up again
+        if (flags & 0x200) asm volatile("hlt");
+        else asm volatile("pause");
     }
 }
 
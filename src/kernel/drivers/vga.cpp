@@ -9,10 +9,12 @@
 #include <drivers/vga.hpp>
 #include <graphics/vga_print.hpp>
 #include <multiboot.hpp>
+#include <mm/vmm.hpp>
 #include <lib/math.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
 
 uint32_t* vga::framebuffer = nullptr;
+uint32_t vga::fb_phys = 0;
 uint32_t vga::fb_size;
 uint32_t vga::screen_width;
 uint32_t vga::screen_height;
@@ -48,14 +50,21 @@ void vga::init_framebuffer(const multiboot_tag_framebuffer* fb_tag) {
         kprintf("Operating in VGA text mode!\n");
         return;
     }
+    // boot.asm only maps framebuffers in the first 4GiB
+    if (fb_tag->framebuffer_addr >= 0x100000000) {
+        kprintf("Framebuffer at %llx can't be mapped!\n", fb_tag->framebuffer_addr);
+        kprintf("Operating in VGA text mode!\n");
+        return;
+    }
     
-    // Save framebuffer info
-    framebuffer = (uint32_t*)fb_tag->framebuffer_addr;
+    // Save framebuffer info, boot.asm mapped it into the framebuffer window from its 4MiB boundary on
+    fb_phys = uint32_t(fb_tag->framebuffer_addr);
+    framebuffer = (uint32_t*)(VMM_FB_ADDR + (fb_phys & (LARGE_PAGE_SIZE - 1)));
     screen_width = fb_tag->framebuffer_width;
     screen_height = fb_tag->framebuffer_height;
     screen_pitch = fb_tag->framebuffer_pitch;
     screen_bpp = fb_tag->framebuffer_bpp;
-    fb_size = screen_width * screen_height * (screen_bpp / 8);
+    fb_size = screen_pitch * screen_height;
 
     // Saving font info
     font_height = sizeof(font8x8_basic[0]) / sizeof(font8x8_basic[0][0]);
@@ -11,6 +11,12 @@
 #include <drivers/vga.hpp>
 #include <lib/math.hpp> 
 #include <lib/data/list.hpp>
+#include <x86/fpu.hpp>
+
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+typedef uint16_t u16x8 __attribute__((vector_size(16)));
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+typedef uint32_t u32x4_u __attribute__((vector_size(16), aligned(4)));
 
 void gui::put_pixel_alpha(const uint32_t x, const uint32_t y, const uint32_t color, const uint8_t alpha) {
     if (alpha == 0) return;
@@ -59,7 +65,46 @@ void gui::put_pixel_alpha(const uint32_t x, const uint32_t y, const uint32_t col
     }
 }
 
+/// @brief Blends a row of 32-bit pixels with a color, four pixels per SSE2 register
+/// @return Pixels blended, the remaining (less than four) are left to the caller
+static SSE2_FUNC uint32_t blend_row_sse2(uint32_t* row, const uint32_t count, const uint32_t color, const uint8_t alpha) {
+    // Every 16-bit lane holds one channel, the same formula as put_pixel_alpha
+    uint16_t b = (color & 0xFF) * alpha, g = ((color >> 8) & 0xFF) * alpha, r = ((color >> 16) & 0xFF) * alpha;
+    const u16x8 fg = {b, g, r, 0, b, g, r, 0};
+    const uint16_t inv_alpha = 256 - alpha;
+    const u8x16 zero = {};
+    const u32x4 alpha_mask = {0xFF000000, 0xFF000000, 0xFF000000, 0xFF000000}; // The alpha byte is kept
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        u32x4 pixels = *(u32x4_u*)(row + i);
+        u8x16 bytes = (u8x16)pixels;
+        u16x8 low = (u16x8)__builtin_shufflevector(bytes, zero, 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+        u16x8 high = (u16x8)__builtin_shufflevector(bytes, zero, 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+        low = (low * inv_alpha + fg) >> 8;
+        high = (high * inv_alpha + fg) >> 8;
+        u8x16 blended = __builtin_shufflevector((u8x16)low, (u8x16)high, 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+        *(u32x4_u*)(row + i) = ((u32x4)blended & ~alpha_mask) | (pixels & alpha_mask);
+    }
+    return i;
+}
+
 void gui::draw_rect(const uint32_t x, const uint32_t y, const uint32_t w, const uint32_t h, const uint32_t color, const uint8_t alpha) {
+    // Translucent rectangles on 32-bit framebuffers are blended a row at a time with SSE2
+    if (alpha != 0 && alpha != 255 && vga::framebuffer && vga::screen_bpp == 32 && x < vga::screen_width && fpu::sse2) {
+        uint32_t width = (w < vga::screen_width - x) ? w : vga::screen_width - x;
+        for (uint32_t yy = y; yy < y + h && yy < vga::screen_height; yy++) {
+            uint32_t* row = (uint32_t*)((uint8_t*)vga::framebuffer + yy * vga::screen_pitch) + x;
+            // A section per row, so interrupts aren't held off for the whole rectangle
+            if (!fpu::begin()) break;
+            uint32_t done = blend_row_sse2(row, width, color, alpha);
+            fpu::end();
+            for (uint32_t xx = x + done; xx < x + width; xx++)
+                gui::put_pixel_alpha(xx, yy, color, alpha);
+        }
+        return;
+    }
+
     for (int yy = y; yy < y + h; yy++)
         for (int xx = x; xx < x + w; xx++)
             gui::put_pixel_alpha(xx, yy, color, alpha);
@@ -18,6 +18,9 @@ namespace cmd {
 
         static void meminfo();
         static void heapdump();
+        static void memstat();
+        static void memtrace();
+        static void membench();
     };
 }
 
@@ -20,6 +20,8 @@ namespace cmd {
         static void uptime();
         static void currtime();
         static void lsprocesses();
+        static void lscpus();
+        static void ctxbench();
         static void lspci();
     };
 }
@@ -0,0 +1,100 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef ACPI_HPP
+#define ACPI_HPP
+
+#include <stdint.h>
+
+#define ACPI_SIG_MADT "APIC"
+
+// Root System Description Pointer, GRUB hands over a copy in the ACPI tags
+struct acpi_rsdp {
+    char signature[8]; // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;  // 0 for ACPI 1.0 (RSDT only), 2+ adds the XSDT
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+// Header every System Description Table starts with
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length; // Including the header
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// Multiple APIC Description Table, followed by variable length entries
+struct acpi_madt {
+    acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags; // Bit 0: the system also has dual 8259 PICs
+} __attribute__((packed));
+
+enum MADT_Entry_Types {
+    MADT_LAPIC = 0,
+    MADT_IOAPIC = 1,
+    MADT_INTERRUPT_OVERRIDE = 2,
+    MADT_LAPIC_NMI = 4,
+    MADT_LAPIC_ADDRESS_OVERRIDE = 5
+};
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct madt_lapic {
+    madt_entry header;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags; // Bit 0: enabled, bit 1: can be enabled
+} __attribute__((packed));
+
+struct madt_ioapic {
+    madt_entry header;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base; // First Global System Interrupt the IOAPIC handles
+} __attribute__((packed));
+
+struct madt_interrupt_override {
+    madt_entry header;
+    uint8_t bus;    // Always 0 (ISA)
+    uint8_t source; // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags; // Bits 0-1: polarity, bits 2-3: trigger mode
+} __attribute__((packed));
+
+struct madt_lapic_address_override {
+    madt_entry header;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed));
+
+namespace acpi {
+    extern bool found; // An RSDP with a valid checksum was found
+
+    // Finds the RSDP in the multiboot info and maps the RSDT/XSDT
+    void init(void* mb2_info);
+    // Returns the mapped table with a given signature, nullptr if there's none
+    acpi_sdt_header* find_table(const char* signature);
+} // Namespace acpi
+
+#endif // ACPI_HPP
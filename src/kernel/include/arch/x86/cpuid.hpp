@@ -40,6 +40,23 @@ enum CPUID_Functions {
     CPUID_VIRTUALIZATION_INFO    = 0x80000008  // Virtualization and address size
 };
 
+// Feature bits returned in EDX by CPUID_FEATURES
+enum CPUID_Features_EDX {
+    CPUID_FEAT_EDX_FPU = 1 << 0, // x87 FPU on chip
+    CPUID_FEAT_EDX_PSE = 1 << 3, // 4 MiB pages
+    CPUID_FEAT_EDX_TSC = 1 << 4, // Time stamp counter
+    CPUID_FEAT_EDX_PAE = 1 << 6, // Physical address extension
+    CPUID_FEAT_EDX_APIC = 1 << 9, // On-chip local APIC
+    CPUID_FEAT_EDX_PGE = 1 << 13, // Global pages
+    CPUID_FEAT_EDX_FXSR = 1 << 24, // FXSAVE/FXRSTOR
+    CPUID_FEAT_EDX_SSE = 1 << 25,  // SSE instructions
+    CPUID_FEAT_EDX_SSE2 = 1 << 26  // SSE2 instructions
+};
+
+// Feature bits returned in EBX by CPUID_EXTENDED_FEATURES
+enum CPUID_Extended_Features_EBX {
+    CPUID_FEAT_EXT_EBX_ERMS = 1 << 9 // Enhanced rep movsb/stosb
+};
 
 extern char cpu_vendor[13]; // Vendor name
 extern char cpu_model_name[49];  // Model name
@@ -49,6 +66,12 @@ namespace cpu {
     void get_vendor(char* vendor);
     void get_processor_model(char* buffer);
     CPUIDResult cpuid(const uint32_t eax_input);
+    // Returns if the CPU reports a CPUID_FEATURES EDX feature
+    bool has_feature(const uint32_t edx_feature);
+    // Returns if the CPU reports a CPUID_EXTENDED_FEATURES EBX feature
+    bool has_extended_feature(const uint32_t ebx_feature);
+    // Returns the CPU family with the extended family added
+    uint32_t get_family(void);
 } //namespace cpu
 
 
@@ -0,0 +1,60 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef FPU_HPP
+#define FPU_HPP
+
+#include <stdint.h>
+
+#define FPU_STATE_SIZE 512 // FXSAVE area, FNSAVE only uses the first 108 bytes
+#define FPU_STATE_ALIGN 16
+
+// CR0 bits
+#define CR0_MP 0x2  // WAIT/FWAIT trap on TS too
+#define CR0_EM 0x4  // No FPU, every FPU instruction raises #NM
+#define CR0_TS 0x8  // Set on a task switch, the next FPU/SSE instruction raises #NM
+#define CR0_NE 0x20 // Native FPU error reporting
+
+// CR4 bits
+#define CR4_OSFXSR 0x200     // FXSAVE/FXRSTOR save SSE state, SSE instructions are allowed
+#define CR4_OSXMMEXCPT 0x400 // Unmasked SSE exceptions raise #XM
+
+/* The kernel is built with -mgeneral-regs-only, functions marked with this may use SSE2 registers
+ * and must only be called between fpu::begin and fpu::end */
+#define SSE2_FUNC __attribute__((target("sse2")))
+
+class Process;
+
+namespace fpu {
+    extern bool enabled;          // The CPU has an FPU and CR0 is set up for lazy switching
+    extern bool fxsr;             // State is saved with FXSAVE instead of FNSAVE
+    extern bool sse2;             // SSE2_FUNC code can run inside of fpu::begin/end
+    extern uint64_t lazy_restores; // #NM traps that loaded a process' state
+
+    // Enables the FPU and SSE, sets CR0.TS so the first user traps
+    void init(void);
+    // Resets the FPU of an AP, CR0 and CR4 already came from the boot CPU
+    void init_cpu(void);
+    // Returns the process whose state is in this CPU's FPU registers
+    Process* get_owner(void);
+    // Returns if <proc>'s state is in the FPU registers of <cpu>, it can't move to another CPU until it's saved
+    bool held_by(const uint32_t cpu, Process* proc);
+    // Called on every task switch, sets CR0.TS unless <next> still owns the FPU registers
+    void switch_to(Process* next);
+    // #NM handler, loads the current process' state. Returns false if there's no FPU to switch
+    bool handle_device_not_available(void);
+    // Forgets a terminated process' state
+    void release(Process* proc);
+
+    /* Lets kernel code use SSE2 until fpu::end, the registers of their owner get saved first.
+     * Interrupts stay off in between, so sections should be short. Returns false if the CPU
+     * can't run SSE2 code, callers then use their scalar path and don't call fpu::end */
+    bool begin(void);
+    void end(void);
+} // Namespace fpu
+
+#endif // FPU_HPP
@@ -10,15 +10,22 @@
 
 #include <stdint.h>
 
-// Amount of segments in the GDT
-#define GDT_SEGMENT_QUANTITY 6
+// Amount of segments in the GDT, every CPU has its own GDT
+#define GDT_SEGMENT_QUANTITY 7
+
+#define GDT_TSS_SELECTOR 0x28
+#define GDT_CPU_SELECTOR 0x30 // Data segment over the CPU's struct Cpu, kept in GS
+
+struct gdt_entry;
+struct Cpu;
 
 // Functions
 
 namespace gdt {
-    void init(void); // Initializes the GDT
-    void set_gdt_gate(const uint32_t num, const uint32_t base, const uint32_t limit, const uint8_t access, const uint8_t gran); // Sets GDT gate
-    void write_tss(const uint32_t num, const uint16_t ss0, const uint32_t esp0);
+    void init(void); // Initializes the boot CPU's GDT
+    void init_cpu(Cpu* cpu); // Builds and loads the GDT and TSS of the running CPU
+    void set_gdt_gate(gdt_entry* gdt, const uint32_t num, const uint32_t base, const uint32_t limit, const uint8_t access, const uint8_t gran); // Sets GDT gate
+    void write_tss(Cpu* cpu, const uint32_t num, const uint16_t ss0, const uint32_t esp0);
 }
 
 // Flushing functions in gdt_flush.asm
@@ -0,0 +1,102 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef APIC_HPP
+#define APIC_HPP
+
+#include <stdint.h>
+
+// Local APIC registers, offsets from the LAPIC base
+#define LAPIC_ID           0x20
+#define LAPIC_VERSION      0x30
+#define LAPIC_TPR          0x80  // Task priority
+#define LAPIC_EOI          0xB0
+#define LAPIC_SVR          0xF0  // Spurious interrupt vector, bit 8 enables the LAPIC
+#define LAPIC_ESR          0x280 // Error status
+#define LAPIC_ICR_LOW      0x300 // Interrupt command, writing the low half sends the IPI
+#define LAPIC_ICR_HIGH     0x310 // Bits 24-31: destination APIC ID
+#define LAPIC_LVT_TIMER    0x320
+#define LAPIC_LVT_LINT0    0x350
+#define LAPIC_LVT_LINT1    0x360
+#define LAPIC_LVT_ERROR    0x370
+#define LAPIC_TIMER_INIT   0x380 // Initial count
+#define LAPIC_TIMER_CURR   0x390 // Current count
+#define LAPIC_TIMER_DIV    0x3E0
+
+// LVT bits
+#define LAPIC_LVT_MASKED   0x10000
+#define LAPIC_LVT_NMI      0x400   // NMI delivery mode
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_SVR_ENABLE   0x100
+#define LAPIC_TIMER_DIV_16 0x3
+
+// Interrupt command bits
+#define LAPIC_ICR_NMI          0x400
+#define LAPIC_ICR_INIT         0x500
+#define LAPIC_ICR_STARTUP      0x600
+#define LAPIC_ICR_PENDING      0x1000  // Delivery status, set until the IPI was accepted
+#define LAPIC_ICR_ASSERT       0x4000
+#define LAPIC_ICR_ALL_BUT_SELF 0xC0000 // Destination shorthand
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define IA32_APIC_BASE_ENABLE 0x800
+
+// IOAPIC registers, reached through IOREGSEL/IOWIN
+#define IOAPIC_REGSEL   0x00
+#define IOAPIC_WIN      0x10
+#define IOAPIC_VERSION  0x01 // Bits 16-23: last redirection entry
+#define IOAPIC_REDTBL(n) (0x10 + (n) * 2)
+
+// Redirection entry bits
+#define IOAPIC_ACTIVE_LOW 0x2000
+#define IOAPIC_LEVEL      0x8000
+#define IOAPIC_MASKED     0x10000
+
+// MADT interrupt override flags
+#define MADT_POLARITY_MASK 0x3
+#define MADT_POLARITY_LOW  0x3
+#define MADT_TRIGGER_MASK  0xC
+#define MADT_TRIGGER_LEVEL 0xC
+
+#define APIC_MAX_CPUS 16
+#define APIC_MAX_IOAPICS 4
+#define ISA_IRQ_COUNT 16
+
+/* The LAPIC timer runs as IRQ 16 (vector 48), after the ISA IRQs. Spurious interrupts
+ * use the last vector, they aren't acknowledged */
+#define APIC_TIMER_IRQ 16
+#define APIC_SPURIOUS_VECTOR 0xFF
+#define APIC_CALIBRATION_TICKS 50 // PIT ticks the LAPIC timer is measured against
+
+namespace apic {
+    extern bool enabled;        // IRQs go through the IOAPIC and are acknowledged at the LAPIC
+    extern bool timer_enabled;  // The LAPIC timer drives the scheduler tick instead of the PIT
+    extern uint32_t timer_counts_per_tick; // LAPIC timer counts (divided by 16) in one PIT tick
+
+    // APIC IDs of the enabled CPUs the MADT lists, the boot CPU included
+    extern uint8_t cpu_ids[APIC_MAX_CPUS];
+    extern uint32_t cpu_count;
+
+    // Enables the LAPIC and routes ISA IRQs through the IOAPIC, needs the ACPI MADT. Keeps the 8259 PIC otherwise
+    void init(void);
+    // Calibrates the LAPIC timer against the PIT and moves the scheduler tick to it
+    void init_timer(void);
+    // Enables the LAPIC of an AP and starts its timer with the boot CPU's calibration
+    void init_cpu(void);
+    // Acknowledges the interrupt in service
+    void send_eoi(void);
+    // Masks and unmasks an ISA IRQ at the IOAPIC
+    void mask_irq(const uint8_t irq);
+    void unmask_irq(const uint8_t irq);
+    // Returns the APIC ID of the running CPU
+    uint8_t get_id(void);
+
+    // Sends an IPI to one CPU, or to every other CPU with LAPIC_ICR_ALL_BUT_SELF. Waits until it was accepted
+    void send_ipi(const uint8_t apic_id, const uint32_t command);
+} // Namespace apic
+
+#endif // APIC_HPP
@@ -11,8 +11,10 @@
 #include <stdint.h>
 
 #define IDT_SIZE 256
-#define IRQ_QUANTITY 16
+#define IRQ_QUANTITY 17 // 16 ISA IRQs and the LAPIC timer
 
+#define NMI_INDEX 2
+#define DEVICE_NOT_AVAILABLE_INDEX 7
 #define PAGE_FAULT_INDEX 14
 
 // This ALWAYS NEEDS TO BE 8 BYTES IN TOTAL, because we have a 32 bit OS
@@ -43,6 +45,7 @@ struct InterruptRegisters {
 namespace idt {
 // Functions
 void init(void); // Initializes IDT
+void load(void); // Loads the IDT on an AP, without enabling interrupts
 // Sets an IDT gate
 void set_idt_gate(const uint8_t num, const uint32_t base, const uint16_t selector, const uint8_t flags);
 // Installing and uninstalling IRQ handler
@@ -54,6 +57,11 @@ extern const char* exception_messages[];
 // Checks if an IRQ is installed
 bool check_irq(int irq_num, void (*handler)(InterruptRegisters* regs));
 
+// Acknowledges an IRQ at the interrupt controller in use (LAPIC or 8259 PIC)
+void send_eoi(const uint8_t irq);
+// Unmasks an ISA IRQ at the interrupt controller in use
+void unmask_irq(const uint8_t irq);
+
 } // Namespace idt
 
 // Handlers
@@ -61,6 +69,7 @@ extern "C" void isr_handler(struct InterruptRegisters* regs);
 extern "C" void irq_handler(struct InterruptRegisters* regs);
 // Flushes the IDT
 extern "C" void idt_flush(uint32_t);
+extern "C" void idt_load(uint32_t);
 
 // ISRs and IRQs
 extern "C" {
@@ -125,6 +134,8 @@ extern "C" {
     void irq13();
     void irq14();
     void irq15();
+    void irq16(); // LAPIC timer
+    void isr_spurious(); // LAPIC spurious interrupts
 }
 
 #endif // IDT_MAIN_HPP
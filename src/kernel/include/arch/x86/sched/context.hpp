@@ -17,8 +17,21 @@ struct context_t {
     uint32_t eip, eflags;
     uint32_t cs, ds, es, fs, gs, ss;
     uint32_t cr3;
+    uint32_t fast; // Saved by ctx_switch_fast, only esp is valid and the rest sits on the stack
 };
 
-extern "C" [[noreturn]] void ctx_switch(context_t* old_ctx, context_t* new_ctx);
+// Saves and loads every register, segments and CR3. Loads contexts of both kinds
+extern "C" void ctx_switch(context_t* old_ctx, context_t* new_ctx);
+// Swaps callee-saved registers and stacks only, for kernel threads in one address space
+extern "C" void ctx_switch_fast(context_t* old_ctx, context_t* new_ctx);
+
+/* Sets up a kernel thread that starts at <entry> with interrupts on, on a stack whose top is <stack_top>.
+ * Whatever the caller put at the top is where <entry> returns to */
+void ctx_init_kernel(context_t* ctx, uint32_t stack_top, void (*entry)());
+
+// The fast path fits when the next context was saved by it and nothing but the stack changes
+static inline bool ctx_can_switch_fast(const context_t* old_ctx, const context_t* new_ctx) {
+    return new_ctx->fast && old_ctx->cr3 == new_ctx->cr3 && !(old_ctx->cs & 3) && !(new_ctx->cs & 3);
+}
 
 #endif // CONTEXT_HPP
@@ -0,0 +1,82 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef SMP_HPP
+#define SMP_HPP
+
+#include <stdint.h>
+#include <x86/gdt.hpp>
+#include <x86/interrupts/apic.hpp>
+
+#define SMP_MAX_CPUS APIC_MAX_CPUS
+#define CPU_OFFSET_SELF 0
+#define CPU_OFFSET_INDEX 4
+#define CPU_OFFSET_CURRENT 8
+#define SMP_TRAMPOLINE_ADDR 0x8000    // Below 1 MiB and page aligned, APs start here in real mode
+#define SMP_STARTUP_TIMEOUT_MS 100    // Time an AP gets to come online after its startup IPIs
+
+class Process;
+
+/* Every CPU has one of these, its GDT's CPU segment (GDT_CPU_SELECTOR, kept in GS) starts at it.
+ * So %gs:0 is the running CPU's struct on whatever CPU code runs on */
+struct Cpu {
+    Cpu* self;             // Has to stay the first field
+    uint32_t index;        // Position in smp::cpus, the boot CPU is 0. Has to stay the second field
+    Process* current;      // Process running on the CPU. Has to stay the third field
+    uint8_t apic_id;
+    volatile bool online;  // Set by the CPU itself once it can run processes
+
+    __attribute__((aligned(8))) gdt_entry gdt[GDT_SEGMENT_QUANTITY];
+    gdt_ptr gdtr;
+    tss_entry tss;
+};
+
+// Layout of ap_trampoline_data in smp_trampoline.asm
+struct ap_trampoline_data_t {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t cr0;
+    uint32_t stack_top;
+    uint32_t entry;
+    Cpu* cpu;
+} __attribute__((packed));
+
+namespace smp {
+    extern Cpu cpus[SMP_MAX_CPUS];
+    extern uint32_t cpu_count; // CPUs that are online, the boot CPU included
+
+    // Starts every AP the MADT lists with INIT-SIPI-SIPI, they idle until processes get placed on them
+    void init(void);
+
+    // Returns the running CPU's struct
+    inline Cpu* this_cpu(void) {
+        Cpu* cpu;
+        asm volatile("mov %%gs:%c1, %0" : "=r"(cpu) : "i"(CPU_OFFSET_SELF));
+        return cpu;
+    }
+
+    // Returns the running CPU's index in smp::cpus
+    inline uint32_t cpu_index(void) {
+        uint32_t index;
+        asm volatile("mov %%gs:%c1, %0" : "=r"(index) : "i"(CPU_OFFSET_INDEX));
+        return index;
+    }
+
+    // Returns the process running on this CPU, a single load so it can't be torn by a task switch
+    inline Process* current_process(void) {
+        Process* proc;
+        asm volatile("mov %%gs:%c1, %0" : "=r"(proc) : "i"(CPU_OFFSET_CURRENT));
+        return proc;
+    }
+
+    // Makes every other online CPU flush its whole TLB (global pages too) and waits until they did
+    void shootdown_tlb(void);
+    // Called for NMIs, returns true if it was a TLB shootdown
+    bool handle_nmi(void);
+} // Namespace smp
+
+#endif // SMP_HPP
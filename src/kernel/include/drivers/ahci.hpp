@@ -23,6 +23,13 @@
 // Port Interrupt Status
 #define IS_IPS(x)   (1 << x)
 
+// Port memory structures
+#define AHCI_CMD_LIST_SIZE  1024  // 32 command headers, 1 KiB aligned
+#define AHCI_FIS_SIZE       256   // Received FIS area, 256 byte aligned
+#define AHCI_PRDT_ENTRIES   8     // PRDT entries per command table
+#define AHCI_CMD_TBL_SIZE   (0x80 + AHCI_PRDT_ENTRIES * 16) // 128 byte aligned
+#define AHCI_PRDT_MAX_BYTES 0x400000 // A single PRDT entry covers at most 4 MiB
+
 // ATA Commands
 #define ATA_CMD_READ_DMA_EX     0x25
 #define ATA_CMD_WRITE_DMA_EX    0x35
@@ -363,6 +370,7 @@ class AhciDriver {
 private:
     PciDevice* pci_dev;
     HBA_MEM* hba;
+    uint32_t ports; // Implemented ports that got their command list, FIS and every command table
 
     void probe_ports();
     void configure_drive(HBA_PORT* port);
@@ -15,6 +15,7 @@
 #define IDENTIFY_COMMAND 0xEC
 #define READ_SECTOR_COMMAND 0x20
 #define WRITE_SECTOR_COMMAND 0x30
+#define ATA_IRQ_TIMEOUT_MS 2000
 
 // Registers for primary ATA bus
 #define PRIMARY_DATA 0x1F0
@@ -15,6 +15,7 @@
 // Key events
 
 #define KEYBOARD_BUFFER_SIZE 128
+#define KEYBOARD_SCANCODE_BUFFER_SIZE 64 // Raw scancodes waiting for the kernel worker
 
 // Single key event
 struct KeyEvent {
@@ -92,6 +93,8 @@ const uint32_t uppercase[128] = {
 
 void push_key_event(KeyEvent ev);
 bool pop_key_event(KeyEvent& out);
+// Blocks the current process until the buffer holds a key event
+void wait_key_event(void);
 
 } // Namespace kbrd
 
@@ -20,6 +20,8 @@ extern const uint32_t frequency;
 namespace pit {
     void init(void); // Initializes the PIT
     void delay(const uint64_t ms);
+    // Advances the kernel tick, called by the PIT or the LAPIC timer once it took over
+    void tick(void);
 
     // Terminal functions
     void getuptime();
@@ -19,7 +19,8 @@ enum VGA_Modes {
 
 struct multiboot_tag_framebuffer;
 namespace vga {
-    extern uint32_t* framebuffer;
+    extern uint32_t* framebuffer; // Virtual address in the framebuffer window
+    extern uint32_t fb_phys;
     extern uint32_t fb_size;
 
     extern uint32_t screen_width;
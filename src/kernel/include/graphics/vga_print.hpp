@@ -10,7 +10,7 @@
 
 #pragma region VGA Text Mode
 
-#define VGA_ADDRESS 0xB8000 // VGA address
+#define VGA_ADDRESS 0xC00B8000 // VGA text buffer in the kernel's direct map
 
 // Size constraints
 #define NUM_COLS 80
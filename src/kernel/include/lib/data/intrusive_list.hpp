@@ -0,0 +1,92 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef INTRUSIVE_LIST_HPP
+#define INTRUSIVE_LIST_HPP
+
+#include <stdint.h>
+
+namespace data {
+
+    // Hook embedded in the objects of an intrusive list, an object sits in at most one list per hook
+    struct list_node {
+        list_node* next;
+        list_node* prev;
+    };
+
+    /* Doubly linked FIFO list whose nodes live inside the objects themselves (<Node> is the hook member),
+     * so pushing and removing never allocate and every operation is O(1) */
+    template<typename T, list_node T::*Node>
+    class intrusive_list {
+    private:
+        list_node* head;
+        list_node* tail;
+        uint32_t count;
+
+        /// @brief Returns the object a hook is embedded in
+        static T* owner(list_node* node) {
+            uintptr_t offset = (uintptr_t)&(((T*)0)->*Node);
+            return (T*)((uint8_t*)node - offset);
+        }
+
+    public:
+        constexpr intrusive_list() : head(nullptr), tail(nullptr), count(0) {}
+
+        // Objects can't be in two lists through the same hook
+        intrusive_list(const intrusive_list&) = delete;
+        intrusive_list& operator=(const intrusive_list&) = delete;
+
+        /// @brief Returns if list is empty
+        bool empty() const {
+            return head == nullptr;
+        }
+
+        /// @brief Returns list size
+        uint32_t size() const {
+            return count;
+        }
+
+        /// @brief Adds an object to the back of the list
+        void push(T* value) {
+            list_node* n = &(value->*Node);
+            n->next = nullptr;
+            n->prev = tail;
+
+            if (!tail) head = n;
+            else tail->next = n;
+            tail = n;
+            count++;
+        }
+
+        /// @brief Removes and returns the first object, nullptr if the list is empty
+        T* pop() {
+            if (!head) return nullptr;
+            T* value = owner(head);
+            remove(value);
+            return value;
+        }
+
+        /// @brief Unlinks an object that sits in this list
+        void remove(T* value) {
+            list_node* n = &(value->*Node);
+            if (n->prev) n->prev->next = n->next;
+            else head = n->next;
+            if (n->next) n->next->prev = n->prev;
+            else tail = n->prev;
+
+            n->next = n->prev = nullptr;
+            count--;
+        }
+
+        /// @brief Returns first object, nullptr if the list is empty
+        T* front() {
+            return head ? owner(head) : nullptr;
+        }
+    };
+} // namespace data
+
+#endif // INTRUSIVE_LIST_HPP
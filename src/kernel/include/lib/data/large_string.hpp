@@ -9,62 +9,63 @@
 #define LARGE_STRING_HPP
 
 #include <stdint.h>
+#include <mm/vmalloc.hpp>
 #include <mm/pmm.hpp>
 #include <lib/string_util.hpp>
 #include <lib/mem_util.hpp>
 #include <lib/data/list.hpp>
 
 namespace data {
-    /// @brief String that allocates from the PMM instead of the heap.
-    /// Suitable for large, persistent strings.
+    /// @brief String that allocates with vmalloc instead of the heap.
+    /// Suitable for large, persistent strings. Its frames don't need to be physically contiguous.
     class large_string {
     private:
         char* data;
         uint32_t length;
-        uint32_t blocks_used;
+        uint32_t blocks_used; // Frames mapped for data, the capacity
 
         static inline uint32_t calc_blocks(uint32_t bytes) {
             return (bytes + FRAME_SIZE - 1) / FRAME_SIZE; // round up to full frames
         }
 
-    public:
-        #pragma region Constructors & Destructors
-        large_string() : data(nullptr), length(0), blocks_used(0) {}
+        // Replaces data with a copy of <len> bytes of <str>
+        void assign(const char* str, uint32_t len) {
+            if (data)
+                vfree(data);
 
-        large_string(const char* str) {
-            if (!str) {
-                data = nullptr;
+            blocks_used = calc_blocks(len + 1);
+            data = (char*)vmalloc(blocks_used * FRAME_SIZE);
+            if (!data) {
                 length = 0;
                 blocks_used = 0;
                 return;
             }
-
-            length = strlen(str);
-            blocks_used = calc_blocks(length + 1);
-            data = (char*)pmm::alloc_frame(blocks_used);
+            length = len;
             memcpy(data, str, length);
             data[length] = '\0';
         }
 
-        large_string(const char* str, uint32_t len) {
-            length = len;
-            blocks_used = calc_blocks(length + 1);
-            data = (char*)pmm::alloc_frame(blocks_used);
-            memcpy(data, str, length);
-            data[length] = '\0';
+    public:
+        #pragma region Constructors & Destructors
+        large_string() : data(nullptr), length(0), blocks_used(0) {}
+
+        large_string(const char* str) : data(nullptr), length(0), blocks_used(0) {
+            if (str)
+                assign(str, strlen(str));
         }
 
-        large_string(const large_string& other) {
-            length = other.length;
-            blocks_used = calc_blocks(length + 1);
-            data = (char*)pmm::alloc_frame(blocks_used);
-            memcpy(data, other.data, length);
-            data[length] = '\0';
+        large_string(const char* str, uint32_t len) : data(nullptr), length(0), blocks_used(0) {
+            assign(str, len);
+        }
+
+        large_string(const large_string& other) : data(nullptr), length(0), blocks_used(0) {
+            if (other.data)
+                assign(other.data, other.length);
         }
 
         ~large_string() {
             if (data)
-                pmm::free_frame(data);
+                vfree(data);
         }
         #pragma endregion
 
@@ -74,28 +75,17 @@ namespace data {
         large_string& operator=(const large_string& other) {
             if (this == &other) return *this;
 
-            if (data)
-                pmm::free_frame(data);
-
-            length = other.length;
-            blocks_used = calc_blocks(length + 1);
-            data = (char*)pmm::alloc_frame(blocks_used);
-            memcpy(data, other.data, length);
-            data[length] = '\0';
+            if (other.data)
+                assign(other.data, other.length);
+            else
+                clear();
             return *this;
         }
 
         large_string& operator=(const char* str) {
             if (!str) return *this;
 
-            if (data)
-                pmm::free_frame(data);
-
-            length = strlen(str);
-            blocks_used = calc_blocks(length + 1);
-            data = (char*)pmm::alloc_frame(blocks_used);
-            memcpy(data, str, length);
-            data[length] = '\0';
+            assign(str, strlen(str));
             return *this;
         }
         #pragma endregion
@@ -135,7 +125,7 @@ namespace data {
         #pragma region Methods & Utility
         void clear() {
             if (data) {
-                pmm::free_frame(data);
+                vfree(data);
                 data = nullptr;
             }
             length = 0;
@@ -148,20 +138,24 @@ namespace data {
             uint32_t str_len = strlen(str);
             uint32_t new_length = length + str_len;
 
-            uint32_t new_blocks = calc_blocks(new_length + 1);
-            char* new_data = (char*)pmm::alloc_frame(new_blocks);
-
-            if (data)
-                memcpy(new_data, data, length);
-            memcpy(new_data + length, str, str_len);
-            new_data[new_length] = '\0';
-
-            if (data)
-                pmm::free_frame(data);
+            // Growing by at least twice the capacity, so appending byte by byte (file reads) stays linear
+            if (calc_blocks(new_length + 1) > blocks_used) {
+                uint32_t new_blocks = calc_blocks(new_length + 1);
+                if (new_blocks < blocks_used * 2) new_blocks = blocks_used * 2;
+                char* new_data = (char*)vmalloc(new_blocks * FRAME_SIZE);
+                if (!new_data) return *this;
+
+                if (data) {
+                    memcpy(new_data, data, length);
+                    vfree(data);
+                }
+                data = new_data;
+                blocks_used = new_blocks;
+            }
 
-            data = new_data;
+            memcpy(data + length, str, str_len);
             length = new_length;
-            blocks_used = new_blocks;
+            data[length] = '\0';
 
             return *this;
         }
@@ -182,14 +176,7 @@ namespace data {
             if (start + len > length)
                 len = length - start;
 
-            uint32_t blocks_needed = calc_blocks(len + 1);
-            char* temp = (char*)pmm::alloc_frame(blocks_needed);
-            memcpy(temp, data + start, len);
-            temp[len] = '\0';
-
-            large_string result(temp, len);
-            pmm::free_frame(temp);
-            return result;
+            return large_string(data + start, len);
         }
 
         bool includes(const char* substr) const {
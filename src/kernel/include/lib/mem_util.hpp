@@ -27,4 +27,27 @@ void* memcpy(void* dest, const void* src, size_t n);
 uint32_t memcmp(const void *s1, const void *s2, const size_t n);
 size_t align_up(const size_t value, const size_t alignment);
 
+#define MEM_STRING_MIN 64 // Spans from which the string variants use rep instructions, below that words are faster
+#define MEM_SSE2_MIN 1024 // Spans from which SSE2 makes up for the cost of an FPU section
+
+namespace mem {
+    // Implementations memset and memcpy can use
+    enum Variant : uint8_t {
+        BYTES,  // Byte at a time, only kept for benchmarks
+        WORDS,  // Aligned 32-bit word loops, for CPUs with slow string instructions (before the P6)
+        STRING, // rep movsd/stosd for large spans
+        ERMS,   // rep movsb/stosb for large spans, on CPUs with enhanced rep movsb
+        SSE2,   // 16 byte SSE2 moves inside of an FPU section for very large spans, rep movsd below
+        VARIANT_COUNT
+    };
+    extern Variant variant; // Used by memset and memcpy, WORDS until select_variant runs
+    extern const char* variant_names[VARIANT_COUNT];
+
+    // Picks the fastest variant for the CPU, called by cpu::get_processor_info
+    void select_variant(void);
+    // memcpy and memset with a given variant, every variant runs on every CPU
+    void copy(const Variant v, void* dest, const void* src, size_t n);
+    void fill(const Variant v, void* dest, const uint8_t val, size_t n);
+} // Namespace mem
+
 #endif // MEM_UTIL_HPP
@@ -0,0 +1,40 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef DMA_HPP
+#define DMA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DMA_UNIT 64          // Pool pages are handed out in 64 byte units
+#define DMA_UNITS 64         // Units in a single pool page
+#define DMA_POOL_MAX 2048    // Bigger buffers get frames of their own
+
+// Physically contiguous memory that can be handed to a bus master
+struct DmaBuffer {
+    void* virt;     // Address the kernel uses
+    uint32_t phys;  // Address the device uses
+    size_t size;
+};
+
+// Page of the DMA pool, small buffers are packed densely into it
+struct DmaPage {
+    DmaPage* next;
+    uint32_t virt;
+    uint32_t used[DMA_UNITS / 32]; // Bitmap of allocated units
+    uint32_t used_units;
+};
+
+namespace dma {
+    // Allocates zeroed, physically contiguous memory aligned to <align> (a power of two), virt is nullptr on failure
+    DmaBuffer alloc(const size_t size, const size_t align);
+    // Frees a buffer returned by alloc
+    void free(const DmaBuffer& buffer);
+} // Namespace dma
+
+#endif // DMA_HPP
@@ -9,20 +9,74 @@
 #define HEAP_HPP
 
 #include <stddef.h>
+#include <stdint.h>
 
-const size_t HEAP_START = 0x200000; // Heap start (2 MiB mark)
+const size_t HEAP_START = 0xC0200000; // Heap start (2 MiB mark in the direct map)
 const size_t HEAP_SIZE = 0x300000;  // 3 MiB heap size
+const size_t HEAP_EXT_START = 0xF0000000; // Virtual range the heap grows into once the initial window is full
+const size_t HEAP_EXT_SIZE = 0x04000000;  // 64 MiB extension range
 
-// Linked list node
+#define HEAP_GROW_MIN 0x10000        // The extension grows by at least 64 KiB at a time
+#define HEAP_TRIM_THRESHOLD 0x40000  // Free pages at the end of the extension are given back once there are 256 KiB of them
+
+#define HEAP_ALIGN 8          // Every block (and so every payload) is 8 byte aligned
+#define HEAP_HEADER_SIZE 8    // Size of the header in front of every payload
+#define HEAP_MIN_BLOCK 24     // Header, free list links and footer
+#define HEAP_BIN_COUNT 24     // Segregated free lists, bin i holds blocks of [2^(i+4), 2^(i+5)) bytes
+
+// Flags kept in the low bits of HeapBlock::size
+#define HEAP_BLOCK_FREE 0x1   // This block is free
+#define HEAP_PREV_FREE  0x2   // The physically previous block is free (and has a footer)
+#define HEAP_FLAG_MASK  0x7
+
+/* Boundary tagged block. Allocated blocks only carry the header, free blocks also
+ * carry free list links and a footer (copy of the size) in their last 4 bytes,
+ * so free can find and merge both physical neighbours in O(1) */
 struct HeapBlock {
-    size_t size;     // Block size
-    bool free;       // Is the block free
-    HeapBlock* next; // Next node
+    size_t size;           // Size of the whole block including the header, low bits are flags
+    size_t requested;      // Bytes asked for by kmalloc, 0 if free
+    // Only valid while the block is free
+    HeapBlock* next_free;
+    HeapBlock* prev_free;
+};
+
+// Heap counters, updated in O(1) by kmalloc/kfree so they can always stay enabled
+struct HeapStats {
+    uint64_t allocs;                      // Successful kmalloc calls, slab objects included
+    uint64_t frees;
+    uint64_t failed;                      // kmalloc calls that ran out of memory
+    size_t block_bytes;                   // Bytes in allocated blocks, headers included
+    size_t peak_block_bytes;
+    size_t free_bytes;                    // Bytes in free blocks
+    uint32_t free_blocks[HEAP_BIN_COUNT]; // Free blocks in every bin
 };
 
 namespace heap {
     void init(void);
+    extern HeapStats stats;
+    // Returns the size of the largest free block
+    size_t largest_free_block(void);
+    // Returns the external fragmentation in percent (1 - largest free block / free bytes)
+    uint32_t fragmentation(void);
     extern HeapBlock* heap_head;
+    extern size_t extension_size; // Bytes currently mapped in the extension range
+
+    // Returns the first block of the extension range, nullptr if the heap never grew
+    inline HeapBlock* extension_head(void) { return extension_size ? (HeapBlock*)HEAP_EXT_START : nullptr; }
+    // Returns if a pointer lies in the initial window or the mapped part of the extension range
+    inline bool owns(const void* ptr) {
+        return ((size_t)ptr >= HEAP_START && (size_t)ptr < HEAP_START + HEAP_SIZE) ||
+               ((size_t)ptr >= HEAP_EXT_START && (size_t)ptr < HEAP_EXT_START + extension_size);
+    }
+
+    // Block helpers
+    inline size_t block_size(const HeapBlock* block) { return block->size & ~HEAP_FLAG_MASK; }
+    inline bool is_free(const HeapBlock* block) { return block->size & HEAP_BLOCK_FREE; }
+    // Returns the physically next block, nullptr at the end of the heap
+    inline HeapBlock* next_block(HeapBlock* block) {
+        HeapBlock* next = (HeapBlock*)((char*)block + block_size(block));
+        return block_size(next) ? next : nullptr;
+    }
 } // Namespace heap
 
 // Memory allocation and deallocation functions
@@ -33,6 +87,8 @@ void* kmalloc(const size_t size);
 void kfree(void* ptr);
 // Allocates space for an array
 void* kcalloc(const size_t num, const size_t size);
+// Allocates a block of size <size> whose address is a multiple of <align> (a power of two), freed with kfree
+void* kmalloc_aligned(const size_t size, const size_t align);
 
 // Placement new: required for constructing objects in preallocated memory
 inline void* operator new(size_t, void* ptr) noexcept { return ptr; }
@@ -0,0 +1,60 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef MEMTRACE_HPP
+#define MEMTRACE_HPP
+
+#include <stdint.h>
+
+#define MEMTRACE_RECORDS 2048  // Size of the ring buffer, older records get overwritten
+#define MEMTRACE_MAX_SITES 64  // Call sites memtrace::get_sites can tell apart
+
+// What a trace record stands for
+enum TraceEvent : uint8_t {
+    TRACE_KMALLOC,
+    TRACE_KFREE,
+    TRACE_FRAME_ALLOC,
+    TRACE_FRAME_FREE
+};
+
+// A single allocator call
+struct TraceRecord {
+    uint64_t tick;    // PIT ticks at the time of the call
+    uint32_t caller;  // Return address of the allocator call
+    uint32_t ptr;     // Returned/freed pointer
+    uint32_t size;    // Bytes (frames for the PMM) requested, 0 for frees
+    TraceEvent event;
+};
+
+// Bytes allocated by one call site that weren't freed within the ring buffer
+struct TraceSite {
+    uint32_t caller;
+    bool frames;          // Site allocates PMM frames instead of heap memory
+    uint32_t allocs;      // Allocations in the ring buffer
+    uint32_t live_allocs; // Of which weren't freed yet
+    uint64_t live_bytes;
+};
+
+namespace memtrace {
+    extern bool enabled;
+    extern TraceRecord records[MEMTRACE_RECORDS];
+    extern uint64_t total; // Records written since the last clear, the newest is at (total - 1) % MEMTRACE_RECORDS
+
+    // Writes a record into the ring buffer
+    void record(const TraceEvent event, const void* caller, const void* ptr, const uint32_t size);
+    // Empties the ring buffer
+    void clear(void);
+    // Fills <sites> with call sites sorted by live bytes, returns the amount of sites
+    uint32_t get_sites(TraceSite* sites, const uint32_t max);
+
+    // Allocator hook, a single predicted branch while tracing is off
+    static inline void trace(const TraceEvent event, const void* caller, const void* ptr, const uint32_t size) {
+        if(__builtin_expect(enabled, 0)) record(event, caller, ptr, size);
+    }
+} // Namespace memtrace
+
+#endif // MEMTRACE_HPP
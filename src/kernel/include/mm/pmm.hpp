@@ -15,14 +15,48 @@
 #define METADATA_ADDR 0x600000 // 6MiB mark
 #define FRAME_SIZE 0x1000 // 4KiB frames
 
-// Linked list node for memory metadata
-struct MetadataNode {
-    uint64_t addr;
-    uint64_t size;
-    bool free : 1;
-    MetadataNode* next;
-    MetadataNode* prev;
-} __attribute__((packed));
+#define PMM_MAX_ORDER 10 // Largest buddy block is 2^10 frames (4MiB)
+#define PMM_ORDER_COUNT (PMM_MAX_ORDER + 1)
+#define PMM_MAX_ZONES 8 // Maximum amount of usable mmap regions we manage
+#define PMM_NO_FRAME 0xFFFFFFFF
+#define PMM_ZERO_POOL_SIZE 64 // Single frames the idle process keeps zeroed ahead of time
+
+// FrameNode flags
+#define FRAME_FREE 0x1 // Frame is the head of a free block
+#define FRAME_USED 0x2 // Frame is the head of an allocation
+
+// Metadata of a single frame, kept in an array per zone starting at METADATA_ADDR
+struct FrameNode {
+    union {
+        uint32_t next;  // Free heads: next free block of the same order (frame index)
+        uint32_t count; // Used heads: amount of frames in the allocation
+    };
+    uint32_t prev;      // Free heads: previous free block of the same order
+    uint8_t order;      // Free heads: order of the block
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+/* A usable mmap region managed by a binary buddy allocator. The zone's frame indexes start
+ * at a 4MiB aligned base, so blocks of every order are naturally aligned in physical memory */
+struct BuddyZone {
+    uint64_t base;                          // Physical address of frame index 0
+    uint64_t start;                         // Physical address of the regions first frame
+    uint32_t frame_count;                   // Frames covered by the metadata array
+    FrameNode* frames;                      // Metadata array
+    uint32_t free_lists[PMM_ORDER_COUNT];   // Heads of the free lists of every order
+    uint32_t free_blocks[PMM_ORDER_COUNT];  // Amount of free blocks of every order
+    uint16_t free_map;                      // Bitmap of orders with a non-empty free list
+    bool high;                              // Zone is above the kernel's direct map
+};
+
+// Fragmentation statistics of the buddy allocator
+struct BuddyStats {
+    uint32_t free_blocks[PMM_ORDER_COUNT]; // Free blocks of every order across all zones
+    uint64_t free_bytes;
+    uint64_t largest_free;                 // Largest free block in bytes
+    uint32_t fragmentation;                // Percent of free memory that isn't in max order blocks
+};
 
 namespace pmm {
     // Variables
@@ -30,13 +64,21 @@ namespace pmm {
     extern uint64_t total_used_ram;
     extern uint64_t hardware_reserved_ram;
     extern uint64_t total_installed_ram;
+    // Allocation counters
+    extern uint64_t alloc_count;
+    extern uint64_t free_count;
+    extern uint64_t peak_used_ram;
     uint32_t get_kernel_addr();
     uint32_t get_kernel_end();
     uint32_t get_kernel_size();
 
-    // Linked list heads
-    extern MetadataNode* low_alloc_mem_head;
-    extern MetadataNode* high_alloc_mem_head;
+    // Buddy zones
+    extern BuddyZone zones[PMM_MAX_ZONES];
+    extern uint32_t zone_count;
+    // End of the frame metadata, frames from here on are handed out
+    uint32_t get_metadata_end();
+    // End of the RAM in the kernel's direct map (VMM_DIRECT_MAP_SIZE at most)
+    uint32_t get_direct_map_end();
 
     // Prints out memory map
     void print_memory_map(void);
@@ -47,9 +89,23 @@ namespace pmm {
 
     // Frame alloc / dealloc functions
 
-    // Allocates a frame in the usable memory regions
-    void* alloc_frame(const uint64_t num_blocks, bool identity_map = true);
+    /* Allocates frames in the direct map, returns their direct map address or their physical address if <mapped> is false.
+     * Frames that will be overwritten anyway can skip zeroing */
+    void* alloc_frame(const uint64_t num_blocks, bool mapped = true, bool zero = true);
+    // Frees frames from alloc_frame, takes both kinds of addresses it returns
     void free_frame(void* ptr);
+    // Allocates frames that may lie above the direct map (and above 4GiB with PAE paging), returns their physical address or 0. They aren't mapped or zeroed, use vmm::kmap to reach them
+    uint64_t alloc_high_frame(const uint32_t num_blocks);
+    // Frees frames from alloc_high_frame
+    void free_high_frame(const uint64_t phys_addr);
+
+    // Amount of frames in the pre-zeroed pool
+    extern uint32_t zero_pool_count;
+    // Zeroes one frame for the pre-zeroed pool, returns false if the pool is full. Called by the idle process
+    bool refill_zero_pool(void);
+
+    // Returns fragmentation statistics of the buddy allocator
+    BuddyStats get_buddy_stats(void);
 
 } // Namespace pmm
 
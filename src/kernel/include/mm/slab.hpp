@@ -0,0 +1,64 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef SLAB_HPP
+#define SLAB_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLAB_MIN_SIZE 8       // Smallest size class
+#define SLAB_MAX_SIZE 2048    // Largest size class, bigger requests go to the block allocator
+#define SLAB_CLASS_COUNT 9    // 8, 16, 32, 64, 128, 256, 512, 1024, 2048
+#define SLAB_MAX_OBJECTS 512  // Upper bound of objects in a single slab (8 byte class in one frame)
+#define SLAB_SPARE_EMPTY 1    // Empty slabs a cache keeps before giving frames back to the PMM
+
+// Header placed at the start of every slab, objects follow it
+struct SlabPage {
+    SlabPage* next;        // Next slab in the caches partial list
+    SlabPage* prev;        // Previous slab in the caches partial list
+    void* free_list;       // Free objects of this slab
+    uint16_t class_index;  // Size class this slab belongs to
+    uint16_t capacity;     // Amount of objects this slab holds
+    uint16_t in_use;       // Amount of allocated objects
+    uint16_t frames;       // Frames backing this slab
+    uint32_t bitmap[SLAB_MAX_OBJECTS / 32]; // Allocated objects, used to catch double/invalid frees
+};
+
+// Cache for one size class
+struct SlabCache {
+    uint32_t object_size;
+    uint8_t object_shift;     // log2(object_size)
+    uint8_t frames_per_slab;
+    SlabPage* partial;        // Slabs with at least one free object
+
+    // Stats
+    uint32_t slab_count;      // Slabs owned by this cache
+    uint32_t empty_count;     // Slabs with no allocated objects
+    uint32_t objects_in_use;
+    uint32_t objects_total;
+    uint64_t allocs;          // Allocations served by this cache
+    uint64_t frees;
+    uint64_t refills;         // Allocations that needed a fresh slab from the PMM
+};
+
+namespace slab {
+    extern bool enabled;
+    extern SlabCache caches[SLAB_CLASS_COUNT];
+
+    // Initializes size class caches, needs the PMM and VMM
+    void init(void);
+
+    // Allocates an object of at most SLAB_MAX_SIZE bytes, nullptr if no slab could be made
+    void* alloc(const size_t size);
+    // Frees an object, returns false if the pointer doesn't belong to a slab
+    bool free(void* ptr);
+    // Returns if a pointer lives inside of a slab
+    bool owns(const void* ptr);
+} // Namespace slab
+
+#endif // SLAB_HPP
@@ -0,0 +1,31 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef VMALLOC_HPP
+#define VMALLOC_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VMALLOC_START 0xF4000000 // Kernel virtual range vmalloc areas are placed in
+#define VMALLOC_SIZE  0x04000000 // 64 MiB
+#define VMALLOC_PAGES (VMALLOC_SIZE / 0x1000)
+
+// vmalloc counters
+struct VmallocStats {
+    uint32_t used_pages;   // Pages of the range taken by areas, guard pages included
+    uint32_t mapped_pages; // Pages backed by frames
+};
+extern VmallocStats vmalloc_stats;
+
+/* Allocates <size> bytes that are virtually contiguous but built from single frames, so it works
+ * however fragmented physical memory is. The memory isn't zeroed and isn't usable for DMA */
+void* vmalloc(const size_t size);
+// Frees an area returned by vmalloc
+void vfree(void* ptr);
+
+#endif // VMALLOC_HPP
@@ -11,10 +11,32 @@
 #include <stdint.h>
 
 #define PAGE_SIZE 4096
+#define LARGE_PAGE_SIZE 0x400000 // 4 MiB PSE page
 #define PD_ENTRIES 1024
 #define PT_ENTRIES 1024
 
+/* Kernel space starts at KERNEL_LOAD_ADDRESS and is the same in every address space, everything below it
+ * is left to processes. Physical memory below VMM_DIRECT_MAP_SIZE is mapped at KERNEL_LOAD_ADDRESS + phys */
 #define KERNEL_LOAD_ADDRESS 0xC0000000
+#define VMM_DIRECT_MAP_SIZE 0x30000000 // 768 MiB
+#define VMM_FB_ADDR 0xF8000000         // Framebuffer window, mapped by boot.asm
+#define VMM_FB_SIZE 0x01000000
+#define VMM_MMIO_ADDR 0xF9000000       // Device registers mapped with map_mmio
+#define VMM_MMIO_SIZE 0x06600000
+#define VMM_KMAP_ADDR 0xFF600000    // Window for temporary mappings of frames that aren't in the direct map
+#define VMM_KMAP_SLOTS 256          // Pages in the kmap window
+#define VMM_TLB_BATCH_MAX 32        // Pages a TLB batch flushes one by one, bigger batches reload CR3
+
+/* The last PD entry points at the PD itself, so the PT of any address is reachable at
+ * VMM_RECURSIVE_ADDR + PD_INDEX * PAGE_SIZE and the PD at VMM_PD_ADDR */
+#define VMM_RECURSIVE_ADDR 0xFFC00000
+#define VMM_PD_ADDR 0xFFFFF000
+
+// Boot paging structures built by boot.asm, the 32-bit VMM keeps using its PD
+#define BOOT_PAGING_ADDR 0x500000
+
+#define PHYS_TO_VIRT(paddr) ((paddr) + KERNEL_LOAD_ADDRESS) // Direct map address of physical memory
+#define VIRT_TO_PHYS(vaddr) ((vaddr) - KERNEL_LOAD_ADDRESS)
 
 #define PD_INDEX(vaddr)   (((vaddr) >> 22) & 0x3FF)
 #define PT_INDEX(vaddr)   (((vaddr) >> 12) & 0x3FF)
@@ -24,6 +46,22 @@
 #define FRAME4MB_TO_PHYS(vaddr) (vaddr << 22)
 #define PHYS_TO_FRAME4MB(vaddr) (vaddr >> 22)
 
+// PAE paging, the four page directories are treated as one array of 2048 entries
+#define PAE_PDPT_ENTRIES 4
+#define PAE_ENTRIES 512                   // Entries in a PAE page directory/table
+#define PAE_LARGE_PAGE_SIZE 0x200000      // 2 MiB page
+#define PAE_DIR_INDEX(vaddr) ((vaddr) >> 21)
+#define PAE_PT_INDEX(vaddr)  (((vaddr) >> 12) & 0x1FF)
+#define PAE_ADDR_MASK 0x000FFFFFFFFFF000ULL // Physical address bits of an entry
+// The last four directory entries point at the four directories, tables are at VMM_PAE_RECURSIVE_ADDR + PAE_DIR_INDEX * PAGE_SIZE
+#define VMM_PAE_RECURSIVE_ADDR 0xFF800000
+#define VMM_PAE_DIRS_ADDR 0xFFFFC000        // The four directories as one array
+
+// CR4 bits set by enable_paging
+#define CR4_PSE 0x10
+#define CR4_PAE 0x20
+#define CR4_PGE 0x80 // Global pages, kernel space TLB entries survive CR3 reloads
+
 #pragma region Paging Structures
 
 // Entries for PD and PT
@@ -53,7 +91,9 @@ struct page_4mb {
     uint32_t global : 1;
     uint32_t ignored : 3;
     uint32_t pat : 1;
-    uint32_t address : 19;
+    uint32_t address_high : 8; // Bits 32-39 of the address with PSE-36
+    uint32_t reserved : 1;
+    uint32_t address : 10;
 } __attribute__((packed));
 
 struct page_4kb {
@@ -78,7 +118,17 @@ struct pt_t {
 
 struct pd_t {
     pd_ent entries[PD_ENTRIES];
-    pt_t* page_tables[PD_ENTRIES];
+};
+
+// PAE entries are 64-bit, built from PAGING_FLAGS and the physical address
+
+struct pae_pt_t {
+    uint64_t pages[PAE_ENTRIES];
+};
+
+struct pae_pdpt_t {
+    uint64_t entries[PAE_PDPT_ENTRIES * PAE_ENTRIES];        // The four page directories back to back
+    uint64_t pdpt[PAE_PDPT_ENTRIES];                         // Loaded into CR3, points to the directories
 };
 
 enum PAGING_FLAGS {
@@ -98,30 +148,68 @@ enum PAGING_FLAGS {
 
 namespace vmm {
     extern bool enabled_paging;
-    extern bool pae_paging;
+    extern bool pae_paging; // PAE paging, frames above 4GiB can be mapped
+    extern bool pse_paging; // 4 MiB pages are supported
 
     pd_t* get_active_pd(void);
+    // Returns the physical address loaded into CR3 for the kernel's address space
+    uint32_t get_cr3(void);
 
+    // Picks the paging mode from CPUID and the memory map, has to run before the PMM builds its zones
+    void select_paging_mode(void* mb2_info);
     // Initializes the VMM
     void init(void);
-    // Allocates a 4 KiB page
-    void alloc_page(const uint32_t virt_addr, const uint32_t phys_addr, const uint32_t flags);
-    // Allocates a 4 MiB page
+    // Allocates a 4 KiB page, physical addresses above 4GiB need PAE paging
+    void alloc_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags);
+    // Allocates a 4 MiB page, both addresses have to be 4 MiB aligned
     void alloc_page_4mib(const uint32_t virt_addr, const uint32_t phys_addr, const uint32_t flags);
-    // Identity maps a region in a given range
+    // Identity maps a region in a given range, 4 MiB aligned spans get 4 MiB pages
     void identity_map_region(const uint32_t start_addr, const uint32_t end_addr, const uint32_t flags);
-    // Frees a page at a give virtual address
+    // Maps <size> bytes of physically contiguous memory with one batched TLB flush, aligned spans get large pages
+    void map_region(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t size, const uint32_t flags);
+    // Unmaps <size> bytes with one batched TLB flush
+    void unmap_region(const uint32_t virt_addr, const uint32_t size);
+    /* Between these, TLB flushes of mapped/unmapped pages are collected and issued at the end,
+     * as single invlpgs for small batches or a CR3 reload for big ones. Pages changed inside a batch
+     * must not be accessed before it ends. Interrupts are off while a batch is open */
+    void begin_tlb_batch(void);
+    void end_tlb_batch(void);
+    // Frees a page at a give virtual address, 4 MiB pages are freed as a whole
     bool free_page(const uint32_t virt_addr);
     // Returns the corresponding physical address for a virtual address
     void* virtual_to_physical(const uint32_t virt_addr);
     // Returns if a page at the given virtual address is mapped or not
     bool is_mapped(const uint32_t virt_addr);
+    // Returns if the given virtual address is mapped by a 4 MiB (2 MiB with PAE) page
+    bool is_large_page(const uint32_t virt_addr);
+
+    // Maps device registers into the MMIO window, returns the virtual address of <phys_addr>
+    void* map_mmio(const uint32_t phys_addr, const uint32_t size, const uint32_t flags);
+
+    // Temporarily maps the frame holding a physical address, returns the matching virtual address (nullptr if the window is full)
+    void* kmap(const uint64_t phys_addr);
+    // Removes a mapping made by kmap
+    void kunmap(const void* virt_addr);
+
+    // PAE versions of the mapping functions, called by the ones above when PAE paging is used
+    namespace pae {
+        extern pae_pdpt_t* active;
+
+        void alloc_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags);
+        void alloc_large_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags);
+        bool free_page(const uint32_t virt_addr);
+        uint64_t virtual_to_physical(const uint32_t virt_addr);
+        bool is_mapped(const uint32_t virt_addr);
+        bool is_large_page(const uint32_t virt_addr);
+    } // Namespace pae
 }
 
 // Functions defined in ASM
 extern "C" void set_pd(uint32_t);
-extern "C" void enable_paging(void);
+extern "C" void enable_paging(uint32_t cr4_flags);
 extern "C" void reload_cr3(void);
 extern "C" void invlpg(uint32_t);
+extern "C" void flush_tlb(void); // Also flushes global pages
+extern "C" void switch_paging(uint32_t cr3, uint32_t cr4_flags);
 
 #endif // VMM_HPP
@@ -143,6 +143,13 @@ struct multiboot_tag_framebuffer {
 #define MULTIBOOT_MEMORY_NVS              4
 #define MULTIBOOT_MEMORY_BADRAM           5
 
+// ACPI tags, hold a copy of the RSDP (old tag: ACPI 1.0, new tag: ACPI 2.0+)
+struct multiboot_tag_acpi {
+    uint32_t type;
+    uint32_t size;
+    uint8_t rsdp[0];
+} __attribute__((packed));
+
 // ============================================
 // Helper Functions
 // ============================================
@@ -162,6 +169,9 @@ public:
     static multiboot_tag_mmap* get_mmap(void* mb2_info);
 
     static multiboot_tag_bootdev* get_bootdev(void* mb2_info);
+
+    // Returns the ACPI 2.0+ RSDP tag, or the ACPI 1.0 one if there's none
+    static multiboot_tag_acpi* get_acpi(void* mb2_info);
 };
 
 #endif // MULTIBOOT_HPP
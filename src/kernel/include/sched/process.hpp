@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <x86/sched/context.hpp>
 #include <lib/data/list.hpp>
+#include <lib/data/intrusive_list.hpp>
 
 #define KERNEL_PROCESS_STACK_SIZE 8192
 #define KERNEL_PROCESS_EFLAGS 0x202
@@ -42,16 +43,25 @@ class Process {
     context_t ctx;
     void* stack;
     pd_t* pd;
+    void* fpu_state; // FXSAVE area, allocated by the first FPU instruction the process runs
     
     uint32_t priority;
     uint32_t time_slice;
+    uint32_t boost;       // Levels gained by waiting in a run queue, dropped once the process runs
+    uint64_t ready_since; // Tick the process was put into its run queue
+    uint32_t cpu;         // Index of the CPU whose run queue the process is placed on
     
     public:
+    // Hook of the run or zombie queue the process sits in, a process is in at most one at a time
+    data::list_node queue_node;
+
     // Creates a process
     static Process* create(void (*entry)(), uint32_t priority, const char* name = "");
+    // Frees a process that was never started and takes it off the process list
+    static void destroy(Process* proc);
     Process() 
-    : pid(KERNEL_ERROR_PID), stack(nullptr), pd(nullptr), name(""), state(PROCESS_READY),
-    priority(PROCESS_MIN_PRIORITY), time_slice(TIME_QUANTUM) { }
+    : pid(KERNEL_ERROR_PID), stack(nullptr), pd(nullptr), fpu_state(nullptr), name(""), state(PROCESS_READY),
+    priority(PROCESS_MIN_PRIORITY), time_slice(TIME_QUANTUM), boost(0), ready_since(0), cpu(0), queue_node{} { }
     
     void start(void);
     void exit(void);
@@ -61,9 +71,15 @@ class Process {
     context_t* get_ctx();
     void* get_stack();
     pd_t* get_pd();
+    void* get_fpu_state();
     uint32_t get_pid();
     uint32_t get_priority();
     uint32_t get_time_slice();
+    // Priority with aging boosts, decides the run queue
+    uint32_t get_effective_priority();
+    uint32_t get_boost();
+    uint64_t get_ready_since();
+    uint32_t get_cpu();
     const char* get_name();
     ProcessState get_state();
     
@@ -72,8 +88,15 @@ class Process {
     void decrement_time_slice();
     void set_state(ProcessState state);
     void set_priority(uint8_t p);
+    void set_fpu_state(void* state);
+    void set_boost(uint32_t b);
+    void set_ready_since(uint64_t tick);
+    void set_cpu(uint32_t c);
 };
 
-extern data::list<Process*> process_log_list;;
+// Allocation free FIFO of processes, linked through Process::queue_node
+typedef data::intrusive_list<Process, &Process::queue_node> process_queue;
+
+extern data::list<Process*> process_log_list;
 
 #endif // PROCESS_HPP
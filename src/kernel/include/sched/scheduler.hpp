@@ -9,17 +9,71 @@
 #define SCHEDULER_HPP
 
 #include <sched/process.hpp>
-#include <lib/data/queue.hpp>
+#include <sched/spinlock.hpp>
+#include <x86/smp.hpp>
 
-extern Process* curr_process;
-extern data::queue<Process*> process_queue;
+// One run queue per priority level, level 0 holds PROCESS_MIN_PRIORITY
+#define SCHED_LEVELS (PROCESS_MAX_PRIORITY - PROCESS_MIN_PRIORITY + 1)
+#define SCHED_AGING_INTERVAL 10 // Ticks between aging passes
+#define SCHED_AGING_TICKS 100   // Ticks a process waits in its run queue before it's boosted one level
+#define SCHED_MIGRATION_TICKS 3 // Ticks a process waits before another CPU may steal it, until then its cache is likely still warm
+
+// Every CPU schedules the processes placed on it from its own run queue
+struct RunQueue {
+    Spinlock lock;
+    process_queue levels[SCHED_LEVELS];
+    uint32_t ready_levels; // Bit n is set while levels[n] isn't empty
+    uint32_t load;         // Processes placed on the CPU that haven't terminated, idle excluded
+    uint32_t ticks;        // Scheduler ticks the CPU got, paces aging
+    Process* idle;         // Runs whenever the queue is empty, never sits in it
+    Process* dead;         // Terminated process whose stack was in use until the last switch
+    Process* prev;         // Last process switched away from, its registers may not be saved yet
+    uint32_t steals;       // Processes this CPU took from other CPUs
+    uint32_t stolen;       // Processes other CPUs took from this one
+};
+
+extern RunQueue run_queues[SMP_MAX_CPUS];
 
 struct InterruptRegisters;
 namespace sched {
     void init();
+    // Creates the idle process of a CPU, APs boot on its stack
+    Process* create_idle(const uint32_t cpu);
+    // Frees the idle process of a CPU that didn't start
+    void destroy_idle(const uint32_t cpu);
+    // Makes the idle process the running one on an AP, never returns
+    [[noreturn]] void run_idle();
     void exit_current_process();
     void zombie_reaper();
     void schedule();
+    // Places a new process on the least loaded CPU and queues it there, idle CPUs may steal it later
+    void add(Process* proc);
+    // Puts a process at the back of its level's run queue, on the CPU it's placed on
+    void enqueue(Process* proc);
+    // Called by the timer every tick on every CPU, ages waiting processes and preempts the current one
+    void tick();
+
+    // Returns the process running on this CPU
+    inline Process* current() { return smp::current_process(); }
+
+    // Per-CPU counters, read without locks
+    inline uint32_t get_load(const uint32_t cpu) { return run_queues[cpu].load; }
+    inline uint32_t get_steals(const uint32_t cpu) { return run_queues[cpu].steals; }
+    inline uint32_t get_stolen(const uint32_t cpu) { return run_queues[cpu].stolen; }
+
+    // Returns if the current context may block (a process other than idle, with interrupts on)
+    bool can_block();
+    // Same, but with interrupts judged by <flags>, like the ones lock_irqsave returns
+    bool can_block(const uint32_t flags);
+    /* Blocks the current process until sched::wake or tick <deadline> (0 waits without a timeout), returns false
+     * if the deadline came first. <lock> (may be nullptr) is released once the process is marked blocked */
+    bool block(Spinlock* lock, const uint64_t deadline);
+    // Blocks the current process for at least <ms> milliseconds, other processes run meanwhile
+    void sleep_ms(const uint64_t ms);
+    // Blocks the current process until sched::wake or until <ms> milliseconds pass, returns false on timeout
+    bool block_timeout(const uint64_t ms);
+    // Makes a blocked process ready again, safe to call from interrupt handlers and other CPUs
+    void wake(Process* proc);
 } // namespace sched
 
 #endif // SCHEDULER_HPP
@@ -0,0 +1,67 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef SPINLOCK_HPP
+#define SPINLOCK_HPP
+
+#include <stdint.h>
+
+/* Busy waiting ticket lock for data shared between CPUs. Waiters get the lock in the order they
+ * asked for it, so no CPU can starve. Needs xadd and cmpxchg (i486 and newer, every SMP capable CPU).
+ * Data that interrupt handlers touch too has to be locked with lock_irqsave, otherwise a handler
+ * could spin on a lock the code it interrupted holds. Code that holds one must not block */
+class Spinlock {
+    private:
+    volatile uint16_t serving; // Ticket holding the lock, only the holder advances it
+    volatile uint16_t next;    // Next ticket to hand out
+
+    public:
+    constexpr Spinlock() : serving(0), next(0) {}
+
+    void lock(void) {
+        uint16_t ticket = 1;
+        asm volatile("lock xaddw %0, %1" : "+r"(ticket), "+m"(next) :: "memory");
+        // Waiting with plain reads, so the cache line isn't bounced between CPUs
+        while(serving != ticket) asm volatile("pause" ::: "memory");
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+
+    /* Takes the lock only if it's free, returns if it did. While nobody took a ticket in between,
+     * serving can't have moved either, so comparing next alone is enough */
+    bool try_lock(void) {
+        uint16_t old = next;
+        if(serving != old) return false;
+        uint16_t prev;
+        asm volatile("lock cmpxchgw %2, %1" : "=a"(prev), "+m"(next) : "r"((uint16_t)(old + 1)), "0"(old) : "memory");
+        return prev == old;
+    }
+
+    // Serves the next ticket
+    void unlock(void) {
+        asm volatile("lock incw %0" : "+m"(serving) :: "memory");
+    }
+
+    // Disables interrupts and takes the lock, returns the previous EFLAGS
+    uint32_t lock_irqsave(void) {
+        uint32_t flags;
+        asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+        lock();
+        return flags;
+    }
+
+    // Releases the lock, interrupts are enabled again if they were before lock_irqsave
+    void unlock_irqrestore(const uint32_t flags) {
+        unlock();
+        if(flags & 0x200) asm volatile("sti" ::: "memory");
+    }
+
+    bool is_locked(void) const {
+        return serving != next;
+    }
+};
+
+#endif // SPINLOCK_HPP
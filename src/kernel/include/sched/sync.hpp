@@ -0,0 +1,87 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef SYNC_HPP
+#define SYNC_HPP
+
+#include <stdint.h>
+#include <sched/spinlock.hpp>
+#include <lib/data/intrusive_list.hpp>
+
+#define MUTEX_SPIN_LIMIT 1000 // Pauses a locker spends waiting for a running owner before it blocks
+
+class Process;
+
+// A process waiting in a WaitQueue, lives on the waiter's stack so waiting never allocates
+struct WaitQueueEntry {
+    data::list_node node;
+    Process* proc; // nullptr for waiters that can't block and poll woken instead
+    bool woken;    // Set by the waker when it takes the entry out
+};
+
+/* Processes blocked (PROCESS_BLOCKED) until an event, woken in FIFO order. <lock> also guards the
+ * condition the waiters wait for: checking it and waiting under the lock means no wake gets lost.
+ * Waking is safe from interrupt handlers */
+class WaitQueue {
+    private:
+    data::intrusive_list<WaitQueueEntry, &WaitQueueEntry::node> waiters;
+
+    public:
+    Spinlock lock;
+
+    /* Blocks until woken or tick <deadline> (0 waits forever). <lock> has to be held, taken with lock_irqsave
+     * whose <flags> are passed. It's released while waiting and held again on return. Contexts that can't
+     * block (no process, idle, interrupts off) poll instead. Returns false on timeout, callers recheck their condition */
+    bool wait_locked(const uint32_t flags, const uint64_t deadline);
+    // Blocks until woken or <ms> milliseconds pass (0 waits forever), returns false on timeout
+    bool wait(const uint64_t ms = 0);
+
+    // Wake the first or every waiter, <lock> has to be held
+    bool wake_one_locked(void);
+    void wake_all_locked(void);
+    bool wake_one(void);
+    void wake_all(void);
+};
+
+// Counting semaphore, posting is safe from interrupt handlers
+class Semaphore {
+    private:
+    WaitQueue waiters; // Its lock guards count
+    uint32_t count;
+
+    public:
+    constexpr Semaphore(const uint32_t initial = 0) : waiters(), count(initial) {}
+
+    // Takes one unit, blocking until there is one or <ms> milliseconds pass (0 waits forever). Returns false on timeout
+    bool wait(const uint64_t ms = 0);
+    // Takes one unit if there is one
+    bool try_wait(void);
+    // Gives one unit back and wakes a waiter
+    void post(void);
+    uint32_t get_count(void) const { return count; }
+};
+
+/* Sleeping lock for longer sections, like disk I/O. A locker spins while the owner runs on another CPU
+ * (it's likely to unlock soon) and blocks after MUTEX_SPIN_LIMIT pauses. Not for interrupt handlers */
+class Mutex {
+    private:
+    WaitQueue waiters; // Its lock guards locked and owner
+    volatile bool locked;
+    Process* volatile owner; // nullptr for owners that aren't processes (boot code)
+
+    bool owner_running(void);
+
+    public:
+    constexpr Mutex() : waiters(), locked(false), owner(nullptr) {}
+
+    void lock(void);
+    bool try_lock(void);
+    void unlock(void);
+    bool is_locked(void) const { return locked; }
+};
+
+#endif // SYNC_HPP
@@ -0,0 +1,42 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+#include <stdint.h>
+
+/* Hierarchical timer wheel, every level has TIMER_WHEEL_SLOTS slots that each cover a power of
+ * TIMER_WHEEL_SLOTS ticks. Level 0 slots are single ticks, higher levels get spread into the lower
+ * ones (cascaded) once their slot comes up, so adding, cancelling and expiring a timer is O(1) */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4 // Covers 2^24 ticks (~4.6 hours at 1000 Hz), later timers get cascaded again
+
+// A one shot timer, the caller owns its memory so arming one never allocates
+struct Timer {
+    Timer* next;
+    Timer* prev;
+    Timer** slot;                 // List head of the slot holding the timer
+    uint64_t expires;             // Tick the callback runs at
+    void (*callback)(void* data); // Runs in the PIT interrupt with interrupts off
+    void* data;
+    bool pending;                 // Sitting in the wheel
+};
+
+namespace timer {
+    // Arms a timer to run <callback> at tick <expires>, timers in the past run on the next tick
+    void add(Timer* t, const uint64_t expires, void (*callback)(void*), void* data);
+    // Disarms a timer, returns if it was still pending. Waits for its callback if that runs on another CPU, so it can't be called from it
+    bool cancel(Timer* t);
+    // Runs every timer that's due, called by the PIT every tick
+    void tick(void);
+    // Converts milliseconds to PIT ticks
+    uint64_t ms_to_ticks(const uint64_t ms);
+} // Namespace timer
+
+#endif // TIMER_HPP
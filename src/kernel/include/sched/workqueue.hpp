@@ -0,0 +1,35 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+
+#pragma once
+
+#ifndef WORKQUEUE_HPP
+#define WORKQUEUE_HPP
+
+#include <stdint.h>
+#include <lib/data/intrusive_list.hpp>
+
+#define WORK_WORKER_PRIORITY 10 // Deferred interrupt work shouldn't wait behind regular processes
+
+/* Work an interrupt handler defers (bottom half), the caller owns its memory so queueing never allocates.
+ * Handlers only acknowledge their device and queue the work, the kernel worker runs it with interrupts on */
+struct Work {
+    data::list_node node;
+    void (*func)(void* data); // Runs in the kernel worker, mustn't sleep since work queued behind it would wait
+    void* data;
+    volatile bool pending;    // Queued and not started yet, cleared before func runs so it can be queued again
+};
+
+namespace work {
+    // Creates the kernel worker, work queued before it starts is run right away instead
+    void init(void);
+    /* Queues <func> to run with <data> in the kernel worker, safe from interrupt handlers and other CPUs.
+     * Returns false if the work was still pending, it then runs once with the <func> and <data> it was queued with */
+    bool queue(Work* w, void (*func)(void*), void* data);
+    // Returns if the current process is the kernel worker running a work item, sched::block panics then
+    bool in_work(void);
+} // Namespace work
+
+#endif // WORKQUEUE_HPP
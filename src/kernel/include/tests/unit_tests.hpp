@@ -14,6 +14,19 @@ namespace unittsts {
     void test_heap(void);
     void test_pmm(void);
     void test_vmm(void);
+    void test_slab(void);
+    void test_heap_growth(void);
+    void test_dma(void);
+    void test_memtrace(void);
+    void test_vmalloc(void);
+    void test_mem_util(void);
+    void test_fpu(void);
+    void test_timer(void);
+    void test_apic(void);
+    void test_smp(void);
+    void test_sync(void);
+    void test_context(void);
+    void test_workqueue(void);
 } // Namespace unittsts
 
 #endif // UNIT_TESTS_HPP
@@ -18,10 +18,15 @@
 #include <device.hpp>
 #include <x86/gdt.hpp>
 #include <x86/cpuid.hpp>
+#include <x86/fpu.hpp>
+#include <x86/acpi.hpp>
+#include <x86/interrupts/apic.hpp>
+#include <x86/smp.hpp>
 #include <drivers/pit.hpp>
 #include <apps/kterminal.hpp>
 #include <mm/pmm.hpp>
 #include <mm/heap.hpp>
+#include <mm/slab.hpp>
 #ifdef PMM_HPP
 #include <mm/vmm.hpp>
 #endif // PMM_HPP
@@ -31,6 +36,7 @@
 #include <fs/sysdisk.hpp>
 #include <sched/process.hpp>
 #include <sched/scheduler.hpp>
+#include <sched/workqueue.hpp>
 #include <drivers/pci.hpp>
 #include <tests/unit_tests.hpp>
 
@@ -48,18 +54,38 @@ extern "C" void kernel_main(const uint32_t magic, void* mbi) {
     gdt::init(); // Global Descriptor Table (GDT)
     idt::init(); // Interrupts Descriptor Table (IDT)
     
+    fpu::init(); // Before get_processor_info, so memcpy can pick SSE2
     cpu::get_processor_info();
+    unittsts::test_fpu();
+    unittsts::test_mem_util(); // Checks the memcpy/memset variants before anything relies on them
     
     // Initializing memory managers
     heap::init();
     unittsts::test_heap();
+    vmm::select_paging_mode(mbi); // Decides if the PMM manages RAM above 4GiB
     pmm::init(mbi);
+    vmm::init(); // Completes the direct map boot.asm started
     unittsts::test_pmm();
-    vmm::init();
     unittsts::test_vmm();
+    slab::init();
+    unittsts::test_slab();
+    unittsts::test_heap_growth();
+    unittsts::test_dma();
+    unittsts::test_memtrace();
+    unittsts::test_vmalloc();
     
     // Drivers
     pit::init(); // Programmable Interval Timer
+    unittsts::test_timer();
+    acpi::init(mbi);
+    apic::init();       // IRQs move from the 8259 PIC to the IOAPIC
+    apic::init_timer(); // Calibrated against the PIT, then drives the tick instead of it
+    unittsts::test_apic();
+    smp::init(); // Application processors idle until processes are placed on them
+    unittsts::test_smp();
+    unittsts::test_sync();
+    unittsts::test_context();
+    unittsts::test_workqueue();
     pci::pci_brute_force_scan();
     kbrd::init(); // Keyboard drivers
     
@@ -69,11 +95,13 @@ extern "C" void kernel_main(const uint32_t magic, void* mbi) {
     // Finds system disk (the one MioOS is on) and sets up the VFS accordingly
     sysdisk::find_sysdisk();
 
-    // Scheduler/multitasking
-    sched::init();
-    
-    // Kernel CLI and other
+    // Kernel CLI and other, queued before the scheduler starts so it's the first thing it runs
     Process::create(cmd::init, 10, "Kernel Command Line")->start();
+    // Interrupt handlers hand their work to the kernel worker once it runs
+    work::init();
+
+    // Scheduler/multitasking, from here on this context is the idle process
+    sched::init();
     
     for(;;) asm volatile("hlt");
 }
@@ -9,6 +9,9 @@
 #include <lib/mem_util.hpp>
 #include <lib/math.hpp>
 #include <lib/data/string.hpp>
+#include <x86/cpuid.hpp>
+#include <x86/fpu.hpp>
+#include <mm/vmm.hpp>
 
 /// @brief Splits bytes into different units
 /// @return String representing units (e.g. 1_049_601 B = 1MiB 1KiB 1B)
@@ -53,30 +56,181 @@ data::string get_units(uint64_t bytes) {
     return result;
 }
 
-// Memset sets a block of memory to a specific value for a given number of bytes
-void memset(const void *dest, const char val, uint32_t count){
-    char *temp = (char*) dest;
-    for (; count != 0; count--){
-        *temp++ = val;
+#pragma region Copy and Fill
+
+mem::Variant mem::variant = mem::WORDS;
+const char* mem::variant_names[mem::VARIANT_COUNT] = {"bytes", "words", "rep movsd", "erms", "sse2"};
+
+// Words that may alias any other type, so GCC doesn't reorder them around byte accesses
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+// Keeps GCC from turning the loops below back into calls to memset/memcpy
+#define NO_LIBCALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+// SSE2 registers, the unaligned type is only used for loads
+typedef uint32_t v4si __attribute__((vector_size(16), may_alias));
+typedef uint32_t v4si_u __attribute__((vector_size(16), may_alias, aligned(1)));
+
+static NO_LIBCALLS void copy_bytes(uint8_t* d, const uint8_t* s, size_t n) {
+    while(n--) *d++ = *s++;
+}
+
+static NO_LIBCALLS void fill_bytes(uint8_t* d, const uint8_t val, size_t n) {
+    while(n--) *d++ = val;
+}
+
+// Aligns the destination and moves 32-bit words, an unaligned source only costs a few cycles on x86
+static NO_LIBCALLS void copy_words(uint8_t* d, const uint8_t* s, size_t n) {
+    if(n >= 8) {
+        while(uint32_t(d) & 3) { *d++ = *s++; n--; }
+
+        word_t* dw = (word_t*)d;
+        const word_t* sw = (const word_t*)s;
+        for(size_t i = n >> 4; i; i--, dw += 4, sw += 4) {
+            dw[0] = sw[0]; dw[1] = sw[1]; dw[2] = sw[2]; dw[3] = sw[3];
+        }
+        for(size_t i = (n >> 2) & 3; i; i--) *dw++ = *sw++;
+
+        d = (uint8_t*)dw;
+        s = (const uint8_t*)sw;
+        n &= 3;
     }
+    copy_bytes(d, s, n);
+}
+
+static NO_LIBCALLS void fill_words(uint8_t* d, const uint8_t val, size_t n) {
+    if(n >= 8) {
+        while(uint32_t(d) & 3) { *d++ = val; n--; }
+
+        word_t pattern = val * 0x01010101;
+        word_t* dw = (word_t*)d;
+        for(size_t i = n >> 4; i; i--, dw += 4) {
+            dw[0] = pattern; dw[1] = pattern; dw[2] = pattern; dw[3] = pattern;
+        }
+        for(size_t i = (n >> 2) & 3; i; i--) *dw++ = pattern;
 
+        d = (uint8_t*)dw;
+        n &= 3;
+    }
+    fill_bytes(d, val, n);
 }
 
-// Memcpy copies a n sized source to a destination
-void* memcpy(void* dest, const void* src, size_t n) {
+static inline void rep_movsd(void* d, const void* s, size_t words) {
+    asm volatile("rep movsl" : "+D"(d), "+S"(s), "+c"(words) :: "memory");
+}
+
+static inline void rep_stosd(void* d, const uint32_t pattern, size_t words) {
+    asm volatile("rep stosl" : "+D"(d), "+c"(words) : "a"(pattern) : "memory");
+}
+
+static inline void rep_movsb(void* d, const void* s, size_t n) {
+    asm volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) :: "memory");
+}
+
+static inline void rep_stosb(void* d, const uint8_t val, size_t n) {
+    asm volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(val) : "memory");
+}
+
+// Moves 64 byte blocks, the destination has to be 16 byte aligned
+static SSE2_FUNC NO_LIBCALLS void copy_sse2(uint8_t* d, const uint8_t* s, size_t blocks) {
+    for(; blocks; blocks--, d += 64, s += 64) {
+        v4si a = *(const v4si_u*)s, b = *(const v4si_u*)(s + 16), c = *(const v4si_u*)(s + 32), e = *(const v4si_u*)(s + 48);
+        *(v4si*)d = a; *(v4si*)(d + 16) = b; *(v4si*)(d + 32) = c; *(v4si*)(d + 48) = e;
+    }
+}
+
+static SSE2_FUNC NO_LIBCALLS void fill_sse2(uint8_t* d, const uint32_t pattern, size_t blocks) {
+    v4si p = {pattern, pattern, pattern, pattern};
+    for(; blocks; blocks--, d += 64) {
+        *(v4si*)d = p; *(v4si*)(d + 16) = p; *(v4si*)(d + 32) = p; *(v4si*)(d + 48) = p;
+    }
+}
+
+// Whole, page aligned pages are the most common big copies (frames, page tables, buffers), they skip every check
+static inline bool is_page(const void* d, const void* s, const size_t n) {
+    return n == PAGE_SIZE && !((uint32_t(d) | uint32_t(s)) & (PAGE_SIZE - 1));
+}
+
+// memcpy with a given variant
+NO_LIBCALLS void mem::copy(const Variant v, void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
-    for (size_t i = 0; i < n; i++) {
-        d[i] = s[i];
+
+    if(v == BYTES) return copy_bytes(d, s, n);
+    if(is_page(d, s, n)) return rep_movsd(d, s, PAGE_SIZE / 4);
+    if(v == WORDS || n < MEM_STRING_MIN) return copy_words(d, s, n);
+
+    if(v == ERMS) return rep_movsb(d, s, n);
+    // Aligning the destination to 16 bytes, the rest after the last block goes through rep movsd
+    if(v == SSE2 && n >= MEM_SSE2_MIN && fpu::begin()) {
+        size_t head = -uint32_t(d) & 15;
+        copy_words(d, s, head);
+        copy_sse2(d + head, s + head, (n - head) >> 6);
+        fpu::end();
+        size_t done = head + ((n - head) & ~63);
+        d += done;
+        s += done;
+        n -= done;
+    }
+    // Aligning the destination, rep movsd is slow when it's not
+    size_t head = -uint32_t(d) & 3;
+    copy_bytes(d, s, head);
+    rep_movsd(d + head, s + head, (n - head) >> 2);
+    copy_bytes(d + n - ((n - head) & 3), s + n - ((n - head) & 3), (n - head) & 3);
+}
+
+// memset with a given variant
+NO_LIBCALLS void mem::fill(const Variant v, void* dest, const uint8_t val, size_t n) {
+    uint8_t* d = (uint8_t*)dest;
+
+    if(v == BYTES) return fill_bytes(d, val, n);
+    if(is_page(d, d, n)) return rep_stosd(d, val * 0x01010101, PAGE_SIZE / 4);
+    if(v == WORDS || n < MEM_STRING_MIN) return fill_words(d, val, n);
+
+    if(v == ERMS) return rep_stosb(d, val, n);
+    if(v == SSE2 && n >= MEM_SSE2_MIN && fpu::begin()) {
+        size_t head = -uint32_t(d) & 15;
+        fill_words(d, val, head);
+        fill_sse2(d + head, val * 0x01010101, (n - head) >> 6);
+        fpu::end();
+        size_t done = head + ((n - head) & ~63);
+        d += done;
+        n -= done;
     }
+    size_t head = -uint32_t(d) & 3;
+    fill_bytes(d, val, head);
+    rep_stosd(d + head, val * 0x01010101, (n - head) >> 2);
+    fill_bytes(d + n - ((n - head) & 3), val, (n - head) & 3);
+}
+
+/* CPUs before the P6 run rep movsd slower than a word loop, newer ones move whole cache lines with it,
+ * and with ERMS rep movsb is as fast as SSE2 and needs no alignment fixups or FPU section */
+void mem::select_variant(void) {
+    if(cpu::has_extended_feature(CPUID_FEAT_EXT_EBX_ERMS)) variant = ERMS;
+    else if(fpu::sse2) variant = SSE2;
+    else if(cpu::get_family() >= 6) variant = STRING;
+    else variant = WORDS;
+}
+
+// Memset sets a block of memory to a specific value for a given number of bytes
+void memset(const void *dest, const char val, uint32_t count){
+    mem::fill(mem::variant, (void*)dest, val, count);
+}
+
+// Memcpy copies a n sized source to a destination
+void* memcpy(void* dest, const void* src, size_t n) {
+    mem::copy(mem::variant, dest, src, n);
     return dest;
 }
 
+// Compares words until they differ, the differing word is compared bytewise
 uint32_t memcmp(const void *s1, const void *s2, const size_t n) {
     const unsigned char *p1 = (const unsigned char *)s1;
     const unsigned char *p2 = (const unsigned char *)s2;
 
-    for (size_t i = 0; i < n; i++) {
+    size_t i = 0;
+    for (; i + 4 <= n && *(const word_t*)&p1[i] == *(const word_t*)&p2[i]; i += 4);
+    for (; i < n; i++) {
         if (p1[i] != p2[i]) {
             return (int)p1[i] - (int)p2[i];
         }
@@ -84,6 +238,8 @@ uint32_t memcmp(const void *s1, const void *s2, const size_t n) {
     return 0;
 }
 
+#pragma endregion
+
 // Alligns the size to the allignment
 size_t align_up(const size_t size, const size_t alignment) {
     return (size + alignment - 1) & ~(alignment - 1);
@@ -0,0 +1,146 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// dma.cpp
+// Physically contiguous buffers for devices, small ones are packed into shared pages
+// ========================================
+
+#include <mm/dma.hpp>
+#include <mm/heap.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
+#include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
+#include <sched/spinlock.hpp>
+
+static DmaPage* pool = nullptr;
+static Spinlock pool_lock; // Guards the pool list and every page's units, drivers allocate from every CPU
+
+#pragma region Helpers
+
+static inline bool unit_used(const DmaPage* page, const uint32_t unit) {
+    return page->used[unit / 32] & (1 << (unit % 32));
+}
+
+static void mark_units(DmaPage* page, const uint32_t first, const uint32_t count, const bool used) {
+    for(uint32_t unit = first; unit < first + count; unit++) {
+        if(used) page->used[unit / 32] |= (1 << (unit % 32));
+        else page->used[unit / 32] &= ~(1 << (unit % 32));
+    }
+    if(used) page->used_units += count;
+    else page->used_units -= count;
+}
+
+// Finds <count> free units starting at a multiple of <step> in a page, returns DMA_UNITS if there's no room
+static uint32_t find_units(const DmaPage* page, const uint32_t count, const uint32_t step) {
+    if(DMA_UNITS - page->used_units < count) return DMA_UNITS;
+
+    for(uint32_t first = 0; first + count <= DMA_UNITS; first += step) {
+        uint32_t unit = first;
+        while(unit < first + count && !unit_used(page, unit)) unit++;
+        if(unit == first + count) return first;
+    }
+    return DMA_UNITS;
+}
+
+// Allocates a fresh page, the caller links it into the pool under pool_lock
+static DmaPage* new_page(void) {
+    DmaPage* page = (DmaPage*)kcalloc(1, sizeof(DmaPage));
+    if(!page) return nullptr;
+
+    page->virt = (uint32_t)pmm::alloc_frame(1, true, false);
+    if(!page->virt) {
+        kfree(page);
+        return nullptr;
+    }
+    return page;
+}
+
+#pragma endregion
+
+// Allocates zeroed, physically contiguous memory aligned to <align>
+DmaBuffer dma::alloc(const size_t size, const size_t align) {
+    DmaBuffer buffer = {nullptr, 0, 0};
+    if(size == 0 || (align & (align - 1))) return buffer;
+
+    if(size > DMA_POOL_MAX || align > FRAME_SIZE) {
+        /* Buddy blocks are aligned to their own size, so asking for at least
+         * align / FRAME_SIZE frames gives us the alignment */
+        uint32_t frames = (size + FRAME_SIZE - 1) / FRAME_SIZE;
+        if(align > FRAME_SIZE && frames < align / FRAME_SIZE) frames = align / FRAME_SIZE;
+
+        buffer.virt = pmm::alloc_frame(frames);
+        if(!buffer.virt) return buffer;
+        buffer.size = frames * FRAME_SIZE;
+    }
+    else {
+        uint32_t count = (size + DMA_UNIT - 1) / DMA_UNIT;
+        uint32_t step = (align > DMA_UNIT) ? align / DMA_UNIT : 1;
+
+        uint32_t flags = pool_lock.lock_irqsave();
+        DmaPage* page = pool;
+        uint32_t first = DMA_UNITS;
+        for(; page; page = page->next) {
+            first = find_units(page, count, step);
+            if(first != DMA_UNITS) break;
+        }
+        if(!page) {
+            // The heap and the PMM take their own locks, so the page is allocated without ours
+            pool_lock.unlock_irqrestore(flags);
+            page = new_page();
+            if(!page) return buffer;
+            flags = pool_lock.lock_irqsave();
+            page->next = pool;
+            pool = page;
+            first = 0;
+        }
+
+        mark_units(page, first, count, true);
+        pool_lock.unlock_irqrestore(flags);
+        buffer.virt = (void*)(page->virt + first * DMA_UNIT);
+        buffer.size = count * DMA_UNIT;
+        memset(buffer.virt, 0, buffer.size);
+    }
+
+    buffer.phys = (uint32_t)vmm::virtual_to_physical((uint32_t)buffer.virt);
+    return buffer;
+}
+
+// Frees a buffer returned by alloc
+void dma::free(const DmaBuffer& buffer) {
+    if(!buffer.virt) return;
+
+    if(buffer.size > DMA_POOL_MAX) {
+        pmm::free_frame(buffer.virt);
+        return;
+    }
+
+    uint32_t page_addr = (uint32_t)buffer.virt & ~(FRAME_SIZE - 1);
+    uint32_t flags = pool_lock.lock_irqsave();
+    DmaPage* prev = nullptr;
+    DmaPage* page = pool;
+    while(page && page->virt != page_addr) {
+        prev = page;
+        page = page->next;
+    }
+    if(!page) {
+        pool_lock.unlock_irqrestore(flags);
+        return;
+    }
+
+    mark_units(page, ((uint32_t)buffer.virt - page_addr) / DMA_UNIT, buffer.size / DMA_UNIT, false);
+
+    // Giving empty pages back, except for the last one in the pool
+    bool release = page->used_units == 0 && (prev || page->next);
+    if(release) {
+        if(prev) prev->next = page->next;
+        else pool = page->next;
+    }
+    pool_lock.unlock_irqrestore(flags);
+
+    if(release) {
+        pmm::free_frame((void*)page->virt);
+        kfree(page);
+    }
+}
@@ -15,6 +15,8 @@ global set_pd
 global enable_paging
 global reload_cr3
 global invlpg
+global flush_tlb
+global switch_paging
 
 ; Sets the Page Directory in CR3
 set_pd:
@@ -28,10 +30,9 @@ set_pd:
 enable_paging:
     cli
 
-    ; Enabling PSE
+    ; Enabling the CR4 features (PSE, ...) passed in by the VMM
     mov eax, cr4
-    xor eax, eax
-    or eax, 0x10
+    or eax, [esp + 4]
     mov cr4, eax
 
     ; Enabling paging
@@ -41,17 +42,57 @@ enable_paging:
     sti
     ret
 
-; Invalidate TLB by reloading CR3
+; Invalidate TLB by reloading CR3, keeps the interrupt flag as it is
 reload_cr3:
     ; Reloading CR3
-    cli
     mov eax, cr3
     mov cr3, eax
-    sti
     ret
 
 ; Invalidates a single virtual address
 invlpg:
     mov eax, [esp + 4]
     invlpg [eax]
+    ret
+
+; Invalidates the whole TLB including global pages, reloading CR3 keeps those
+flush_tlb:
+    mov eax, cr4
+    test eax, 0x80 ; CR4.PGE
+    jz .reload
+    ; Toggling PGE flushes every entry
+    mov edx, eax
+    and edx, ~0x80
+    mov cr4, edx
+    mov cr4, eax
+    ret
+.reload:
+    mov eax, cr3
+    mov cr3, eax
+    ret
+
+; Runs identity mapped, since paging is turned off for a moment
+section .boot progbits alloc exec nowrite align=16
+
+; Loads new paging structures that need other CR4 bits (32-bit to PAE paging), keeps the interrupt flag as it is
+switch_paging:
+    mov ecx, [esp + 4] ; CR3
+    mov edx, [esp + 8] ; CR4 flags
+    pushf
+    cli
+
+    ; Paging has to be off while CR4.PAE changes
+    mov eax, cr0
+    and eax, ~(1 << 31)
+    mov cr0, eax
+
+    mov eax, cr4
+    or eax, edx
+    mov cr4, eax
+    mov cr3, ecx
+
+    mov eax, cr0
+    or eax, 1 << 31
+    mov cr0, eax
+    popf
     ret
\ No newline at end of file
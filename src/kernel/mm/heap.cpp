@@ -7,6 +7,11 @@
 // ========================================
 
 #include <mm/heap.hpp>
+#include <mm/slab.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
+#include <mm/memtrace.hpp>
+#include <sched/spinlock.hpp>
 #include <graphics/vga_print.hpp>
 #include <drivers/vga.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
@@ -16,100 +21,390 @@
 
 // Start of the heap
 HeapBlock* heap::heap_head = nullptr;
+size_t heap::extension_size = 0;
+HeapStats heap::stats;
+
+// Segregated free lists and a bitmap of the non-empty ones
+static HeapBlock* bins[HEAP_BIN_COUNT];
+static uint32_t bin_map = 0;
+static Spinlock heap_lock; // Guards the bins, the slabs and the extension, allocations happen on every CPU
+
+#pragma region Block Helpers
+
+// Returns the bin a block of a given size belongs to
+static inline uint32_t bin_index(const size_t size) {
+    uint32_t index = (31 - __builtin_clz(size)) - 4;
+    return index < HEAP_BIN_COUNT ? index : HEAP_BIN_COUNT - 1;
+}
+
+// Writes the footer of a free block
+static inline void set_footer(HeapBlock* block) {
+    *(size_t*)((char*)block + heap::block_size(block) - sizeof(size_t)) = heap::block_size(block);
+}
+
+// Adds a free block to the front of its bin
+static void bin_insert(HeapBlock* block) {
+    uint32_t index = bin_index(heap::block_size(block));
+    block->prev_free = nullptr;
+    block->next_free = bins[index];
+    if(bins[index]) bins[index]->prev_free = block;
+    bins[index] = block;
+    bin_map |= (1 << index);
+
+    heap::stats.free_blocks[index]++;
+    heap::stats.free_bytes += heap::block_size(block);
+}
+
+// Removes a free block from its bin
+static void bin_remove(HeapBlock* block) {
+    uint32_t index = bin_index(heap::block_size(block));
+    if(block->prev_free) block->prev_free->next_free = block->next_free;
+    else bins[index] = block->next_free;
+    if(block->next_free) block->next_free->prev_free = block->prev_free;
+    if(!bins[index]) bin_map &= ~(1 << index);
+
+    heap::stats.free_blocks[index]--;
+    heap::stats.free_bytes -= heap::block_size(block);
+}
+
+// Finds a free block of at least <size> bytes
+static HeapBlock* find_fit(const size_t size) {
+    uint32_t index = bin_index(size);
+
+    // Blocks in the bin the size falls into can still be too small
+    for(HeapBlock* block = bins[index]; block; block = block->next_free)
+        if(heap::block_size(block) >= size) return block;
+
+    // Every block in a higher bin is big enough, so we just take the first one
+    uint32_t higher_bins = (index + 1 < HEAP_BIN_COUNT) ? bin_map & ~((2u << index) - 1) : 0;
+    if(!higher_bins) return nullptr;
+    return bins[__builtin_ctz(higher_bins)];
+}
+
+/* Frees a block and merges it with its free physical neighbours. The block has to be marked
+ * as allocated and the flags of its header have to be valid. Returns the merged block */
+static HeapBlock* release_block(HeapBlock* block) {
+    size_t size = heap::block_size(block);
+
+    // Merging with the physically next block
+    HeapBlock* next = (HeapBlock*)((char*)block + size);
+    if(heap::is_free(next)) {
+        bin_remove(next);
+        size += heap::block_size(next);
+    }
+
+    // Merging with the physically previous block, its footer sits right before our header
+    if(block->size & HEAP_PREV_FREE) {
+        size_t prev_size = *(size_t*)((char*)block - sizeof(size_t));
+        HeapBlock* prev = (HeapBlock*)((char*)block - prev_size);
+        bin_remove(prev);
+        size += prev_size;
+        block = prev;
+    }
+
+    block->size = size | HEAP_BLOCK_FREE;
+    block->requested = 0;
+    set_footer(block);
+    bin_insert(block);
+
+    // Letting the next block know that it can merge with us
+    next = (HeapBlock*)((char*)block + size);
+    next->size |= HEAP_PREV_FREE;
+    return block;
+}
+
+#pragma endregion
+
+#pragma region Extension
+
+// Gives the frames behind [start, end) of the extension range back to the PMM
+static void unmap_extension(const uint32_t start, const uint32_t end) {
+    vmm::begin_tlb_batch();
+    for(uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+        void* frame = vmm::virtual_to_physical(addr);
+        vmm::free_page(addr);
+        pmm::free_frame(frame);
+    }
+    vmm::end_tlb_batch();
+}
+
+// Maps fresh frames after the end of the extension, returns false if we ran out of frames
+static bool map_extension(const size_t bytes) {
+    uint32_t end = HEAP_EXT_START + heap::extension_size;
+    vmm::begin_tlb_batch();
+    for(size_t offset = 0; offset < bytes; offset += PAGE_SIZE) {
+        // The frames are only used through the extension range
+        uint32_t frame = (uint32_t)pmm::alloc_frame(1, false, false);
+        if(!frame) {
+            vmm::end_tlb_batch();
+            unmap_extension(end, end + offset);
+            return false;
+        }
+        vmm::alloc_page(end + offset, frame, PRESENT | WRITABLE);
+    }
+    vmm::end_tlb_batch();
+    return true;
+}
+
+// Grows the extension so that a block of <size> bytes fits at its end
+static bool grow(const size_t size) {
+    if(!vmm::enabled_paging) return false;
+
+    size_t bytes = align_up(size + HEAP_HEADER_SIZE, HEAP_GROW_MIN);
+    if(bytes > HEAP_EXT_SIZE - heap::extension_size) return false;
+
+    uint32_t old_end = HEAP_EXT_START + heap::extension_size;
+    if(!map_extension(bytes)) return false;
+    heap::extension_size += bytes;
+
+    /* The first growth starts the extension with a single block, later ones turn the old
+     * epilogue into the header of the new block so it merges with a free last block */
+    HeapBlock* block;
+    if(old_end == HEAP_EXT_START) {
+        block = (HeapBlock*)HEAP_EXT_START;
+        block->size = bytes - HEAP_HEADER_SIZE;
+    }
+    else {
+        block = (HeapBlock*)(old_end - HEAP_HEADER_SIZE);
+        block->size = bytes | (block->size & HEAP_PREV_FREE);
+    }
+
+    HeapBlock* epilogue = (HeapBlock*)(old_end + bytes - HEAP_HEADER_SIZE);
+    epilogue->size = 0;
+    epilogue->requested = 0;
+
+    release_block(block);
+    return true;
+}
+
+// Gives the whole free pages of the extensions last block back to the PMM
+static void trim(HeapBlock* block) {
+    uint32_t start = (uint32_t)block;
+    uint32_t end = HEAP_EXT_START + heap::extension_size;
+    // The block keeps room for itself and the epilogue, unless it spans the whole extension
+    uint32_t new_end = (start == HEAP_EXT_START) ? HEAP_EXT_START : align_up(start + HEAP_MIN_BLOCK + HEAP_HEADER_SIZE, PAGE_SIZE);
+    if(end - new_end < HEAP_TRIM_THRESHOLD) return;
+
+    bin_remove(block);
+    if(new_end != HEAP_EXT_START) {
+        // Free blocks are always merged, so the previous block is allocated
+        block->size = (new_end - HEAP_HEADER_SIZE - start) | HEAP_BLOCK_FREE;
+        set_footer(block);
+        bin_insert(block);
+
+        HeapBlock* epilogue = (HeapBlock*)(new_end - HEAP_HEADER_SIZE);
+        epilogue->size = HEAP_PREV_FREE;
+        epilogue->requested = 0;
+    }
+
+    unmap_extension(new_end, end);
+    heap::extension_size = new_end - HEAP_EXT_START;
+}
+
+#pragma endregion
 
 // Heap initialization function
 void heap::init(void) {
     // Clear any junk memory from warm boot
     memset((void*)HEAP_START, 0, HEAP_SIZE);
+    memset(bins, 0, sizeof(bins));
+    memset(&stats, 0, sizeof(HeapStats));
+    bin_map = 0;
     // Gets the start of the heap
     heap_head = (HeapBlock*)HEAP_START;
 
-    // Setting properties for the heap_head
-    /* Setting the size fo the heap_head to be the maximum value,
-     * but aswell subtacting the meta data size of HeapBlock */
-    heap_head->size = HEAP_SIZE - sizeof(HeapBlock);
-    heap_head->free = true;
-    heap_head->next = nullptr;
+    /* The whole heap starts as a single free block, followed by a zero sized allocated
+     * epilogue header so the last block never tries to merge past the end of the heap */
+    heap_head->size = (HEAP_SIZE - HEAP_HEADER_SIZE) | HEAP_BLOCK_FREE;
+    heap_head->requested = 0;
+    set_footer(heap_head);
+    bin_insert(heap_head);
 
-    if(!heap_head || !heap_head->free) {
+    HeapBlock* epilogue = (HeapBlock*)(HEAP_START + HEAP_SIZE - HEAP_HEADER_SIZE);
+    epilogue->size = HEAP_PREV_FREE;
+    epilogue->requested = 0;
+
+    if(!heap_head || !heap::is_free(heap_head)) {
         kprintf(LOG_ERROR, "Failed to initialize kernel heap memory manager!\n");
         kernel_panic("Fatal component failed to initialize!");
     }
     else kprintf(LOG_INFO, "Implemented kernel heap memory manager\n");
 }
 
+// Gives an allocation back to its slab or the block list, the heap lock has to be held
+static void free_locked(void* ptr, const void* caller) {
+    // Objects that belong to a slab never reach the block list
+    if(slab::free(ptr)) {
+        heap::stats.frees++;
+        memtrace::trace(TRACE_KFREE, caller, ptr, 0);
+        return;
+    }
+    if(!heap::owns(ptr)) return;
+    if(uint32_t(ptr) & (HEAP_ALIGN - 1)) return;
+
+    // Getting the block based of of the given address/pointer
+    HeapBlock* block = (HeapBlock*)((char*)ptr - HEAP_HEADER_SIZE);
+    if(heap::is_free(block)) return;
+
+    heap::stats.frees++;
+    heap::stats.block_bytes -= heap::block_size(block);
+    memtrace::trace(TRACE_KFREE, caller, ptr, 0);
+    block = release_block(block);
+
+    // Shrinking the extension when its last block is free
+    if(uint32_t(block) >= HEAP_EXT_START && !heap::next_block(block)) trim(block);
+}
+
+/* Takes a block for <size> bytes whose payload is aligned to <align> out of the bins,
+ * growing the heap if needed. Returns the payload or nullptr */
+static void* alloc_block(const size_t size, const size_t align) {
+    if(size > HEAP_EXT_SIZE) return nullptr;
+
+    // Size of the whole block, big enough to hold the free list links and footer once it's freed
+    size_t block_size = align_up(size + HEAP_HEADER_SIZE, HEAP_ALIGN);
+    if(block_size < HEAP_MIN_BLOCK) block_size = HEAP_MIN_BLOCK;
+    // Aligned requests need room to move the payload forward and leave a free block in front of it
+    size_t search_size = (align > HEAP_ALIGN) ? block_size + align + HEAP_MIN_BLOCK : block_size;
+
+    HeapBlock* block = find_fit(search_size);
+    // Growing the heap once the free blocks can't hold the request
+    if(!block && grow(search_size)) block = find_fit(search_size);
+    if(!block) return nullptr;
+    bin_remove(block);
+
+    // Free blocks are always merged, so the previous block of a free block is allocated
+    size_t prev_free = 0;
+    if(align > HEAP_ALIGN) {
+        uint32_t start = (uint32_t)block;
+        uint32_t payload = align_up(start + HEAP_HEADER_SIZE, align);
+        // The gap in front of the payload has to be able to hold a free block
+        if(payload != start + HEAP_HEADER_SIZE && payload - HEAP_HEADER_SIZE - start < HEAP_MIN_BLOCK)
+            payload = align_up(start + HEAP_HEADER_SIZE + HEAP_MIN_BLOCK, align);
+
+        size_t lead = payload - HEAP_HEADER_SIZE - start;
+        if(lead) {
+            HeapBlock* aligned = (HeapBlock*)(payload - HEAP_HEADER_SIZE);
+            aligned->size = heap::block_size(block) - lead;
+
+            block->size = lead | HEAP_BLOCK_FREE;
+            block->requested = 0;
+            set_footer(block);
+            bin_insert(block);
+
+            block = aligned;
+            prev_free = HEAP_PREV_FREE;
+        }
+    }
+
+    size_t remaining = heap::block_size(block) - block_size;
+    // Split the block if the rest can hold a free block of its own
+    if(remaining >= HEAP_MIN_BLOCK) {
+        HeapBlock* rest = (HeapBlock*)((char*)block + block_size);
+        // The rests physical next block already knows that its previous block is free
+        rest->size = remaining | HEAP_BLOCK_FREE;
+        rest->requested = 0;
+        set_footer(rest);
+        bin_insert(rest);
+    }
+    else {
+        block_size = heap::block_size(block);
+        // The next block is losing its free neighbour
+        HeapBlock* next = (HeapBlock*)((char*)block + block_size);
+        next->size &= ~HEAP_PREV_FREE;
+    }
+
+    block->size = block_size | prev_free;
+    block->requested = size;
+
+    heap::stats.block_bytes += block_size;
+    if(heap::stats.block_bytes > heap::stats.peak_block_bytes) heap::stats.peak_block_bytes = heap::stats.block_bytes;
+
+    // Returning the blocks address plus the metadata size
+    return (char*)block + HEAP_HEADER_SIZE;
+}
+
 // Heap memory allocating / deallocating functions
 void* kmalloc(const size_t size) {
     if(size <= 0) return nullptr;
+    uint32_t flags = heap_lock.lock_irqsave();
 
-    HeapBlock* current = heap::heap_head; // Setting the current block as the head
-
-    // Find a free block with enough space
-    while(current) {
-        // If the current block is free and has enough space then we can use it
-        if(current->free && current->size >= size) {
-            // Split the block if theres extra space
-            if(current->size > size + sizeof(HeapBlock)) {
-                // Setting new block and adding the sizeof the Block to keep metadata in mind
-                HeapBlock* new_block = (HeapBlock*)((char*)current + sizeof(HeapBlock) + size);
-                // Trimming the extra space of
-                new_block->size = current->size - size - sizeof(HeapBlock);
-                new_block->free = true;
-                /* Setting the current blocks next block as the trimmed (new)
-                 * blocks next, because the new block is the end of the current block */
-                new_block->next = current->next;
-                // Making the current blocks next block the new block
-                current->next = new_block;
-            }
-
-            current->size = size; // Setting the passed size
-            current->free = false; // Mark as allocated
-
-            // kprintf(RGB_COLOR_GREEN, " %u", size);
-            // Returning the current blocks address plus the metadata size needed
-            return (char*)current + sizeof(HeapBlock);
+    // Small requests are served by the slab size classes
+    if(size <= SLAB_MAX_SIZE) {
+        void* obj = slab::alloc(size);
+        if(obj) {
+            heap::stats.allocs++;
+            memtrace::trace(TRACE_KMALLOC, __builtin_return_address(0), obj, size);
+            heap_lock.unlock_irqrestore(flags);
+            return obj;
         }
-        // Moving to the next block
-        current = current->next;
     }
 
-    kprintf(LOG_ERROR, "Not enough heap memory for %u bytes!\n", size);
-    return nullptr;
+    void* ptr = alloc_block(size, HEAP_ALIGN);
+    if(ptr) {
+        heap::stats.allocs++;
+        memtrace::trace(TRACE_KMALLOC, __builtin_return_address(0), ptr, size);
+    }
+    else heap::stats.failed++;
+    heap_lock.unlock_irqrestore(flags);
+
+    if(!ptr) kprintf(LOG_ERROR, "Not enough heap memory for %u bytes!\n", size);
+    return ptr;
+}
+
+// Allocates a block whose address is a multiple of <align> (a power of two)
+void* kmalloc_aligned(const size_t size, const size_t align) {
+    if(size <= 0 || (align & (align - 1))) return nullptr;
+    if(align <= HEAP_ALIGN) return kmalloc(size);
+
+    uint32_t flags = heap_lock.lock_irqsave();
+    void* ptr = alloc_block(size, align);
+    if(ptr) {
+        heap::stats.allocs++;
+        memtrace::trace(TRACE_KMALLOC, __builtin_return_address(0), ptr, size);
+    }
+    else heap::stats.failed++;
+    heap_lock.unlock_irqrestore(flags);
+
+    if(!ptr) kprintf(LOG_ERROR, "Not enough heap memory for %u bytes aligned to %u!\n", size, align);
+    return ptr;
 }
 
 void kfree(void* ptr) {
     if(!ptr) return;
-    if(uint32_t(ptr) < HEAP_START || uint32_t(ptr) > HEAP_START + HEAP_SIZE) return;
+    uint32_t flags = heap_lock.lock_irqsave();
+    free_locked(ptr, __builtin_return_address(0));
+    heap_lock.unlock_irqrestore(flags);
+}
 
-    // Getting the block based of of the given address/pointer
-    HeapBlock* block = (HeapBlock*)((char*)ptr - sizeof(HeapBlock));
-    if(block->free) return;
-    // kprintf(RGB_COLOR_BLUE, " %u", block->size);
-    
-    block->free = true; // Setting as free
-
-    // Merging adjacent free blocks to decrease fragmentation
-    HeapBlock* current = heap::heap_head; // Setting the current blockto the head
-    while(current) {
-        // If the current block and the next block are free
-        if(current->free && current->next && current->next->free) {
-            // Adding the block sizes together
-            current->size += current->next->size + sizeof(HeapBlock);
-            /* The current blocks next block will be the next blocks next block, 
-             * because the next block doesn't exist anymore */
-            current->next = current->next->next;
-
-            // Freeing the memory of the deleted node
-            kfree(current->next);
-        }
-        // Going to the next block
-        current = current->next;
-    }
+// Walks the highest non-empty bin, heap_lock has to be held so no block is taken off it meanwhile
+static size_t largest_free_locked(void) {
+    if(!bin_map) return 0;
+
+    // Only the highest non-empty bin can hold the largest block
+    size_t largest = 0;
+    for(HeapBlock* block = bins[31 - __builtin_clz(bin_map)]; block; block = block->next_free)
+        if(heap::block_size(block) > largest) largest = heap::block_size(block);
+    return largest;
+}
+
+// Returns the size of the largest free block
+size_t heap::largest_free_block(void) {
+    uint32_t flags = heap_lock.lock_irqsave();
+    size_t largest = largest_free_locked();
+    heap_lock.unlock_irqrestore(flags);
+    return largest;
+}
+
+// Returns the external fragmentation in percent (1 - largest free block / free bytes)
+uint32_t heap::fragmentation(void) {
+    // Both read under one lock, so they describe the same moment
+    uint32_t flags = heap_lock.lock_irqsave();
+    size_t largest = largest_free_locked();
+    size_t free_bytes = stats.free_bytes;
+    heap_lock.unlock_irqrestore(flags);
 
-    /* Setting the ptr to null because it doesn't point to a 
-     * valid address anymore and deleting data of of the ptr */
-    *(uint32_t*)ptr = 0; 
-    ptr = nullptr;
+    if(!free_bytes) return 0;
+    return 100 - udiv64(uint64_t(largest) * 100, free_bytes);
 }
 
 // Allocates space for an array
@@ -0,0 +1,103 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// memtrace.cpp
+// Records allocator calls into a ring buffer to find out who holds memory
+// ========================================
+
+#include <mm/memtrace.hpp>
+#include <mm/pmm.hpp>
+#include <drivers/pit.hpp>
+#include <sched/spinlock.hpp>
+#include <lib/mem_util.hpp>
+
+static_assert((MEMTRACE_RECORDS & (MEMTRACE_RECORDS - 1)) == 0, "MEMTRACE_RECORDS must be a power of two");
+
+bool memtrace::enabled = false;
+TraceRecord memtrace::records[MEMTRACE_RECORDS];
+uint64_t memtrace::total = 0;
+static Spinlock records_lock;
+
+// Writes a record into the ring buffer
+void memtrace::record(const TraceEvent event, const void* caller, const void* ptr, const uint32_t size) {
+    // Allocators may be called from interrupt handlers and other CPUs, so the slot is claimed under a lock with interrupts off
+    uint32_t flags = records_lock.lock_irqsave();
+
+    TraceRecord* rec = &records[uint32_t(total) & (MEMTRACE_RECORDS - 1)];
+    rec->tick = ticks;
+    rec->caller = uint32_t(caller);
+    rec->ptr = uint32_t(ptr);
+    rec->size = size;
+    rec->event = event;
+    total++;
+
+    records_lock.unlock_irqrestore(flags);
+}
+
+// Empties the ring buffer
+void memtrace::clear(void) {
+    total = 0;
+}
+
+static inline bool is_alloc(const TraceEvent event) {
+    return event == TRACE_KMALLOC || event == TRACE_FRAME_ALLOC;
+}
+
+// Returns the free event that matches an allocation event
+static inline TraceEvent free_of(const TraceEvent event) {
+    return event == TRACE_KMALLOC ? TRACE_KFREE : TRACE_FRAME_FREE;
+}
+
+// Fills <sites> with call sites sorted by live bytes, returns the amount of sites
+uint32_t memtrace::get_sites(TraceSite* sites, const uint32_t max) {
+    // Pausing tracing so the records don't move while we walk them
+    bool was_enabled = enabled;
+    enabled = false;
+
+    uint32_t count = total < MEMTRACE_RECORDS ? uint32_t(total) : MEMTRACE_RECORDS;
+    uint32_t oldest = uint32_t(total - count) & (MEMTRACE_RECORDS - 1);
+    uint32_t site_count = 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        TraceRecord* rec = &records[(oldest + i) & (MEMTRACE_RECORDS - 1)];
+        if(!is_alloc(rec->event)) continue;
+
+        // An allocation is live if no later free of the same kind released its pointer
+        bool live = true;
+        TraceEvent free_event = free_of(rec->event);
+        for(uint32_t j = i + 1; j < count && live; j++) {
+            TraceRecord* later = &records[(oldest + j) & (MEMTRACE_RECORDS - 1)];
+            if(later->event == free_event && later->ptr == rec->ptr) live = false;
+        }
+
+        // Finding or adding the call site
+        bool frames = rec->event == TRACE_FRAME_ALLOC;
+        TraceSite* site = nullptr;
+        for(uint32_t s = 0; s < site_count; s++)
+            if(sites[s].caller == rec->caller && sites[s].frames == frames) { site = &sites[s]; break; }
+        if(!site) {
+            if(site_count == max) continue;
+            site = &sites[site_count++];
+            memset(site, 0, sizeof(TraceSite));
+            site->caller = rec->caller;
+            site->frames = frames;
+        }
+
+        site->allocs++;
+        if(live) {
+            site->live_allocs++;
+            site->live_bytes += frames ? uint64_t(rec->size) * FRAME_SIZE : rec->size;
+        }
+    }
+    enabled = was_enabled;
+
+    // Biggest holders first
+    for(uint32_t i = 1; i < site_count; i++) {
+        TraceSite site = sites[i];
+        uint32_t j = i;
+        for(; j > 0 && sites[j - 1].live_bytes < site.live_bytes; j--) sites[j] = sites[j - 1];
+        sites[j] = site;
+    }
+    return site_count;
+}
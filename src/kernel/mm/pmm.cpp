@@ -9,6 +9,8 @@
 #include <mm/pmm.hpp>
 #include <mm/heap.hpp>
 #include <mm/vmm.hpp>
+#include <mm/memtrace.hpp>
+#include <sched/spinlock.hpp>
 #include <multiboot.hpp>
 #include <graphics/vga_print.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
@@ -29,6 +31,9 @@ uint64_t pmm::total_usable_ram = 0;
 uint64_t pmm::total_used_ram = 0;
 uint64_t pmm::hardware_reserved_ram = 0;
 uint64_t pmm::total_installed_ram = 0;
+uint64_t pmm::alloc_count = 0;
+uint64_t pmm::free_count = 0;
+uint64_t pmm::peak_used_ram = 0;
 
 // Multiboot info will be saved here
 void* mb2_info = nullptr;
@@ -36,9 +41,15 @@ void* mb2_info = nullptr;
 uint64_t LOW_DATA_START_ADDR = 0;
 uint64_t metadata_reserved = 0; // Space reserved by frame metadata
 
-// We will have two different heads for two allocatable regions 
-MetadataNode* pmm::low_alloc_mem_head = nullptr; // Lower allocatable RAM: usually 0x100000 - 0xBFFDFFFF
-MetadataNode* pmm::high_alloc_mem_head = (MetadataNode*)(METADATA_ADDR + sizeof(MetadataNode)); // High allocatable RAM: usually 4 GiB and onwards
+// Buddy zones, one per usable mmap region
+BuddyZone pmm::zones[PMM_MAX_ZONES];
+uint32_t pmm::zone_count = 0;
+
+uint32_t pmm::get_metadata_end() {return uint32_t(LOW_DATA_START_ADDR);}
+
+// End of the RAM that's reached through the kernel's direct map
+uint64_t direct_map_end = 0;
+uint32_t pmm::get_direct_map_end() {return uint32_t(direct_map_end);}
 
 #pragma region Memory Map Manager
 
@@ -94,7 +105,27 @@ void pmm::print_memory_map(void) {
     }
 }
 
-// Gets the total amount of usable RAM in the system and creates head (and other) nodes for memory alloc
+// Creates a buddy zone for [addr, end), zones are either all in the direct map or all above it
+static void add_zone(const uint64_t addr, const uint64_t end) {
+    if(addr >= end || pmm::zone_count >= PMM_MAX_ZONES) return;
+    if(addr < VMM_DIRECT_MAP_SIZE && end > VMM_DIRECT_MAP_SIZE) {
+        add_zone(addr, VMM_DIRECT_MAP_SIZE);
+        add_zone(VMM_DIRECT_MAP_SIZE, end);
+        return;
+    }
+    // Keeping the total RAM amount for stats
+    pmm::total_usable_ram += end - addr;
+
+    BuddyZone* zone = &pmm::zones[pmm::zone_count++];
+    // Aligning the base down to the largest block so every block is aligned to its own size
+    zone->base = addr & ~(uint64_t(FRAME_SIZE << PMM_MAX_ORDER) - 1);
+    zone->start = (addr + FRAME_SIZE - 1) & ~uint64_t(FRAME_SIZE - 1);
+    zone->frame_count = (end - zone->base) / FRAME_SIZE;
+    zone->high = addr >= VMM_DIRECT_MAP_SIZE;
+    if(!zone->high && end > direct_map_end) direct_map_end = end & ~uint64_t(FRAME_SIZE - 1);
+}
+
+// Gets the total amount of usable RAM in the system and creates a buddy zone for every usable region
 void pmm::manage_mmap(void* _mb2_info) {
     // Get the memory map tag
     multiboot_tag_mmap* mmap_tag = Multiboot2::get_mmap(_mb2_info);
@@ -112,38 +143,11 @@ void pmm::manage_mmap(void* _mb2_info) {
 
         // If the mmap entry is available
         if(entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
-            
-            // If the mmap entry is at 4GiB+
-            if(entry->addr >= 0x100000000 && vmm::pae_paging) {
-                // Keeping the total RAM amount for stats
-                pmm::total_usable_ram += entry->len;
-
-                // Manage high allocatable ram
-                high_alloc_mem_head = (MetadataNode*)(METADATA_ADDR + sizeof(MetadataNode)); // The second node of the list
-                high_alloc_mem_head->addr = 0x100000000; // 4GiB (High usable region start)
-                high_alloc_mem_head->size = entry->len;
-                high_alloc_mem_head->free = true; // Noting that this is free
-                high_alloc_mem_head->next = nullptr; // Making this the linked list tail
-                high_alloc_mem_head->prev = low_alloc_mem_head; // Making the low allocatable region the previous
-            }
-            // If the mmap entry address is at the kernels base
-            else if(entry->addr == uint64_t(&__kernel_phys_base)) {
-                // Keeping the total RAM amount for stats
-                pmm::total_usable_ram += entry->len;
-
-                // Creating node for low allocatable ram 
-                low_alloc_mem_head = (MetadataNode*)METADATA_ADDR;
-                low_alloc_mem_head->addr = 0; // We will set this later
-                low_alloc_mem_head->size = entry->addr + entry->len; // We will change this later
-                low_alloc_mem_head->free = true; // Noting that this is free
-                // Making the high usable region the next node only if PAE paging is enabled, because
-                // 32-bit paging only supports 4GiB of physical RAM
-                low_alloc_mem_head->next = vmm::pae_paging ? high_alloc_mem_head : nullptr; 
-                low_alloc_mem_head->prev = nullptr; // Making this the linked list head
-            }
-            // /* There is one available mmap entry that starts at 0x0, but we will not use this because
-            //  * to not conflict with any BIOS info/memory */
-            // else pmm::hardware_reserved_ram += entry->len;
+            /* The available entry that starts at 0x0 isn't used to not conflict with any BIOS info/memory,
+             * 32-bit paging only supports 4GiB of physical RAM so regions above it need PAE paging */
+            uint64_t end = entry->addr + entry->len;
+            if(!vmm::pae_paging && end > 0x100000000) end = 0x100000000;
+            if(entry->addr >= uint64_t(&__kernel_phys_base)) add_zone(entry->addr, end);
         }
         // If the entry is reserved we'll add the size to the total amount of reserved ram
         else pmm::hardware_reserved_ram += entry->len;
@@ -152,171 +156,340 @@ void pmm::manage_mmap(void* _mb2_info) {
         pmm::total_installed_ram += entry->len;
     }
 
-    // Calculating amount of space to reserve for metadata
-    metadata_reserved = vmm::pae_paging ? pmm::total_usable_ram : 0x100000000 / FRAME_SIZE * sizeof(MetadataNode);
+    // Placing every zone's frame metadata one after another starting at METADATA_ADDR
+    uint64_t metadata_addr = METADATA_ADDR;
+    for(uint32_t i = 0; i < zone_count; i++) {
+        zones[i].frames = (FrameNode*)PHYS_TO_VIRT(uint32_t(metadata_addr));
+        metadata_addr += zones[i].frame_count * sizeof(FrameNode);
+    }
+    metadata_reserved = metadata_addr - METADATA_ADDR;
     // Keeping the address in where the actual data will be placed and aligning it to ensure page-alignment
     LOW_DATA_START_ADDR = align_up(METADATA_ADDR + metadata_reserved, PAGE_SIZE);
 }
 
 #pragma endregion
 
+#pragma region Buddy Allocator
+
+// Returns the zone that a physical address belongs to
+static BuddyZone* zone_of(const uint64_t addr) {
+    for(uint32_t i = 0; i < pmm::zone_count; i++) {
+        BuddyZone* zone = &pmm::zones[i];
+        if(addr >= zone->start && addr < zone->base + uint64_t(zone->frame_count) * FRAME_SIZE) return zone;
+    }
+    return nullptr;
+}
+
+// Adds a free block to the front of its order's free list
+static void push_block(BuddyZone* zone, const uint32_t index, const uint8_t order) {
+    FrameNode* node = &zone->frames[index];
+    node->flags = FRAME_FREE;
+    node->order = order;
+    node->prev = PMM_NO_FRAME;
+    node->next = zone->free_lists[order];
+    if(node->next != PMM_NO_FRAME) zone->frames[node->next].prev = index;
+
+    zone->free_lists[order] = index;
+    zone->free_blocks[order]++;
+    zone->free_map |= (1 << order);
+}
+
+// Removes a free block from its order's free list
+static void remove_block(BuddyZone* zone, const uint32_t index) {
+    FrameNode* node = &zone->frames[index];
+    uint8_t order = node->order;
+    if(node->prev != PMM_NO_FRAME) zone->frames[node->prev].next = node->next;
+    else zone->free_lists[order] = node->next;
+    if(node->next != PMM_NO_FRAME) zone->frames[node->next].prev = node->prev;
+    node->flags = 0;
+
+    zone->free_blocks[order]--;
+    if(zone->free_lists[order] == PMM_NO_FRAME) zone->free_map &= ~(1 << order);
+}
+
+// Frees a block, merging it with its buddy for as long as the buddy is free and of the same order
+static void free_block(BuddyZone* zone, uint32_t index, uint8_t order) {
+    while(order < PMM_MAX_ORDER) {
+        uint32_t buddy = index ^ (1 << order);
+        if(buddy >= zone->frame_count) break;
+        FrameNode* node = &zone->frames[buddy];
+        if(!(node->flags & FRAME_FREE) || node->order != order) break;
+
+        remove_block(zone, buddy);
+        if(buddy < index) index = buddy;
+        order++;
+    }
+    push_block(zone, index, order);
+}
+
+// Frees a range of frames as the biggest naturally aligned blocks that fit in it
+static void free_range(BuddyZone* zone, uint32_t index, uint32_t count) {
+    while(count) {
+        uint8_t order = index ? __builtin_ctz(index) : PMM_MAX_ORDER;
+        if(order > PMM_MAX_ORDER) order = PMM_MAX_ORDER;
+        while((1u << order) > count) order--;
+
+        free_block(zone, index, order);
+        index += 1 << order;
+        count -= 1 << order;
+    }
+}
+
+// Takes a block of at least the given order out of a zone, splitting bigger blocks. Returns PMM_NO_FRAME on failure
+static uint32_t take_block(BuddyZone* zone, const uint8_t order) {
+    // Smallest non-empty order that fits
+    uint16_t candidates = zone->free_map & ~((1 << order) - 1);
+    if(!candidates) return PMM_NO_FRAME;
+    uint8_t current = __builtin_ctz(candidates);
+
+    uint32_t index = zone->free_lists[current];
+    remove_block(zone, index);
+    // Giving the upper halves back until the block is of the wanted order
+    while(current > order) {
+        current--;
+        push_block(zone, index + (1 << current), current);
+    }
+    return index;
+}
+
+/* Takes a run of consecutive max order blocks for allocations bigger than the largest order.
+ * This walks the max order free list, but these allocations are rare. Returns PMM_NO_FRAME on failure */
+static uint32_t take_run(BuddyZone* zone, const uint32_t blocks) {
+    for(uint32_t head = zone->free_lists[PMM_MAX_ORDER]; head != PMM_NO_FRAME; head = zone->frames[head].next) {
+        uint32_t found = 1;
+        for(; found < blocks; found++) {
+            uint32_t index = head + (found << PMM_MAX_ORDER);
+            if(index >= zone->frame_count) break;
+            FrameNode* node = &zone->frames[index];
+            if(!(node->flags & FRAME_FREE) || node->order != PMM_MAX_ORDER) break;
+        }
+        if(found < blocks) continue;
+
+        for(uint32_t i = 0; i < blocks; i++) remove_block(zone, head + (i << PMM_MAX_ORDER));
+        return head;
+    }
+    return PMM_NO_FRAME;
+}
+
+#pragma endregion
+
 // Initializes any additional info for the PMM
 void pmm::init(void* _mb2_info) {
     // Saving multiboot2 info globally
     mb2_info = _mb2_info;
     // Calling needed functions
     pmm::manage_mmap(_mb2_info);
-    
-    // Setting up low_alloc_mem_head
-    low_alloc_mem_head->addr = LOW_DATA_START_ADDR;
-    low_alloc_mem_head->size -= LOW_DATA_START_ADDR; /* We previously set this as the mmap entry's address + size, 
-    * now we'll just subtract the actual data starting address to just get the size */
-    if(!low_alloc_mem_head) {
+
+    if(zone_count == 0 || zones[0].high) {
         kprintf(LOG_ERROR, "Failed to initialize physical memory manager! (Low allocable memory not defined)\n");
         kernel_panic("Fatal component failed to initialize!");
     }
-   
-   // Cleaning up any unwanted memory from a warm boot
-   memset((void*)low_alloc_mem_head->addr, 0, low_alloc_mem_head->size);
-   
-   kprintf(LOG_INFO, "Implemented physical memory manager\n");
+
+    for(uint32_t i = 0; i < zone_count; i++) {
+        BuddyZone* zone = &zones[i];
+        // Every frame starts out reserved, only the usable part of the region is freed
+        memset(zone->frames, 0, zone->frame_count * sizeof(FrameNode));
+        memset(zone->free_blocks, 0, sizeof(zone->free_blocks));
+        zone->free_map = 0;
+        for(uint32_t order = 0; order < PMM_ORDER_COUNT; order++) zone->free_lists[order] = PMM_NO_FRAME;
+
+        // Frames below the end of the metadata hold the kernel, heap and metadata
+        uint64_t start = zone->start;
+        if(start < LOW_DATA_START_ADDR) start = LOW_DATA_START_ADDR;
+        uint32_t first = (start - zone->base) / FRAME_SIZE;
+        if(first < zone->frame_count) free_range(zone, first, zone->frame_count - first);
+    }
+
+    kprintf(LOG_INFO, "Implemented physical memory manager\n");
 }
 
 // Alloc and dealloc
 
+// Guards the free lists, frames are taken from every CPU and from interrupt handlers
+static Spinlock frames_lock;
+
+// Locks the free lists with interrupts off, returns the previous EFLAGS
+static inline uint32_t irq_save(void) {
+    return frames_lock.lock_irqsave();
+}
+
+// Unlocks the free lists, interrupts are enabled again if they were before irq_save
+static inline void irq_restore(const uint32_t flags) {
+    frames_lock.unlock_irqrestore(flags);
+}
+
+// Notes an allocation in the counters
+static inline void count_alloc(const uint32_t count) {
+    pmm::total_used_ram += uint64_t(count) * FRAME_SIZE;
+    if(pmm::total_used_ram > pmm::peak_used_ram) pmm::peak_used_ram = pmm::total_used_ram;
+    pmm::alloc_count++;
+}
+
+// Takes frames out of the low or high zones and marks them as allocated. Returns 0 on failure
+static uint64_t take_zone_frames(const uint32_t count, const bool high_zones) {
+    // Smallest order that holds the wanted amount of frames
+    uint8_t order = (count > 1) ? 32 - __builtin_clz(count - 1) : 0;
+
+    for(uint32_t i = 0; i < pmm::zone_count; i++) {
+        BuddyZone* zone = &pmm::zones[i];
+        if(zone->high != high_zones) continue;
+
+        uint32_t index = (order > PMM_MAX_ORDER) ? take_run(zone, (count + (1 << PMM_MAX_ORDER) - 1) >> PMM_MAX_ORDER)
+                                                 : take_block(zone, order);
+        if(index == PMM_NO_FRAME) continue;
+
+        // Marking the head as allocated so free_frame knows the size
+        zone->frames[index].flags = FRAME_USED;
+        zone->frames[index].count = count;
+
+        // Giving frames we don't need back so accounting stays exact
+        uint32_t taken = (order > PMM_MAX_ORDER) ? align_up(count, 1 << PMM_MAX_ORDER) : (1 << order);
+        if(taken > count) free_range(zone, index + count, taken - count);
+
+        return zone->base + uint64_t(index) * FRAME_SIZE;
+    }
+    return 0;
+}
+
+// Takes frames out of the zones, frames above the direct map can't be returned as a pointer so high zones are only used when allowed
+static uint64_t take_frames(const uint32_t count, const bool high = false) {
+    // High zones go first, so low memory is kept for what needs it
+    if(high) {
+        uint64_t frame = take_zone_frames(count, true);
+        if(frame) return frame;
+    }
+    return take_zone_frames(count, false);
+}
+
+#pragma region Zero Pool
+
+// Single frames that were zeroed ahead of time by the idle process
+static uint32_t zero_pool[PMM_ZERO_POOL_SIZE];
+uint32_t pmm::zero_pool_count = 0;
+
+// Zeroes one frame for the pre-zeroed pool, returns false if there's nothing to do
+bool pmm::refill_zero_pool(void) {
+    if(zero_pool_count >= PMM_ZERO_POOL_SIZE) return false;
+
+    uint32_t flags = irq_save();
+    uint32_t frame = take_frames(1);
+    irq_restore(flags);
+    if(!frame) return false;
+
+    // Zeroing with interrupts enabled, the frame isn't reachable by anyone else yet
+    memset((void*)PHYS_TO_VIRT(frame), 0, FRAME_SIZE);
+
+    // Only the idle process fills the pool, so it can't have filled up in the meantime
+    flags = irq_save();
+    zero_pool[zero_pool_count++] = frame;
+    irq_restore(flags);
+    return true;
+}
+
+#pragma endregion
+
 // Allocates a frame in the usable memory regions
-void* pmm::alloc_frame(const uint64_t num_blocks, bool identity_map) {
+void* pmm::alloc_frame(const uint64_t num_blocks, bool mapped, bool zero) {
     // Precausions
-    if(num_blocks <= 0) return nullptr;
-
-    // Aligning to default frame size
-    uint64_t size = num_blocks * FRAME_SIZE;
+    if(num_blocks <= 0 || num_blocks > 0xFFFFFFFF) return nullptr;
+    uint32_t count = num_blocks;
+
+    uint32_t flags = irq_save();
+    // Single zeroed frames come from the pool when possible
+    if(count == 1 && zero && zero_pool_count) {
+        uint32_t frame = zero_pool[--zero_pool_count];
+        count_alloc(1);
+        memtrace::trace(TRACE_FRAME_ALLOC, __builtin_return_address(0), (void*)frame, 1);
+        irq_restore(flags);
+        return (void*)(mapped ? PHYS_TO_VIRT(frame) : frame);
+    }
 
-    MetadataNode* current = low_alloc_mem_head; // Setting the current block as the head
+    uint32_t return_address = take_frames(count);
+    // Noting that we took up usable RAM
+    if(return_address) {
+        count_alloc(count);
+        memtrace::trace(TRACE_FRAME_ALLOC, __builtin_return_address(0), (void*)return_address, count);
+    }
+    irq_restore(flags);
 
-    #ifdef VMM_HPP
-    // Checks if the list head is mapped
-    if (vmm::enabled_paging && !vmm::is_mapped(uint32_t(low_alloc_mem_head))) {
-        kprintf(LOG_ERROR, "Page fault: pmm_head is not mapped!\n");
+    if(!return_address) {
+        kprintf(LOG_ERROR, "Not enough memory to allocate %x block(s)!\n", count);
         return nullptr;
     }
-    #endif
-
-    // Find a free block with enough space
-    while(current) {
-        // If the current block is free and has enough space then we can use it
-        if(current->free && current->size >= size) {
-            // Split the block if theres extra space
-            if(current->size > size) {
-                // Setting new block
-                MetadataNode* new_block = (MetadataNode*)((uint8_t*)current + sizeof(MetadataNode));
-                // Trimming the extra space of
-                new_block->size = current->size - size;
-                new_block->addr = current->addr + size; // Setting address
-                new_block->free = true;
-                /* Setting the current blocks next block as the trimmed (new)
-                 * blocks next, because the new block is the end of the current block. Setting current as prev */
-                new_block->next = current->next;
-                new_block->prev = current;
-                // Making the current blocks next block the new block
-                current->next = new_block;
-            }
-
-            current->size = size; // Setting the passed size
-            // Setting the address
-            if(current->prev) 
-                current->addr = current->prev->addr + current->prev->size;
-
-            current->free = false; // Mark as allocated
-
-            // Noting that we took up usable RAM
-            pmm::total_used_ram += size;
-
-            // Returning the current blocks address plus the metadata size needed and aligning it to the page size
-            uint64_t return_address = current->addr;
-            
-            #ifdef VMM_HPP // If VMM is present
-            // If paging is enabled
-            if(vmm::enabled_paging && identity_map) {
-                // Identity map the allocated frames every 4KiB block to virtual memory
-                vmm::identity_map_region(return_address, return_address + PAGE_SIZE * num_blocks, PRESENT | WRITABLE);
-            }
-            #endif // VMM_HPP
-            memset((void*)return_address, 0, FRAME_SIZE); // Zeroing out data
-
-            return (void*)align_up(return_address, PAGE_SIZE); // Insuring alignment
-        }
-        // Moving to the next block
-        current = current->next;
+
+    // Low zones are in the kernel's direct map, so the frames are already mapped
+    if(zero) memset((void*)PHYS_TO_VIRT(return_address), 0, count * FRAME_SIZE); // Zeroing out data
+
+    return (void*)(mapped ? PHYS_TO_VIRT(return_address) : return_address);
+}
+
+// Gives an allocation back to its zone, returns the amount of frames it had (0 if it isn't an allocation)
+static uint32_t release_frames(const uint64_t addr, const void* caller) {
+    BuddyZone* zone = zone_of(addr);
+    if(!zone || (addr & (FRAME_SIZE - 1))) return 0;
+    uint32_t index = (addr - zone->base) / FRAME_SIZE;
+
+    uint32_t flags = irq_save();
+    // Ignoring pointers that aren't the start of an allocation, this also catches double frees
+    FrameNode* node = &zone->frames[index];
+    if(node->flags != FRAME_USED) {
+        irq_restore(flags);
+        return 0;
     }
+    uint32_t count = node->count;
+    node->flags = 0;
+
+    free_range(zone, index, count);
+    pmm::total_used_ram -= uint64_t(count) * FRAME_SIZE;
+    pmm::free_count++;
+    memtrace::trace(TRACE_FRAME_FREE, caller, (void*)uint32_t(addr), 0);
+    irq_restore(flags);
+    return count;
+}
 
-    kprintf(LOG_ERROR, "Not enough memory to allocate %x block(s)!\n", num_blocks);
-    return nullptr;
+// Allocates frames that may lie above 4GiB, they aren't mapped or zeroed
+uint64_t pmm::alloc_high_frame(const uint32_t num_blocks) {
+    if(num_blocks == 0) return 0;
+
+    uint32_t flags = irq_save();
+    uint64_t frame = take_frames(num_blocks, true);
+    if(frame) count_alloc(num_blocks);
+    irq_restore(flags);
+
+    if(!frame) kprintf(LOG_ERROR, "Not enough memory to allocate %x block(s)!\n", num_blocks);
+    return frame;
+}
+
+// Frees frames from alloc_high_frame
+void pmm::free_high_frame(const uint64_t phys_addr) {
+    release_frames(phys_addr, __builtin_return_address(0));
 }
 
-// Frees a frame
+// Frees a frame, given by its direct map or physical address
 void pmm::free_frame(void* ptr) {
     if(!ptr) return;
+    uint32_t addr = uint32_t(ptr);
+    if(addr >= KERNEL_LOAD_ADDRESS && addr < KERNEL_LOAD_ADDRESS + VMM_DIRECT_MAP_SIZE) addr = VIRT_TO_PHYS(addr);
+    release_frames(addr, __builtin_return_address(0));
+}
 
-    // Getting the frame based of of the given address/pointer and setting it as free
-    MetadataNode* current = low_alloc_mem_head;
-    MetadataNode* block;
-    while(current) {
-        // If the given address is the same as the current nodes address, that means we found it
-        if(current->addr == uint64_t(ptr)) {
-            // Saving the block
-            block = current;
-            break;
-        }
-
-        // Going to next node
-        current = current->next;
-    }
-    block->free = true; // Setting as free
-    pmm::total_used_ram -= block->size;
-
-    loop:
-    // Setting the corresponding linked list head, high or low usable mem region
-    current = low_alloc_mem_head;
-
-    bool merged_frames = false;
-    // Merging adjacent free blocks to decrease fragmentation
-    while(current) {
-        // If the current block and the next block are free
-        if(current->free && current->next && current->next->free) {
-            /* We'll only merge the blocks if there is no gap between the address, we add
-             * this check because we have two memory regions (lower(starting at the kernels base), and the higher(usually starting at 4GiB))
-             * these two regions in the mmap have two hardware reserved regions in between,
-             * to avoid overwritting these reserved regions we wont merge these two usable regions */
-            if(current->next->addr == current->addr + current->size) {
-                // Adding the block sizes together
-                current->size += current->next->size;
-                /* The current blocks next block will be the next blocks next block, 
-                * because the next block doesn't exist anymore */
-                current->next = current->next->next;
-                if(current->next)
-                    current->next->prev = current;
-
-                merged_frames = true;
-            }
+// Returns fragmentation statistics of the buddy allocator
+BuddyStats pmm::get_buddy_stats(void) {
+    BuddyStats stats;
+    memset(&stats, 0, sizeof(BuddyStats));
+
+    for(uint32_t i = 0; i < zone_count; i++) {
+        for(uint32_t order = 0; order < PMM_ORDER_COUNT; order++) {
+            uint32_t blocks = zones[i].free_blocks[order];
+            if(!blocks) continue;
+            stats.free_blocks[order] += blocks;
+            stats.free_bytes += uint64_t(blocks) * (FRAME_SIZE << order);
+            if(uint64_t(FRAME_SIZE << order) > stats.largest_free) stats.largest_free = FRAME_SIZE << order;
         }
-        // Going to the next block
-        current = current->next;
     }
 
-    // We will do this merging while every possible frame isn't merged
-    if(merged_frames) goto loop;
-    
-    // Setting the ptr to null because it doesn't point to a valid address anymore
-    ptr = nullptr;
-
-    #ifdef VMM_HPP // If VMM is present
-        // If paging is enabled
-        if(vmm::enabled_paging) {
-            // Unmap the allocated frames every 4KiB block from virtual memory
-            for(uint64_t i = 0, addr = uint64_t(ptr); i < (block->size / PAGE_SIZE); block++, addr += PAGE_SIZE)
-                vmm::free_page(uint64_t(addr));
-        }
-    #endif // VMM_HPP
+    // Free memory that can't be handed out as a block of the largest order counts as fragmented
+    uint64_t max_order_bytes = uint64_t(stats.free_blocks[PMM_MAX_ORDER]) * (FRAME_SIZE << PMM_MAX_ORDER);
+    if(stats.free_bytes) stats.fragmentation = 100 - udiv64(max_order_bytes * 100, stats.free_bytes);
+    return stats;
 }
-
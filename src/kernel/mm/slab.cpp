@@ -0,0 +1,209 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// slab.cpp
+// Size class slab allocator that sits in front of the kernel heap
+// ========================================
+
+#include <mm/slab.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
+#include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
+
+bool slab::enabled = false;
+SlabCache slab::caches[SLAB_CLASS_COUNT];
+
+// Frames given to one slab of every size class, bigger classes get more so a slab holds several objects
+static const uint8_t frames_per_class[SLAB_CLASS_COUNT] = {1, 1, 1, 1, 1, 1, 2, 4, 4};
+
+// Objects start after the header, aligned to 16 bytes
+static constexpr uint32_t object_offset = (sizeof(SlabPage) + 15) & ~15;
+
+#pragma region Owner Table
+
+/* Maps every frame that backs a slab to its header. Two levels like a page directory,
+ * so a lookup is O(1) and we only pay for tables of 4MiB regions that hold slabs */
+static SlabPage** owner_dir[PD_ENTRIES];
+
+static SlabPage* get_owner(const uint32_t addr) {
+    SlabPage** table = owner_dir[PD_INDEX(addr)];
+    if(!table) return nullptr;
+    return table[PT_INDEX(addr)];
+}
+
+static bool set_owner(const uint32_t addr, SlabPage* owner) {
+    SlabPage**& table = owner_dir[PD_INDEX(addr)];
+    if(!table) {
+        if(!owner) return true;
+        // Tables are a single zeroed frame
+        table = (SlabPage**)pmm::alloc_frame(1);
+        if(!table) return false;
+    }
+    table[PT_INDEX(addr)] = owner;
+    return true;
+}
+
+#pragma endregion
+
+#pragma region Helpers
+
+// Returns the size class index for a given size
+static inline uint32_t class_of(const size_t size) {
+    if(size <= SLAB_MIN_SIZE) return 0;
+    // Index of the smallest power of two that fits, offset so 8 bytes is class 0
+    return (32 - __builtin_clz(size - 1)) - 3;
+}
+
+static inline uint8_t* first_object(SlabPage* s) {
+    return (uint8_t*)s + object_offset;
+}
+
+// Removes a slab from its caches partial list
+static void unlink_partial(SlabCache* cache, SlabPage* s) {
+    if(s->prev) s->prev->next = s->next;
+    else cache->partial = s->next;
+    if(s->next) s->next->prev = s->prev;
+    s->next = s->prev = nullptr;
+}
+
+// Adds a slab to the front of its caches partial list
+static void link_partial(SlabCache* cache, SlabPage* s) {
+    s->prev = nullptr;
+    s->next = cache->partial;
+    if(cache->partial) cache->partial->prev = s;
+    cache->partial = s;
+}
+
+// Gets frames from the PMM and carves them into objects of a size class
+static SlabPage* new_slab(const uint32_t class_index) {
+    SlabCache* cache = &slab::caches[class_index];
+
+    SlabPage* s = (SlabPage*)pmm::alloc_frame(cache->frames_per_slab);
+    if(!s) return nullptr;
+
+    // Registering every frame of the slab in the owner table
+    for(uint32_t i = 0; i < cache->frames_per_slab; i++) {
+        if(!set_owner((uint32_t)s + i * FRAME_SIZE, s)) {
+            for(uint32_t j = 0; j < i; j++) set_owner((uint32_t)s + j * FRAME_SIZE, nullptr);
+            pmm::free_frame(s);
+            return nullptr;
+        }
+    }
+
+    memset(s, 0, sizeof(SlabPage));
+    s->class_index = class_index;
+    s->frames = cache->frames_per_slab;
+    s->capacity = (cache->frames_per_slab * FRAME_SIZE - object_offset) >> cache->object_shift;
+    if(s->capacity > SLAB_MAX_OBJECTS) s->capacity = SLAB_MAX_OBJECTS;
+
+    // Threading the free list through the objects, lowest address first
+    uint8_t* obj = first_object(s);
+    for(uint32_t i = 0; i < s->capacity; i++, obj += cache->object_size)
+        *(void**)obj = (i + 1 < s->capacity) ? obj + cache->object_size : nullptr;
+    s->free_list = first_object(s);
+
+    link_partial(cache, s);
+    cache->slab_count++;
+    cache->empty_count++;
+    cache->objects_total += s->capacity;
+    return s;
+}
+
+// Gives a slab's frames back to the PMM
+static void release_slab(SlabCache* cache, SlabPage* s) {
+    unlink_partial(cache, s);
+    for(uint32_t i = 0; i < s->frames; i++) set_owner((uint32_t)s + i * FRAME_SIZE, nullptr);
+
+    cache->slab_count--;
+    cache->empty_count--;
+    cache->objects_total -= s->capacity;
+    pmm::free_frame(s);
+}
+
+#pragma endregion
+
+// Initializes size class caches
+void slab::init(void) {
+    memset(owner_dir, 0, sizeof(owner_dir));
+
+    for(uint32_t i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabCache* cache = &caches[i];
+        memset(cache, 0, sizeof(SlabCache));
+        cache->object_shift = i + 3;
+        cache->object_size = 1 << cache->object_shift;
+        cache->frames_per_slab = frames_per_class[i];
+    }
+
+    enabled = true;
+    kprintf(LOG_INFO, "Implemented slab allocator with %u size classes (%u-%u B)\n", SLAB_CLASS_COUNT, SLAB_MIN_SIZE, SLAB_MAX_SIZE);
+}
+
+// Allocates an object from its size class
+void* slab::alloc(const size_t size) {
+    if(!enabled || size == 0 || size > SLAB_MAX_SIZE) return nullptr;
+
+    uint32_t class_index = class_of(size);
+    SlabCache* cache = &caches[class_index];
+
+    SlabPage* s = cache->partial;
+    if(!s) {
+        s = new_slab(class_index);
+        if(!s) return nullptr;
+        cache->refills++;
+    }
+
+    // Popping the first free object
+    void* obj = s->free_list;
+    s->free_list = *(void**)obj;
+
+    if(s->in_use == 0) cache->empty_count--;
+    s->in_use++;
+    // A full slab doesn't need to be found by alloc anymore
+    if(!s->free_list) unlink_partial(cache, s);
+
+    uint32_t index = ((uint8_t*)obj - first_object(s)) >> cache->object_shift;
+    s->bitmap[index / 32] |= (1 << (index % 32));
+
+    cache->objects_in_use++;
+    cache->allocs++;
+    return obj;
+}
+
+// Frees an object back to its slab
+bool slab::free(void* ptr) {
+    if(!enabled || !ptr) return false;
+
+    SlabPage* s = get_owner((uint32_t)ptr);
+    if(!s) return false;
+    SlabCache* cache = &caches[s->class_index];
+
+    // Pointers that aren't at the start of an object or weren't allocated are ignored
+    uint32_t offset = (uint8_t*)ptr - first_object(s);
+    if((uint8_t*)ptr < first_object(s) || (offset & (cache->object_size - 1))) return true;
+    uint32_t index = offset >> cache->object_shift;
+    if(index >= s->capacity || !(s->bitmap[index / 32] & (1 << (index % 32)))) return true;
+
+    s->bitmap[index / 32] &= ~(1 << (index % 32));
+    *(void**)ptr = s->free_list;
+    s->free_list = ptr;
+
+    // The slab was full, so it isn't on the partial list yet
+    if(s->in_use == s->capacity) link_partial(cache, s);
+    s->in_use--;
+    cache->objects_in_use--;
+    cache->frees++;
+
+    if(s->in_use == 0) {
+        cache->empty_count++;
+        // Keeping a spare slab around to avoid thrashing the PMM
+        if(cache->empty_count > SLAB_SPARE_EMPTY) release_slab(cache, s);
+    }
+    return true;
+}
+
+// Returns if a pointer lives inside of a slab
+bool slab::owns(const void* ptr) {
+    return enabled && get_owner((uint32_t)ptr) != nullptr;
+}
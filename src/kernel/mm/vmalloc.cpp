@@ -0,0 +1,146 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// vmalloc.cpp
+// Maps single frames into one contiguous kernel virtual range
+// ========================================
+
+#include <mm/vmalloc.hpp>
+#include <mm/vmm.hpp>
+#include <mm/pmm.hpp>
+#include <sched/spinlock.hpp>
+#include <graphics/vga_print.hpp>
+
+VmallocStats vmalloc_stats = {0, 0};
+
+/* Pages of the range that belong to an area, and the first page of every area.
+ * An area runs from its first page up to the next free page or the next first page */
+static uint32_t used_map[VMALLOC_PAGES / 32];
+static uint32_t head_map[VMALLOC_PAGES / 32];
+
+#pragma region Helpers
+
+static inline bool test_bit(const uint32_t* map, const uint32_t page) {
+    return map[page / 32] & (1u << (page % 32));
+}
+
+static inline void set_bit(uint32_t* map, const uint32_t page) {
+    map[page / 32] |= 1u << (page % 32);
+}
+
+static inline void clear_bit(uint32_t* map, const uint32_t page) {
+    map[page / 32] &= ~(1u << (page % 32));
+}
+
+static Spinlock maps_lock;
+
+// Locks the bitmaps with interrupts off, returns the previous EFLAGS
+static inline uint32_t irq_save(void) {
+    return maps_lock.lock_irqsave();
+}
+
+static inline void irq_restore(const uint32_t flags) {
+    maps_lock.unlock_irqrestore(flags);
+}
+
+// Takes the first run of <count> free pages, returns its index or VMALLOC_PAGES if the range is full
+static uint32_t take_pages(const uint32_t count) {
+    uint32_t run = 0;
+    for(uint32_t page = 0; page < VMALLOC_PAGES; page++) {
+        // Skipping fully used words in one go
+        if(!run && !(page % 32) && used_map[page / 32] == 0xFFFFFFFF) {
+            page += 31;
+            continue;
+        }
+        run = test_bit(used_map, page) ? 0 : run + 1;
+        if(run < count) continue;
+
+        uint32_t first = page + 1 - count;
+        for(uint32_t i = first; i <= page; i++) set_bit(used_map, i);
+        set_bit(head_map, first);
+        vmalloc_stats.used_pages += count;
+        return first;
+    }
+    return VMALLOC_PAGES;
+}
+
+// Physical address a page of the range is mapped to, frames above 4GiB need the 64-bit PAE lookup
+static inline uint64_t mapped_frame(const uint32_t virt_addr) {
+    if(vmm::pae_paging) return vmm::pae::virtual_to_physical(virt_addr);
+    return (uint32_t)vmm::virtual_to_physical(virt_addr);
+}
+
+// Unmaps the pages of an area and gives their frames back
+static void unmap_area(const uint32_t virt_addr, const uint32_t pages) {
+    vmm::begin_tlb_batch();
+    for(uint32_t i = 0; i < pages; i++) {
+        uint32_t addr = virt_addr + i * PAGE_SIZE;
+        if(!vmm::is_mapped(addr)) continue;
+        uint64_t frame = mapped_frame(addr) & ~uint64_t(PAGE_SIZE - 1);
+        vmm::free_page(addr);
+        pmm::free_high_frame(frame);
+        vmalloc_stats.mapped_pages--;
+    }
+    vmm::end_tlb_batch();
+}
+
+#pragma endregion
+
+// Allocates <size> bytes of virtually contiguous memory
+void* vmalloc(const size_t size) {
+    if(!size || !vmm::enabled_paging || size > VMALLOC_SIZE) return nullptr;
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    // One unmapped guard page after every area catches overruns
+    uint32_t flags = irq_save();
+    uint32_t first = take_pages(pages + 1);
+    irq_restore(flags);
+    if(first == VMALLOC_PAGES) {
+        kprintf(LOG_ERROR, "vmalloc: No virtual range for %u pages!\n", pages);
+        return nullptr;
+    }
+
+    /* Frames are taken one at a time, so no contiguous run is needed. High zones go first,
+     * since these frames get mapped anyway and the direct map is kept for what needs it */
+    uint32_t virt_addr = VMALLOC_START + first * PAGE_SIZE;
+    vmm::begin_tlb_batch();
+    for(uint32_t i = 0; i < pages; i++) {
+        uint64_t frame = pmm::alloc_high_frame(1);
+        if(!frame) {
+            vmm::end_tlb_batch();
+            vfree((void*)virt_addr);
+            return nullptr;
+        }
+        vmm::alloc_page(virt_addr + i * PAGE_SIZE, frame, PRESENT | WRITABLE);
+        vmalloc_stats.mapped_pages++;
+    }
+    vmm::end_tlb_batch();
+    return (void*)virt_addr;
+}
+
+// Frees an area returned by vmalloc
+void vfree(void* ptr) {
+    uint32_t addr = (uint32_t)ptr;
+    if(addr < VMALLOC_START || addr >= VMALLOC_START + VMALLOC_SIZE || (addr & (PAGE_SIZE - 1))) return;
+    uint32_t first = (addr - VMALLOC_START) / PAGE_SIZE;
+
+    // Pointers that aren't the start of an area (or were freed already) are ignored
+    uint32_t flags = irq_save();
+    if(!test_bit(head_map, first)) {
+        irq_restore(flags);
+        return;
+    }
+    uint32_t pages = 1;
+    while(first + pages < VMALLOC_PAGES && test_bit(used_map, first + pages) && !test_bit(head_map, first + pages)) pages++;
+    irq_restore(flags);
+
+    // The range stays taken until the frames are back, so it can't be handed out in the meantime
+    unmap_area(addr, pages);
+
+    flags = irq_save();
+    clear_bit(head_map, first);
+    for(uint32_t i = first; i < first + pages; i++) clear_bit(used_map, i);
+    vmalloc_stats.used_pages -= pages;
+    irq_restore(flags);
+}
@@ -11,63 +11,282 @@
 #include <x86/interrupts/kernel_panic.hpp>
 #include <graphics/vga_print.hpp>
 #include <drivers/vga.hpp>
+#include <lib/mem_util.hpp>
+#include <x86/cpuid.hpp>
+#include <multiboot.hpp>
+#include <x86/smp.hpp>
+#include <sched/spinlock.hpp>
 
-// Getting kernels physical base from linker
-extern "C" uint32_t __kernel_phys_base;
+// Code that runs identity mapped, from the linker
+extern "C" uint32_t __boot_start;
+extern "C" uint32_t __boot_end;
 
 namespace vmm {
     alignas(PAGE_SIZE) pd_t* active_pd = nullptr; // The PD we'll be using
     bool enabled_paging = false;
     bool pae_paging = false;
+    bool pse_paging = false;
 
     pd_t* get_active_pd(void) { return active_pd; }
+    uint32_t get_cr3(void) { return VIRT_TO_PHYS(pae_paging ? (uint32_t)pae::active->pdpt : (uint32_t)active_pd); }
+
+    // Kernel space is the same in every address space, so its pages are global
+    static inline uint32_t global_flag(const uint32_t virt_addr) {
+        return virt_addr >= KERNEL_LOAD_ADDRESS ? CPU_GLOBAL : 0;
+    }
 
     // Enables mapping before paging is enabled
     bool legacy_map = false;
-    // Initializes the VMM with 32-bit paging
+
+    #pragma region TLB Batching
+
+    /* Pages whose TLB entries are waiting for a flush. Only the mapping functions' own pages are
+     * batched, page table views and kmap slots are always flushed right away. Every CPU batches on its own,
+     * so interrupts stay off while a batch is open. Otherwise its process could move to another CPU in between */
+    struct TlbBatch {
+        uint32_t depth;
+        uint32_t flags; // EFLAGS before the outermost begin_tlb_batch
+        uint32_t count;
+        bool overflow; // More pages than fit, the whole TLB gets flushed
+        bool remote;   // Other CPUs have to flush too once the batch ends
+        uint32_t pages[VMM_TLB_BATCH_MAX];
+    };
+    static TlbBatch batches[SMP_MAX_CPUS];
+
+    static inline TlbBatch* this_batch(void) {
+        return &batches[smp::cpu_index()];
+    }
+
+    /* kmap slots are only used by the CPU that took them, which flushes the slot itself before using it.
+     * Everything else is shared, so other CPUs can't keep stale entries */
+    static inline bool is_shared(const uint32_t virt_addr) {
+        return virt_addr < VMM_KMAP_ADDR || virt_addr >= VMM_KMAP_ADDR + VMM_KMAP_SLOTS * PAGE_SIZE;
+    }
+
+    // Flushes a page now, or notes it if a batch is open
+    static void flush_page(const uint32_t virt_addr) {
+        TlbBatch* batch = this_batch();
+        if(!batch->depth) {
+            invlpg(virt_addr);
+            if(is_shared(virt_addr)) smp::shootdown_tlb();
+            return;
+        }
+        if(batch->count < VMM_TLB_BATCH_MAX) batch->pages[batch->count++] = virt_addr;
+        else batch->overflow = true;
+        if(is_shared(virt_addr)) batch->remote = true;
+    }
+
+    // Flushes the whole TLB now, or once the open batch ends. Global pages are flushed too
+    static void flush_all(void) {
+        TlbBatch* batch = this_batch();
+        if(batch->depth) {
+            batch->overflow = true;
+            batch->remote = true;
+            return;
+        }
+        flush_tlb();
+        smp::shootdown_tlb();
+    }
+
+    // Starts collecting TLB flushes instead of issuing them, batches can be nested
+    void begin_tlb_batch(void) {
+        uint32_t flags;
+        asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+        TlbBatch* batch = this_batch();
+        if(!batch->depth++) batch->flags = flags;
+    }
+
+    // Issues the flushes collected since begin_tlb_batch, other CPUs flush their whole TLB once
+    void end_tlb_batch(void) {
+        TlbBatch* batch = this_batch();
+        if(!batch->depth || --batch->depth) return;
+
+        if(batch->overflow) flush_tlb();
+        else for(uint32_t i = 0; i < batch->count; i++) invlpg(batch->pages[i]);
+        if(batch->remote) smp::shootdown_tlb();
+        batch->count = 0;
+        batch->overflow = false;
+        batch->remote = false;
+        if(batch->flags & 0x200) asm volatile("sti" ::: "memory");
+    }
+
+    #pragma endregion
+
+    // PD as seen by the CPU, through the recursive slot once paging is on
+    static inline pd_t* dir(void) {
+        return enabled_paging ? (pd_t*)VMM_PD_ADDR : active_pd;
+    }
+
+    // Page table of a present, non 4 MiB PDE. Before paging it's reached through the direct map
+    static inline pt_t* table(const uint16_t pd_index) {
+        if(enabled_paging) return (pt_t*)(VMM_RECURSIVE_ADDR + uint32_t(pd_index) * PAGE_SIZE);
+        return (pt_t*)PHYS_TO_VIRT(FRAME_TO_PHYS(uint32_t(active_pd->entries[pd_index].address)));
+    }
+
+    // Allocates a zeroed frame for a page table
+    static uint32_t new_page_table(void) {
+        // Without PSE the boot direct map is only partial while it's being built, so tables are zeroed through kmap
+        uint32_t frame = (uint32_t)pmm::alloc_frame(1, false, !enabled_paging);
+        if(!frame) kernel_panic("Out of memory for page tables!");
+        if(!enabled_paging) return frame; // The PMM already zeroed it
+
+        // A PDE can't point at the frame before it's clean
+        void* view = kmap(frame);
+        if(!view) kernel_panic("No kmap slot for a new page table!");
+        memset(view, 0, PAGE_SIZE);
+        kunmap(view);
+        return frame;
+    }
+
+    // Points a PDE at a page table, access bits are left to the PTEs
+    static void set_page_table(const uint16_t pd_index, const uint32_t frame, const bool user) {
+        pd_ent pd_entry = {0};
+        pd_entry.present = 1;
+        pd_entry.read_write = 1;
+        pd_entry.user_supervisor = user;
+        pd_entry.address = PHYS_TO_FRAME(frame);
+        dir()->entries[pd_index] = pd_entry;
+        // The table's recursive view changed, it's written to right away
+        if(enabled_paging) invlpg(VMM_RECURSIVE_ADDR + uint32_t(pd_index) * PAGE_SIZE);
+    }
+
+    // Returns the PDE at an index as a 4 MiB page
+    static inline page_4mb get_large_page(const uint16_t pd_index) {
+        page_4mb large;
+        memcpy(&large, &dir()->entries[pd_index], sizeof(large));
+        return large;
+    }
+
+    // Replaces a 4 MiB page with a page table that maps the same memory, so part of it can be remapped
+    static void split_large_page(const uint16_t pd_index) {
+        page_4mb large = get_large_page(pd_index);
+        uint32_t base = FRAME4MB_TO_PHYS(uint32_t(large.address));
+
+        // Every entry gets written, so the table is filled through kmap before the PDE points at it
+        uint32_t frame = (uint32_t)pmm::alloc_frame(1, false, false);
+        if(!frame) kernel_panic("Out of memory for page tables!");
+        pt_t* view = enabled_paging ? (pt_t*)kmap(frame) : (pt_t*)PHYS_TO_VIRT(frame);
+        if(!view) kernel_panic("No kmap slot for a new page table!");
+        page_4kb page = {0};
+        page.present = 1;
+        page.read_write = large.read_write;
+        page.user_supervisor = large.user_supervisor;
+        page.write_through = large.write_through;
+        page.cache_disable = large.cache_disable;
+        page.global = large.global;
+        for(uint32_t i = 0; i < PT_ENTRIES; i++) {
+            page.address = PHYS_TO_FRAME((base + i * PAGE_SIZE));
+            view->pages[i] = page;
+        }
+        if(enabled_paging) kunmap(view);
+
+        set_page_table(pd_index, frame, large.user_supervisor);
+        invlpg(uint32_t(pd_index) * LARGE_PAGE_SIZE);
+    }
+
+    // Picks the paging mode from CPUID and the memory map, has to run before the PMM builds its zones
+    void select_paging_mode(void* mb2_info) {
+        pse_paging = cpu::has_feature(CPUID_FEAT_EDX_PSE);
+
+        /* PAE is only worth its bigger tables when there is RAM above 4GiB. Its direct map is built
+         * with large pages while the boot PD is active, so it also needs PSE */
+        multiboot_tag_mmap* mmap_tag = Multiboot2::get_mmap(mb2_info);
+        if(!mmap_tag || !pse_paging || !cpu::has_feature(CPUID_FEAT_EDX_PAE)) return;
+        uint32_t entry_count = (mmap_tag->size - sizeof(multiboot_tag_mmap)) / mmap_tag->entry_size;
+        for(uint32_t i = 0; i < entry_count; i++) {
+            multiboot_mmap_entry* entry = &mmap_tag->entries[i];
+            if(entry->type == MULTIBOOT_MEMORY_AVAILABLE && entry->addr + entry->len > 0x100000000) pae_paging = true;
+        }
+    }
+
+    // Initializes the VMM with 32-bit or PAE paging
     void init(void) {
-        // Allocating memory for PD
-        active_pd = (pd_t*)pmm::alloc_frame(2);
-
-        legacy_map = true;
-        // Identity mapping kernel + heap + first metadata block
-        identity_map_region(0x0, METADATA_ADDR + PAGE_SIZE, PRESENT | WRITABLE);
-        // Mapping PMM's low_alloc_mem_head
-        vmm::alloc_page((uint32_t)pmm::low_alloc_mem_head, (uint32_t)pmm::low_alloc_mem_head, PRESENT | WRITABLE);
-        if(vga::framebuffer) {
-            size_t pages = (vga::fb_size + PAGE_SIZE - 1) / PAGE_SIZE; // Pages needed to map VGA framebuffer
-            for (size_t i = 0; i < pages; i++) {
-                vmm::alloc_page((uint32_t)vga::framebuffer + i * PAGE_SIZE,
-                                (uint32_t)vga::framebuffer + i * PAGE_SIZE,
-                                PRESENT | WRITABLE);
+        uint32_t cr4_flags = cpu::has_feature(CPUID_FEAT_EDX_PGE) ? CR4_PGE : 0;
+        uint32_t direct_map_end = pmm::get_direct_map_end();
+        uint32_t structures;
+
+        if(pae_paging) {
+            // Building new structures while the boot PD is active, they're reached through the direct map
+            pae::active = (pae_pdpt_t*)pmm::alloc_frame((sizeof(pae_pdpt_t) + PAGE_SIZE - 1) / PAGE_SIZE);
+            // The four directories stay present for good, PDPT entries can only be changed by reloading CR3
+            for(uint32_t i = 0; i < PAE_PDPT_ENTRIES; i++)
+                pae::active->pdpt[i] = VIRT_TO_PHYS((uint32_t)&pae::active->entries[i * PAE_ENTRIES]) | PRESENT;
+            // The last four entries point at the directories, which makes every table show up at VMM_PAE_RECURSIVE_ADDR
+            for(uint32_t i = 0; i < PAE_PDPT_ENTRIES; i++)
+                pae::active->entries[PAE_DIR_INDEX(VMM_PAE_RECURSIVE_ADDR) + i] = VIRT_TO_PHYS((uint32_t)&pae::active->entries[i * PAE_ENTRIES]) | PRESENT | WRITABLE;
+            structures = VMM_PAE_DIRS_ADDR;
+
+            legacy_map = true;
+            map_region(KERNEL_LOAD_ADDRESS, 0, direct_map_end, PRESENT | WRITABLE);
+            if(vga::framebuffer) {
+                // Same window as boot.asm maps, starting at the framebuffer's 4 MiB boundary
+                uint32_t fb_offset = vga::fb_phys & (LARGE_PAGE_SIZE - 1);
+                uint32_t fb_window = fb_offset + vga::fb_size < VMM_FB_SIZE ? fb_offset + vga::fb_size : VMM_FB_SIZE;
+                map_region(VMM_FB_ADDR, vga::fb_phys - fb_offset, fb_window, PRESENT | WRITABLE);
             }
+            // The kmap window's page table has to exist up front, new page tables are cleared through it
+            alloc_page(VMM_KMAP_ADDR, 0, 0);
+            // switch_paging turns paging off for a moment, so it has to run identity mapped
+            identity_map_region((uint32_t)&__boot_start, (uint32_t)&__boot_end - 1, PRESENT);
+            legacy_map = false;
+
+            switch_paging(get_cr3(), CR4_PAE | cr4_flags);
+            enabled_paging = true;
+            unmap_region((uint32_t)&__boot_start, (uint32_t)&__boot_end - (uint32_t)&__boot_start);
         }
-        // Identity mapping for paging structures
-        identity_map_region((uint32_t)active_pd, (uint32_t)active_pd + PAGE_SIZE * 5, PRESENT | WRITABLE);
-        legacy_map = false;
-        
-        set_pd((uint32_t)active_pd);
-        enable_paging();
-        reload_cr3();
-        
-        // Setting up HHK (Mapping kernel to 3GiB)
-        // for(uint32_t addr = (uint32_t)&__kernel_phys_base, page = KERNEL_LOAD_ADDRESS; addr < (uint32_t)&__kernel_phys_base + 0x100000; addr += PAGE_SIZE, page += PAGE_SIZE)
-        //     alloc_page(page, addr, PRESENT | WRITABLE);
-        // jump_to_hhk();
-        
-        enabled_paging = true;
-        if(!vmm::is_mapped((uint32_t)active_pd)) {
+        else {
+            // Taking over the PD built by boot.asm, its last entry already points at itself (VMM_RECURSIVE_ADDR)
+            active_pd = (pd_t*)PHYS_TO_VIRT(BOOT_PAGING_ADDR);
+            enabled_paging = true;
+            structures = VMM_PD_ADDR;
+            enable_paging(cr4_flags | (pse_paging ? CR4_PSE : 0));
+
+            /* Boot only maps the start of RAM without PSE, and all of VMM_DIRECT_MAP_SIZE with it.
+             * Mapping it again also marks every page as global, now that PGE is on */
+            map_region(KERNEL_LOAD_ADDRESS, 0, direct_map_end, PRESENT | WRITABLE);
+            uint32_t mapped_end = align_up(direct_map_end, LARGE_PAGE_SIZE);
+            if(pse_paging && mapped_end < VMM_DIRECT_MAP_SIZE)
+                unmap_region(PHYS_TO_VIRT(mapped_end), VMM_DIRECT_MAP_SIZE - mapped_end);
+
+            // Dropping the identity mapping boot.asm jumped to the higher half with
+            dir()->entries[0] = {0};
+            flush_all();
+        }
+
+        if(!vmm::is_mapped(structures)) {
             kprintf(LOG_ERROR, "Failed to initializ virtual memory manager! (Page directory is not mapped)\n");
             kernel_panic("Fatal component failed to initialize!");
         }
-        else kprintf(LOG_INFO, "Implemented virtual memory manager\n");
-        if(!is_mapped((uint32_t)active_pd)) enabled_paging = false;
+        else kprintf(LOG_INFO, "Implemented virtual memory manager (%s paging, %u MiB direct map)\n", pae_paging ? "PAE" : "32-bit", direct_map_end >> 20);
         return;
     }
 
+    // Maps device registers into the MMIO window, returns the virtual address of <phys_addr>
+    void* map_mmio(const uint32_t phys_addr, const uint32_t size, const uint32_t flags) {
+        static uint32_t next = VMM_MMIO_ADDR;
+        static Spinlock lock;
+
+        uint32_t offset = PAGE_OFFSET(phys_addr);
+        uint32_t bytes = align_up(offset + size, PAGE_SIZE);
+        // The window is handed out bump style, devices don't give their registers back
+        uint32_t eflags = lock.lock_irqsave();
+        if(next + bytes > VMM_MMIO_ADDR + VMM_MMIO_SIZE || next + bytes < next) {
+            lock.unlock_irqrestore(eflags);
+            kprintf(LOG_ERROR, "MMIO window is full, can't map %x!\n", phys_addr);
+            return nullptr;
+        }
+        uint32_t virt_addr = next;
+        next += bytes;
+        lock.unlock_irqrestore(eflags);
+
+        map_region(virt_addr, phys_addr - offset, bytes, flags);
+        return (void*)(virt_addr + offset);
+    }
+
     // Allocates a 4 KiB page
-    void alloc_page(const uint32_t virt_addr, const uint32_t phys_addr, const uint32_t flags) {
+    void alloc_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags) {
         if(!enabled_paging && !legacy_map) return;
+        if(pae_paging) return pae::alloc_page(virt_addr, phys_addr, flags);
         if(!active_pd) kernel_panic("PD inactive!");
 
         // Getting indexes from address
@@ -81,26 +300,22 @@ namespace vmm {
         bool write_through = flags & WRITETHROUGH;
         bool cache_disable = flags & NOTCACHABLE;
         bool pat = flags & PAT;
-        bool global = flags & CPU_GLOBAL;
+        bool global = (flags | global_flag(virt_addr)) & CPU_GLOBAL;
+
+        // Remapping part of a 4 MiB page splits it, unless the page already maps it the same way
+        pd_ent* pd_entry = &dir()->entries[pd_index];
+        if(pd_entry->present && pd_entry->ps) {
+            page_4mb large = get_large_page(pd_index);
+            if(FRAME4MB_TO_PHYS(uint32_t(large.address)) + (virt_addr & (LARGE_PAGE_SIZE - 1)) == (phys_addr & ~(PAGE_SIZE - 1)) &&
+               large.read_write == writable && large.user_supervisor == user &&
+               large.write_through == write_through && large.cache_disable == cache_disable) return;
+            split_large_page(pd_index);
+        }
 
         // If PT is inactive we'll allocate it
-        if(!active_pd->page_tables[pd_index]) {
-            // Creating and setting flags for a new PT
-            pt_t* pt = (pt_t*)pmm::alloc_frame(1);
-            pd_ent pd_entry = {0};
-            pd_entry.present = present;
-            pd_entry.read_write = writable;
-            pd_entry.user_supervisor = user;
-            pd_entry.write_through = write_through;
-            pd_entry.cache_disable = cache_disable;
-            pd_entry.address = PHYS_TO_FRAME((uint32_t)pt);
-            pd_entry.ps = 0;
-
-            // Adding this new PT to the PD
-            active_pd->page_tables[pd_index] = pt;
-            active_pd->entries[pd_index] = pd_entry;
-        }
-        pt_t* pt = active_pd->page_tables[pd_index];
+        if(!pd_entry->present) set_page_table(pd_index, new_page_table(), user);
+        else if(user) pd_entry->user_supervisor = 1;
+        pt_t* pt = table(pd_index);
 
         // Creating new 4KiB page
         page_4kb new_page = {0};
@@ -117,13 +332,19 @@ namespace vmm {
         pt->pages[pt_index] = new_page;
 
         // Flush TLB
-        invlpg(virt_addr);
+        flush_page(virt_addr);
         return;
     }
 
     // Allocates a 4 MiB page
     void alloc_page_4mib(const uint32_t virt_addr, const uint32_t phys_addr, const uint32_t flags) {
         if(!enabled_paging && !legacy_map) return;
+        // PAE pages are 2 MiB, so it takes two of them
+        if(pae_paging) {
+            pae::alloc_large_page(virt_addr, phys_addr, flags);
+            pae::alloc_large_page(virt_addr + PAE_LARGE_PAGE_SIZE, phys_addr + PAE_LARGE_PAGE_SIZE, flags);
+            return;
+        }
         if(!active_pd) kernel_panic("PD inactive!");
 
         // Getting indexes from address
@@ -135,31 +356,87 @@ namespace vmm {
         bool user = flags & USER;
         bool write_through = flags & WRITETHROUGH;
         bool cache_disable = flags & NOTCACHABLE;
+        bool global = (flags | global_flag(virt_addr)) & CPU_GLOBAL;
 
         // Creating new 4MiB page and setting flags
-        pd_ent new_page = {0};
+        page_4mb new_page = {0};
         new_page.present = present;
         new_page.read_write = writable;
         new_page.user_supervisor = user;
         new_page.write_through = write_through;
         new_page.cache_disable = cache_disable;
+        new_page.global = global;
         new_page.ps = 1;
         new_page.address = PHYS_TO_FRAME4MB((uint32_t)phys_addr);
 
-        active_pd->entries[pd_index] = new_page;
+        // The page table that mapped this region isn't needed anymore
+        pd_ent old_entry = dir()->entries[pd_index];
+        memcpy(&dir()->entries[pd_index], &new_page, sizeof(new_page));
+
         // Flush TLB
-        invlpg(virt_addr);
+        if(!old_entry.present || old_entry.ps) {
+            flush_page(virt_addr);
+            return;
+        }
+        if(enabled_paging) invlpg(VMM_RECURSIVE_ADDR + uint32_t(pd_index) * PAGE_SIZE);
+        flush_all();
+        pmm::free_frame((void*)FRAME_TO_PHYS(uint32_t(old_entry.address)));
         return;
     }
 
     // Identity maps a region in a given range
     void identity_map_region(const uint32_t start_addr, const uint32_t end_addr, const uint32_t flags) {
-        for(uint32_t addr = start_addr; addr <= end_addr; addr += PAGE_SIZE) vmm::alloc_page(addr, addr, flags);
+        if(end_addr < start_addr) return;
+        map_region(start_addr, start_addr, end_addr - start_addr + 1, flags);
+    }
+
+    // Maps <size> bytes of physically contiguous memory, the TLB is flushed once at the end
+    void map_region(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t size, const uint32_t flags) {
+        uint32_t large_size = pae_paging ? PAE_LARGE_PAGE_SIZE : LARGE_PAGE_SIZE;
+        uint32_t virt = virt_addr & ~(PAGE_SIZE - 1);
+        uint64_t phys = phys_addr & ~uint64_t(PAGE_SIZE - 1);
+        uint32_t pages = (PAGE_OFFSET(virt_addr) + uint64_t(size) + PAGE_SIZE - 1) >> 12;
+
+        begin_tlb_batch();
+        while(pages) {
+            // Spans that cover a whole aligned large page take a single PDE
+            if((pse_paging || pae_paging) && !(virt & (large_size - 1)) && !(phys & (large_size - 1)) && pages >= large_size / PAGE_SIZE) {
+                if(pae_paging) pae::alloc_large_page(virt, phys, flags);
+                else vmm::alloc_page_4mib(virt, phys, flags);
+                virt += large_size;
+                phys += large_size;
+                pages -= large_size / PAGE_SIZE;
+                continue;
+            }
+            vmm::alloc_page(virt, phys, flags);
+            virt += PAGE_SIZE;
+            phys += PAGE_SIZE;
+            pages--;
+        }
+        end_tlb_batch();
+    }
+
+    // Unmaps <size> bytes, the TLB is flushed once at the end. Large pages inside the range are unmapped as a whole
+    void unmap_region(const uint32_t virt_addr, const uint32_t size) {
+        uint32_t large_size = pae_paging ? PAE_LARGE_PAGE_SIZE : LARGE_PAGE_SIZE;
+        uint32_t virt = virt_addr & ~(PAGE_SIZE - 1);
+        uint32_t pages = (PAGE_OFFSET(virt_addr) + uint64_t(size) + PAGE_SIZE - 1) >> 12;
+
+        begin_tlb_batch();
+        while(pages) {
+            uint32_t step = is_large_page(virt) ? large_size - (virt & (large_size - 1)) : PAGE_SIZE;
+            vmm::free_page(virt);
+            if(step / PAGE_SIZE >= pages) break;
+            virt += step;
+            pages -= step / PAGE_SIZE;
+        }
+        end_tlb_batch();
     }
 
     // Frees a page at a give virtual address
     bool free_page(const uint32_t virt_addr) {
         if(!enabled_paging && !legacy_map) return true;
+        if(pae_paging) return pae::free_page(virt_addr);
         if(!active_pd) kernel_panic("PD inactive!");
 
         // Getting indexes from address
@@ -167,53 +444,58 @@ namespace vmm {
         uint16_t pt_index = PT_INDEX(virt_addr);
 
         // If PT is inactive
-        if(!active_pd->page_tables[pd_index]) return false;
+        pd_ent* pd_entry = &dir()->entries[pd_index];
+        if(!pd_entry->present) return false;
 
         // If we're dealing with a 4MiB page
-        if(active_pd->entries[pd_index].ps) {
-            active_pd->entries[pd_index] = {0};
+        if(pd_entry->ps) {
+            *pd_entry = {0};
             // Flushing TLB
-            invlpg(virt_addr);
+            flush_page(virt_addr);
             return true;
         }
-        
-        pt_t* pt = active_pd->page_tables[pd_index];
+
+        pt_t* pt = table(pd_index);
         // If page is inactive
         if(!pt->pages[pt_index].present) return false;
 
         // Freeing
         pt->pages[pt_index].present = 0;
         // Flush TLB
-        invlpg(virt_addr);
+        flush_page(virt_addr);
         return true;
     }
 
     // Returns the corresponding physical address for a virtual address
     void* virtual_to_physical(const uint32_t virt_addr) {
         if(!enabled_paging && !legacy_map) return (void*)virt_addr;
+        if(pae_paging) return (void*)uint32_t(pae::virtual_to_physical(virt_addr));
         if(!active_pd) kernel_panic("PD inactive!");
 
         // Getting indexes from address
         uint16_t pd_index = PD_INDEX(virt_addr);
         uint16_t pt_index = PT_INDEX(virt_addr);
 
+        // If PT is inactive
+        pd_ent pd_entry = dir()->entries[pd_index];
+        if(!pd_entry.present) return nullptr;
         // If the PDE is a 4MiB page
-        if(active_pd->entries[pd_index].present && active_pd->entries[pd_index].ps)
-            return (void*)FRAME4MB_TO_PHYS(active_pd->entries[pd_index].address);
+        if(pd_entry.ps)
+            return (void*)(FRAME4MB_TO_PHYS(uint32_t(get_large_page(pd_index).address)) + (virt_addr & (LARGE_PAGE_SIZE - 1)));
 
-        // If PT is inactive
-        if(!active_pd->page_tables[pd_index]) return nullptr;
-        pt_t* pt = active_pd->page_tables[pd_index];
+        // The PT is reached through the recursive slot, so no identity mapping is needed
+        pt_t* pt = table(pd_index);
         // If page is inactive
         if(!pt->pages[pt_index].present) return nullptr;
 
         // returning the physical address gotten from the address field in the 4KiB page
-        return (void*)FRAME_TO_PHYS(pt->pages[pt_index].address) + PAGE_OFFSET(virt_addr);
+        return (void*)(FRAME_TO_PHYS(uint32_t(pt->pages[pt_index].address)) + PAGE_OFFSET(virt_addr));
     }
 
     // Returns if a page at the given virtual address is mapped or not
     bool is_mapped(const uint32_t virt_addr) {
         if(!enabled_paging && !legacy_map) return false;
+        if(pae_paging) return pae::is_mapped(virt_addr);
         if(!active_pd) kernel_panic("PD inactive!");
 
         // Getting indexes from address
@@ -221,11 +503,219 @@ namespace vmm {
         uint16_t pt_index = PT_INDEX(virt_addr);
 
         // If PT is inactive
-        if(active_pd->entries[pd_index].present == 0) return false;
+        pd_ent pd_entry = dir()->entries[pd_index];
+        if(pd_entry.present == 0) return false;
+        // 4 MiB pages map the whole region
+        if(pd_entry.ps) return true;
         // If page is inactive
-        if(active_pd->page_tables[pd_index]->pages[pt_index].present == 0) return false;
+        if(table(pd_index)->pages[pt_index].present == 0) return false;
 
         // If we made it to here it means the page is mapped
         return true;
     }
+
+    // Returns if the given virtual address is mapped by a 4 MiB page
+    bool is_large_page(const uint32_t virt_addr) {
+        if(!enabled_paging && !legacy_map) return false;
+        if(pae_paging) return pae::is_large_page(virt_addr);
+        if(!active_pd) kernel_panic("PD inactive!");
+        pd_ent entry = dir()->entries[PD_INDEX(virt_addr)];
+        return entry.present && entry.ps;
+    }
+
+    #pragma region Temporary Mappings
+
+    // Taken kmap slots
+    static uint32_t kmap_used[VMM_KMAP_SLOTS / 32];
+    static Spinlock kmap_lock;
+
+    // Temporarily maps the frame holding a physical address, returns the matching virtual address
+    void* kmap(const uint64_t phys_addr) {
+        if(!pae_paging && phys_addr >= 0x100000000) return nullptr;
+
+        uint32_t flags = kmap_lock.lock_irqsave();
+        uint32_t slot = VMM_KMAP_SLOTS;
+        for(uint32_t i = 0; i < VMM_KMAP_SLOTS / 32; i++) {
+            if(kmap_used[i] == 0xFFFFFFFF) continue;
+            slot = i * 32 + __builtin_ctz(~kmap_used[i]);
+            kmap_used[i] |= 1u << (slot % 32);
+            break;
+        }
+        kmap_lock.unlock_irqrestore(flags);
+        if(slot == VMM_KMAP_SLOTS) return nullptr;
+
+        uint32_t virt_addr = VMM_KMAP_ADDR + slot * PAGE_SIZE;
+        alloc_page(virt_addr, phys_addr & ~uint64_t(PAGE_SIZE - 1), PRESENT | WRITABLE);
+        // Slots get reused right away, so they can't wait for a TLB batch
+        invlpg(virt_addr);
+        return (void*)(virt_addr + PAGE_OFFSET(uint32_t(phys_addr)));
+    }
+
+    // Removes a mapping made by kmap
+    void kunmap(const void* virt_addr) {
+        uint32_t slot = ((uint32_t)virt_addr - VMM_KMAP_ADDR) / PAGE_SIZE;
+        if((uint32_t)virt_addr < VMM_KMAP_ADDR || slot >= VMM_KMAP_SLOTS) return;
+
+        free_page(VMM_KMAP_ADDR + slot * PAGE_SIZE);
+        __atomic_and_fetch(&kmap_used[slot / 32], ~(1u << (slot % 32)), __ATOMIC_SEQ_CST);
+    }
+
+    #pragma endregion
+
+    #pragma region PAE Paging
+
+    namespace pae {
+        pae_pdpt_t* active = nullptr;
+
+        // Permission and caching bits of an entry
+        static constexpr uint32_t access_flags = WRITABLE | USER | WRITETHROUGH | NOTCACHABLE;
+
+        // Writes an entry in two halves so the CPU never sees a present entry with half of an address
+        static inline void set_entry(uint64_t* entry, const uint64_t value) {
+            volatile uint32_t* half = (volatile uint32_t*)entry;
+            half[0] = 0;
+            half[1] = uint32_t(value >> 32);
+            half[0] = uint32_t(value);
+        }
+
+        static inline bool is_large(const uint64_t entry) {
+            return (entry & PRESENT) && (entry & PS);
+        }
+
+        // Physical address mapped by a large page entry
+        static inline uint64_t large_base(const uint64_t entry) {
+            return entry & PAE_ADDR_MASK & ~uint64_t(PAE_LARGE_PAGE_SIZE - 1);
+        }
+
+        // The four directories as seen by the CPU, through the recursive entries once PAE paging is on
+        static inline uint64_t* dirs(void) {
+            return enabled_paging ? (uint64_t*)VMM_PAE_DIRS_ADDR : active->entries;
+        }
+
+        // Page table of a present, non 2 MiB directory entry. Before PAE paging it's reached through the direct map
+        static inline pae_pt_t* table(const uint16_t dir_index) {
+            if(enabled_paging) return (pae_pt_t*)(VMM_PAE_RECURSIVE_ADDR + uint32_t(dir_index) * PAGE_SIZE);
+            return (pae_pt_t*)PHYS_TO_VIRT(uint32_t(active->entries[dir_index] & PAE_ADDR_MASK));
+        }
+
+        // Points a directory entry at a page table, access bits are left to the PTEs
+        static void set_page_table(const uint16_t dir_index, const uint32_t frame, const uint32_t flags) {
+            set_entry(&dirs()[dir_index], frame | PRESENT | WRITABLE | (flags & USER));
+            // The table's recursive view changed, it's written to right away
+            if(enabled_paging) invlpg(VMM_PAE_RECURSIVE_ADDR + uint32_t(dir_index) * PAGE_SIZE);
+        }
+
+        // Replaces a 2 MiB page with a page table that maps the same memory, so part of it can be remapped
+        static void split_large_page(const uint16_t dir_index) {
+            uint64_t large = dirs()[dir_index];
+            uint64_t base = large_base(large);
+            uint64_t page_flags = (large & (access_flags | CPU_GLOBAL)) | PRESENT;
+
+            // Every entry gets written, so the table is filled through kmap before the directory points at it
+            uint32_t frame = (uint32_t)pmm::alloc_frame(1, false, false);
+            if(!frame) kernel_panic("Out of memory for page tables!");
+            pae_pt_t* view = enabled_paging ? (pae_pt_t*)kmap(frame) : (pae_pt_t*)PHYS_TO_VIRT(frame);
+            if(!view) kernel_panic("No kmap slot for a new page table!");
+            for(uint32_t i = 0; i < PAE_ENTRIES; i++) view->pages[i] = (base + i * PAGE_SIZE) | page_flags;
+            if(enabled_paging) kunmap(view);
+
+            set_page_table(dir_index, frame, large);
+            invlpg(uint32_t(dir_index) * PAE_LARGE_PAGE_SIZE);
+        }
+
+        // Allocates a 4 KiB page
+        void alloc_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags) {
+            if(!active) kernel_panic("PDPT inactive!");
+            uint16_t dir_index = PAE_DIR_INDEX(virt_addr);
+
+            // Remapping part of a 2 MiB page splits it, unless the page already maps it the same way
+            uint64_t dir_entry = dirs()[dir_index];
+            if(is_large(dir_entry)) {
+                uint64_t mapped = large_base(dir_entry) + (virt_addr & (PAE_LARGE_PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+                if(mapped == (phys_addr & PAE_ADDR_MASK) && (dir_entry & access_flags) == (flags & access_flags)) return;
+                split_large_page(dir_index);
+            }
+
+            // If PT is inactive we'll allocate it
+            if(!(dir_entry & PRESENT)) set_page_table(dir_index, new_page_table(), flags);
+            else if(flags & USER) dirs()[dir_index] |= USER;
+
+            pae_pt_t* pt = table(dir_index);
+            set_entry(&pt->pages[PAE_PT_INDEX(virt_addr)], (phys_addr & PAE_ADDR_MASK) | ((flags | global_flag(virt_addr)) & (PRESENT | access_flags | PAT | CPU_GLOBAL)));
+            // Flush TLB
+            flush_page(virt_addr);
+        }
+
+        // Allocates a 2 MiB page
+        void alloc_large_page(const uint32_t virt_addr, const uint64_t phys_addr, const uint32_t flags) {
+            if(!active) kernel_panic("PDPT inactive!");
+            uint16_t dir_index = PAE_DIR_INDEX(virt_addr);
+
+            // The page table that mapped this region isn't needed anymore
+            uint64_t old_entry = dirs()[dir_index];
+            set_entry(&dirs()[dir_index], large_base(phys_addr) | ((flags | global_flag(virt_addr)) & (PRESENT | access_flags | CPU_GLOBAL)) | PS);
+
+            // Flush TLB
+            if(!(old_entry & PRESENT) || (old_entry & PS)) {
+                flush_page(virt_addr);
+                return;
+            }
+            if(enabled_paging) invlpg(VMM_PAE_RECURSIVE_ADDR + uint32_t(dir_index) * PAGE_SIZE);
+            flush_all();
+            pmm::free_frame((void*)uint32_t(old_entry & PAE_ADDR_MASK));
+        }
+
+        // Frees a page at a given virtual address, 2 MiB pages are freed as a whole
+        bool free_page(const uint32_t virt_addr) {
+            if(!active) kernel_panic("PDPT inactive!");
+            uint16_t dir_index = PAE_DIR_INDEX(virt_addr);
+
+            uint64_t dir_entry = dirs()[dir_index];
+            if(!(dir_entry & PRESENT)) return false;
+            if(dir_entry & PS) {
+                set_entry(&dirs()[dir_index], 0);
+                flush_page(virt_addr);
+                return true;
+            }
+
+            pae_pt_t* pt = table(dir_index);
+            if(!(pt->pages[PAE_PT_INDEX(virt_addr)] & PRESENT)) return false;
+            set_entry(&pt->pages[PAE_PT_INDEX(virt_addr)], 0);
+            flush_page(virt_addr);
+            return true;
+        }
+
+        // Returns the physical address for a virtual address, 0 if it isn't mapped
+        uint64_t virtual_to_physical(const uint32_t virt_addr) {
+            if(!active) kernel_panic("PDPT inactive!");
+            uint16_t dir_index = PAE_DIR_INDEX(virt_addr);
+
+            uint64_t dir_entry = dirs()[dir_index];
+            if(!(dir_entry & PRESENT)) return 0;
+            if(dir_entry & PS) return large_base(dir_entry) + (virt_addr & (PAE_LARGE_PAGE_SIZE - 1));
+
+            pae_pt_t* pt = table(dir_index);
+            if(!(pt->pages[PAE_PT_INDEX(virt_addr)] & PRESENT)) return 0;
+            return (pt->pages[PAE_PT_INDEX(virt_addr)] & PAE_ADDR_MASK) + PAGE_OFFSET(virt_addr);
+        }
+
+        // Returns if a page at the given virtual address is mapped or not
+        bool is_mapped(const uint32_t virt_addr) {
+            if(!active) kernel_panic("PDPT inactive!");
+            uint16_t dir_index = PAE_DIR_INDEX(virt_addr);
+
+            uint64_t dir_entry = dirs()[dir_index];
+            if(!(dir_entry & PRESENT)) return false;
+            if(dir_entry & PS) return true;
+            return table(dir_index)->pages[PAE_PT_INDEX(virt_addr)] & PRESENT;
+        }
+
+        // Returns if the given virtual address is mapped by a 2 MiB page
+        bool is_large_page(const uint32_t virt_addr) {
+            if(!active) kernel_panic("PDPT inactive!");
+            return is_large(dirs()[PAE_DIR_INDEX(virt_addr)]);
+        }
+    } // Namespace pae
+
+    #pragma endregion
 }
@@ -52,3 +52,9 @@ multiboot_tag_mmap* Multiboot2::get_mmap(void* mb2_info) {
 multiboot_tag_bootdev* Multiboot2::get_bootdev(void* mb2_info) {
     return (multiboot_tag_bootdev*)find_tag(mb2_info, MULTIBOOT_TAG_TYPE_BOOTDEV);
 }
+
+multiboot_tag_acpi* Multiboot2::get_acpi(void* mb2_info) {
+    multiboot_tag_acpi* tag = (multiboot_tag_acpi*)find_tag(mb2_info, MULTIBOOT_TAG_TYPE_ACPI_NEW);
+    if (!tag) tag = (multiboot_tag_acpi*)find_tag(mb2_info, MULTIBOOT_TAG_TYPE_ACPI_OLD);
+    return tag;
+}
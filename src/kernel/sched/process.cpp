@@ -8,33 +8,33 @@
 
 #include <sched/process.hpp>
 #include <sched/scheduler.hpp>
+#include <sched/spinlock.hpp>
 #include <x86/sched/context.hpp>
+#include <x86/fpu.hpp>
 #include <mm/heap.hpp>
 #include <mm/pmm.hpp>
 #include <mm/vmm.hpp>
 #include <graphics/vga_print.hpp>
-#include <lib/data/queue.hpp>
 #include <lib/string_util.hpp>
 #include <lib/math.hpp>
 
 data::list<Process*> process_log_list;
-
-template <typename Func>
-inline void atomic_procedure(Func function) {
-    asm volatile("cli");
-    function();
-    asm volatile("sti");
-}
+static Spinlock process_lock; // Guards PIDs and process_log_list, processes get created on every CPU
 
 static void* alloc_kernel_process_stack() {
     // Rounding up to multiples of FRAME_SIZE
     uint32_t blocks = ((KERNEL_PROCESS_STACK_SIZE + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1)) / FRAME_SIZE;
-    // Just return identity mapped address
-    return pmm::alloc_frame(blocks);
+    // Just return identity mapped address, stacks don't need to be zeroed
+    return pmm::alloc_frame(blocks, true, false);
 }
 
 static uint32_t next_pid = 0;
-uint32_t alloc_pid() { return next_pid++; }
+uint32_t alloc_pid() {
+    uint32_t flags = process_lock.lock_irqsave();
+    uint32_t pid = next_pid++;
+    process_lock.unlock_irqrestore(flags);
+    return pid;
+}
 
 /// @brief Creates a kernel process
 /// @param entry Function that the process will do
@@ -55,7 +55,6 @@ Process* Process::create(void (*entry)(), uint32_t priority, const char* process
     proc->time_slice = TIME_QUANTUM * priority;
 
     proc->pd = vmm::get_active_pd();
-    proc->ctx.cr3 = (uint32_t)vmm::virtual_to_physical((uint32_t)proc->pd);
 
     // Allocate stack
     void* stack_bottom = alloc_kernel_process_stack();
@@ -73,43 +72,42 @@ Process* Process::create(void (*entry)(), uint32_t priority, const char* process
     stack_top -= sizeof(uint32_t); 
     *((uint32_t*)stack_top) = (uint32_t)sched::exit_current_process;
     
-    // Set context registers
-    proc->ctx.esp = stack_top;
-    proc->ctx.eip = (uint32_t)entry;
-    proc->ctx.eflags = KERNEL_PROCESS_EFLAGS;
-    proc->ctx.cs = 0x08;
-    proc->ctx.ds = 0x10;
-    proc->ctx.es = 0x10;
-    proc->ctx.fs = 0x10;
-    proc->ctx.gs = 0x10;
-    proc->ctx.ss = 0x10;
-    // Initialize general purpose registers to zero
-    proc->ctx.eax = 0;
-    proc->ctx.ebx = 0;
-    proc->ctx.ecx = 0;
-    proc->ctx.edx = 0;
-    proc->ctx.esi = 0;
-    proc->ctx.edi = 0;
-    proc->ctx.ebp = 0;
+    // Set context registers, the stack is laid out for the fast switch path
+    ctx_init_kernel(&proc->ctx, stack_top, entry);
 
+    uint32_t flags = process_lock.lock_irqsave();
     process_log_list.add(proc);
+    process_lock.unlock_irqrestore(flags);
     return proc;
 }
 
+/// @brief Frees a process that was never started and takes it off the process list
+void Process::destroy(Process* proc) {
+    if(!proc) return;
+
+    uint32_t flags = process_lock.lock_irqsave();
+    for(uint32_t i = 0; i < process_log_list.count(); i++) {
+        if(process_log_list[i] != proc) continue;
+        process_log_list.erase(i);
+        break;
+    }
+    process_lock.unlock_irqrestore(flags);
+
+    if(proc->stack) pmm::free_frame(proc->stack);
+    kfree(proc);
+}
+
 /// @brief Starts executing a kernel process
 void Process::start(void) {
-    this->state = PROCESS_RUNNING;
-
-    // Adding to process queue, scheduler will do the rest
-    atomic_procedure([this](){
-        process_queue.push(this);
-    });
+    // Adding to the run queue of the least loaded CPU, scheduler will do the rest
+    sched::add(this);
 }
 
 void Process::exit(void) {
     // IMPORTANT: Do NOT free the stack here. We are currently running on it!
     // The scheduler will handle the cleanup (Zombie Reaping).
     this->state = PROCESS_TERMINATED;
+    fpu::release(this);
     
     // Trigger reschedule - will never return
     sched::schedule();
@@ -128,9 +126,14 @@ void Process::yield(void) {
 context_t* Process::get_ctx() { return &this->ctx; }
 void* Process::get_stack() { return this->stack; }
 pd_t* Process::get_pd() { return this->pd; }
+void* Process::get_fpu_state() { return this->fpu_state; }
 uint32_t Process::get_pid() { return this->pid; }
 uint32_t Process::get_priority() { return this->priority; }
 uint32_t Process::get_time_slice() { return this->time_slice; }
+uint32_t Process::get_effective_priority() { return min(this->priority + this->boost, PROCESS_MAX_PRIORITY); }
+uint32_t Process::get_boost() { return this->boost; }
+uint64_t Process::get_ready_since() { return this->ready_since; }
+uint32_t Process::get_cpu() { return this->cpu; }
 const char* Process::get_name() { return this->name; }
 ProcessState Process::get_state() { return this->state; }
 
@@ -138,3 +141,7 @@ void Process::set_time_slice() { this->time_slice = TIME_QUANTUM * this->priorit
 void Process::decrement_time_slice() { if(this->time_slice > 0) this->time_slice--; }
 void Process::set_state(ProcessState state) { this->state = state; }
 void Process::set_priority(uint8_t p) { priority = p; }
+void Process::set_fpu_state(void* state) { fpu_state = state; }
+void Process::set_boost(uint32_t b) { boost = b; }
+void Process::set_ready_since(uint64_t tick) { ready_since = tick; }
+void Process::set_cpu(uint32_t c) { cpu = c; }
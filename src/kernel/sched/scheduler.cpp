@@ -9,18 +9,25 @@
 #include <sched/scheduler.hpp>
 #include <x86/sched/context.hpp>
 #include <x86/interrupts/idt.hpp>
+#include <x86/fpu.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
 #include <graphics/vga_print.hpp>
 #include <drivers/vga.hpp>
 #include <mm/pmm.hpp>
+#include <drivers/pit.hpp>
+#include <sched/timer.hpp>
+#include <sched/sync.hpp>
+#include <sched/workqueue.hpp>
 
-Process* curr_process;
-data::queue<Process*> process_queue;
-static data::queue<Process*> zombie_queue; // Processes waiting to be reaped
+RunQueue run_queues[SMP_MAX_CPUS];
+static process_queue zombie_queue; // Processes waiting to be reaped
+static WaitQueue zombie_waiters;   // The reaper sleeps here while there's nothing to reap, its lock guards zombie_queue
 
-/// Idle process used to have a valid curr_process when nothing else runs
+/// Idle process used to have a valid current process when nothing else runs
 static void kernel_idle(void) {
     for (;;) {
+        // Using idle time to zero frames ahead of time, halting once the pool is full. Only the boot CPU fills the pool
+        if (smp::cpu_index() == 0 && pmm::refill_zero_pool()) continue;
         asm volatile("sti"); 
         asm volatile("hlt");
     }
@@ -28,102 +35,426 @@ static void kernel_idle(void) {
 
 void dump_process(Process process);
 
-static Process* kernel_idle_process;
+#pragma region Run Queues
+
+// Returns the run queue level of a process
+static inline uint32_t level_of(Process* proc) {
+    return proc->get_effective_priority() - PROCESS_MIN_PRIORITY;
+}
+
+// Returns the highest level with a ready process, ready_levels can't be 0
+static inline uint32_t highest_level(RunQueue* rq) {
+    uint32_t level;
+    asm("bsr %1, %0" : "=r"(level) : "rm"(rq->ready_levels));
+    return level;
+}
+
+// Pops the first process of a level
+static Process* dequeue(RunQueue* rq, const uint32_t level) {
+    Process* proc = rq->levels[level].pop();
+    if (rq->levels[level].empty()) rq->ready_levels &= ~(1 << level);
+    return proc;
+}
+
+// Returns if a process waits on a higher level than the running one, the idle process gives way to anyone
+static inline bool higher_ready(RunQueue* rq, Process* proc) {
+    if (proc == rq->idle) return rq->ready_levels != 0;
+    return (rq->ready_levels >> (level_of(proc) + 1)) != 0;
+}
+
+// Puts a process at the back of its level, the queue has to be locked
+static void push_ready(RunQueue* rq, Process* proc) {
+    if (proc == rq->idle) return;
+
+    uint32_t level = level_of(proc);
+    proc->set_state(PROCESS_READY);
+    proc->set_ready_since(ticks);
+    rq->levels[level].push(proc);
+    rq->ready_levels |= 1 << level;
+}
+
+// Locks the running CPU's run queue with interrupts off, so the running process can't be switched out in between
+static RunQueue* lock_this_queue(uint32_t* flags) {
+    asm volatile("pushf; pop %0; cli" : "=r"(*flags) :: "memory");
+    RunQueue* rq = &run_queues[smp::cpu_index()];
+    rq->lock.lock();
+    return rq;
+}
+
+static inline void unlock_queue(RunQueue* rq, const uint32_t flags) {
+    rq->lock.unlock_irqrestore(flags);
+}
+
+// Hands a terminated process to the reaper, once no CPU runs on its stack anymore
+static void bury(Process* proc) {
+    if (!proc) return;
+    uint32_t flags = zombie_waiters.lock.lock_irqsave();
+    zombie_queue.push(proc);
+    zombie_waiters.wake_all_locked();
+    zombie_waiters.lock.unlock_irqrestore(flags);
+}
+
+/// @brief Puts a process at the back of its level's run queue, on the CPU it's placed on
+void sched::enqueue(Process* proc) {
+    RunQueue* rq = &run_queues[proc->get_cpu()];
+    uint32_t flags = rq->lock.lock_irqsave();
+    push_ready(rq, proc);
+    rq->lock.unlock_irqrestore(flags);
+}
+
+/// @brief Places a new process on the least loaded CPU and queues it there
+void sched::add(Process* proc) {
+    // Loads are read without locks, a slightly stale one only makes the placement a bit less even
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < SMP_MAX_CPUS; i++) {
+        if (!smp::cpus[i].online) continue;
+        if (run_queues[i].load < run_queues[best].load) best = i;
+    }
+
+    RunQueue* rq = &run_queues[best];
+    uint32_t flags = rq->lock.lock_irqsave();
+    proc->set_cpu(best);
+    rq->load++;
+    push_ready(rq, proc);
+    rq->lock.unlock_irqrestore(flags);
+}
+
+/* Moves processes that waited SCHED_AGING_TICKS at the front of their queue up a level, so busy high
+ * priority processes can't starve low ones. Only queue heads are looked at, so a pass is O(levels) */
+static void age(RunQueue* rq) {
+    uint32_t levels = rq->ready_levels & ~(1 << (SCHED_LEVELS - 1));
+    while (levels) {
+        uint32_t level = __builtin_ctz(levels);
+        levels &= levels - 1;
+
+        Process* head = rq->levels[level].front();
+        if (ticks - head->get_ready_since() < SCHED_AGING_TICKS) continue;
+        dequeue(rq, level);
+        head->set_boost(head->get_boost() + 1);
+        push_ready(rq, head);
+    }
+}
+
+#pragma endregion
+
+#pragma region Work Stealing
+
+/* Migration cost heuristic, moving a process costs its warm cache and TLB entries on the old CPU.
+ * Processes that ran less than SCHED_MIGRATION_TICKS ago stay, and so do processes whose
+ * registers the victim still holds: the one it last switched away from and its FPU owner */
+static inline bool can_migrate(RunQueue* victim, const uint32_t cpu, Process* proc) {
+    if (ticks - proc->get_ready_since() < SCHED_MIGRATION_TICKS) return false;
+    return proc != victim->prev && !fpu::held_by(cpu, proc);
+}
+
+// Returns if another CPU has processes waiting, read without locks
+static bool work_elsewhere(const uint32_t self) {
+    for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i != self && smp::cpus[i].online && run_queues[i].ready_levels) return true;
+    }
+    return false;
+}
+
+/* Takes a process from another CPU's queue for an idle CPU, whose own queue has to be locked.
+ * The busiest CPUs are tried first. Their locks are only tried, so two CPUs stealing from each
+ * other can't deadlock. Queue heads waited longest, so they're the only ones looked at.
+ * Run queues aren't lock-free deques since a process sits in one of SCHED_LEVELS levels that a single
+ * deque per CPU can't order, and a failed try_lock already keeps thieves off a busy owner's queue */
+static Process* steal(RunQueue* rq) {
+    uint32_t self = smp::cpu_index();
+    uint32_t tried = 1 << self;
+
+    for (;;) {
+        // Busiest CPU that wasn't tried yet and has processes waiting
+        uint32_t victim_cpu = SMP_MAX_CPUS;
+        for (uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+            if ((tried & (1 << i)) || !smp::cpus[i].online || !run_queues[i].ready_levels) continue;
+            if (victim_cpu == SMP_MAX_CPUS || run_queues[i].load > run_queues[victim_cpu].load) victim_cpu = i;
+        }
+        if (victim_cpu == SMP_MAX_CPUS) return nullptr;
+        tried |= 1 << victim_cpu;
+
+        RunQueue* victim = &run_queues[victim_cpu];
+        if (!victim->lock.try_lock()) continue;
+
+        uint32_t levels = victim->ready_levels;
+        while (levels) {
+            uint32_t level = 31 - __builtin_clz(levels);
+            levels &= ~(1 << level);
+
+            Process* proc = victim->levels[level].front();
+            if (!can_migrate(victim, victim_cpu, proc)) continue;
+
+            dequeue(victim, level);
+            victim->load--;
+            victim->stolen++;
+            victim->lock.unlock();
+
+            proc->set_cpu(self);
+            rq->load++;
+            rq->steals++;
+            return proc;
+        }
+        victim->lock.unlock();
+    }
+}
+
+#pragma endregion
+
+/// @brief Creates the idle process of a CPU, APs boot on its stack
+Process* sched::create_idle(const uint32_t cpu) {
+    Process* idle = Process::create(kernel_idle, 1, "Kernel Idle Process");
+    if (!idle || idle->get_pid() == KERNEL_ERROR_PID) return nullptr;
+    // The idle process never sits in a run queue, it runs whenever it's empty
+    idle->set_cpu(cpu);
+    run_queues[cpu].idle = idle;
+    return idle;
+}
+
+/// @brief Frees the idle process of a CPU that didn't start
+void sched::destroy_idle(const uint32_t cpu) {
+    Process* idle = run_queues[cpu].idle;
+    run_queues[cpu].idle = nullptr;
+    Process::destroy(idle);
+}
+
+/// @brief Makes the idle process the running one on an AP, never returns
+void sched::run_idle() {
+    Process* idle = run_queues[smp::cpu_index()].idle;
+    idle->set_state(PROCESS_RUNNING);
+    smp::this_cpu()->current = idle;
+    kernel_idle();
+    for (;;) asm volatile("hlt");
+}
+
 /// @brief Initializes scheduler
 void sched::init() {
-    // Creating kernel idle process to keep scheduler busy
-    kernel_idle_process = Process::create(kernel_idle, 1, "Kernel Idle Process");
-    curr_process = kernel_idle_process;
-    curr_process->start();
+    // Creating kernel idle process to keep scheduler busy, from here on the boot context is it
+    Process* idle = create_idle(0);
+    if(!idle) {
+        kprintf(LOG_ERROR, "Failed to initialize Scheduler! (Couldn't create kernel idle process)\n");
+        kernel_panic("Fatal component failed to initialize!");
+    }
+    idle->set_state(PROCESS_RUNNING);
+    smp::this_cpu()->current = idle;
 
     Process* zombie_reaper = Process::create(sched::zombie_reaper, 1, "Zombie Process Reaper");
     zombie_reaper->start();
     
-    if(!curr_process || curr_process->get_pid() == KERNEL_ERROR_PID) {
-        kprintf(LOG_ERROR, "Failed to initialize Scheduler! (Couldn't create kernel idle process)\n");
-        kernel_panic("Fatal component failed to initialize!");
-    }
-    else kprintf(LOG_INFO, "Implemented Scheduler\n");
+    kprintf(LOG_INFO, "Implemented Scheduler with %u priority levels on %u CPU(s)\n", SCHED_LEVELS, smp::cpu_count);
     sched::schedule();
 }
 
 /// @brief Terminates zombie processes, will run on seperate kernel thread
 void sched::zombie_reaper() {
     while (true) {
-        Process* z = nullptr;
-        asm volatile("cli");
-        if (!zombie_queue.empty()) {
-            z = zombie_queue.pop();
+        // Sleeping until bury() hands over a zombie
+        uint32_t flags = zombie_waiters.lock.lock_irqsave();
+        while (zombie_queue.empty()) zombie_waiters.wait_locked(flags, 0);
+        Process* z = zombie_queue.pop();
+        zombie_waiters.lock.unlock_irqrestore(flags);
+
+        // kprintf(RGB_COLOR_GREEN, "Reaping process %u (%s)\n", z->get_pid(), z->get_name());
+        if (z->get_stack()) {
+            pmm::free_frame(z->get_stack());
         }
-        asm volatile("sti");
-
-        // If we found a zombie, free it
-        if (z) {
-            // kprintf(RGB_COLOR_GREEN, "Reaping process %u (%s)\n", z->get_pid(), z->get_name());
-            if (z->get_stack()) {
-                pmm::free_frame(z->get_stack());
-            }
-            kfree(z);
-        } 
-        else {
-            Process::yield();
+        if (z->get_fpu_state()) {
+            kfree(z->get_fpu_state());
         }
+        kfree(z);
     }
 }
 
 void sched::exit_current_process() {
-    if (!curr_process || curr_process->get_pid() == 0) {
+    Process* curr = current();
+    if (!curr || curr == run_queues[curr->get_cpu()].idle) {
         return; // Can't exit idle process
     }
 
     // Just call exit on the process, it handles state change and schedule call
-    curr_process->exit();
+    curr->exit();
+}
+
+/// @brief Called by the timer every tick on every CPU, ages waiting processes and preempts the current one
+void sched::tick() {
+    Process* curr = current();
+    if (!curr) return;
+
+    uint32_t flags;
+    RunQueue* rq = lock_this_queue(&flags);
+    // A process that terminated while nothing else was ready is buried from here
+    Process* dead = rq->dead;
+    rq->dead = nullptr;
+
+    if (++rq->ticks % SCHED_AGING_INTERVAL == 0) age(rq);
+
+    bool preempt = false;
+    if (curr->get_state() == PROCESS_RUNNING) {
+        curr->decrement_time_slice();
+        // Rescheduling when the time slice expired or a higher priority process became ready
+        preempt = curr->get_time_slice() == 0 || higher_ready(rq, curr);
+        // An idle CPU looks for work to steal every tick
+        if (curr == rq->idle && !rq->ready_levels) preempt = work_elsewhere(smp::cpu_index());
+    }
+    unlock_queue(rq, flags);
+
+    bury(dead);
+    if (preempt) sched::schedule();
 }
 
 void sched::schedule() {
-    if(!curr_process) {
+    if(!current()) {
         return;
     }
 
-    Process* old_process = curr_process;
+    // Run queues are also changed by the timer and by other CPUs
+    uint32_t flags;
+    RunQueue* rq = lock_this_queue(&flags);
+    Process* dead = rq->dead;
+    rq->dead = nullptr;
+
+    Process* old_process = current();
+    bool old_runnable = old_process->get_state() == PROCESS_RUNNING && old_process != rq->idle;
     Process* next = nullptr;
 
-    // 2. SELECT NEXT PROCESS
-    if (!process_queue.empty()) {
-        // Standard Round Robin: Pop the head. 
-        // We will push old_process to the tail later if it's still running.
-        next = process_queue.pop(); 
+    // 1. SELECT NEXT PROCESS
+    // The highest non-empty level wins, processes of the same level take turns
+    if (rq->ready_levels && (!old_runnable || highest_level(rq) >= level_of(old_process))) {
+        next = dequeue(rq, highest_level(rq));
     }
 
-    // 3. HANDLE NO NEXT PROCESS FOUND
+    // 2. HANDLE NO NEXT PROCESS FOUND
     if (!next) {
-        // If queue is empty, checks if the OLD process can still run
-        if (old_process->get_state() == PROCESS_RUNNING && old_process != kernel_idle_process) {
+        // Nothing of the same or a higher level is ready, so the old process keeps running
+        if (old_runnable) {
             old_process->set_time_slice();
+            unlock_queue(rq, flags);
+            bury(dead);
             return;
         }
         
-        next = kernel_idle_process;
+        // Idling only when no other CPU has a process to spare
+        next = smp::cpu_count > 1 ? steal(rq) : nullptr;
+        if (!next) next = rq->idle;
     }
 
-    // 4. UPDATE OLD PROCESS STATE
-    if(old_process->get_state() == PROCESS_RUNNING) {
-        // If it was running, and we are switching away, put it back in queue (Tail)
-        if (old_process != next && old_process != kernel_idle_process) {
-            process_queue.push(old_process);
-        }
+    // 3. UPDATE OLD PROCESS STATE
+    if (old_runnable) {
+        // Back to the tail of its own level
+        push_ready(rq, old_process);
     }
     else if (old_process->get_state() == PROCESS_TERMINATED) {
-        // Mark for reaping
-        zombie_queue.push(old_process);
+        // Reaped once the switch is done, until then we're still on its stack
+        rq->load--;
+        rq->dead = old_process;
     }
 
-    // 5. CONTEXT SWITCH
+    // 4. CONTEXT SWITCH
+    // Running drops the aging boost, the process goes back to its own level afterwards
+    next->set_boost(0);
     next->set_state(PROCESS_RUNNING);
     next->set_time_slice();
-    curr_process = next;
+    smp::this_cpu()->current = next;
+    if (old_process != next) rq->prev = old_process;
+
+    // Interrupts stay off until the switch is done, so nothing on this CPU sees the old process half saved
+    rq->lock.unlock();
+    bury(dead);
 
     if (old_process != next) {
-        ctx_switch(old_process->get_ctx(), next->get_ctx());
+        // The FPU registers are switched lazily, the next FPU instruction traps if they belong to someone else
+        fpu::switch_to(next);
+        // Kernel threads in one address space only swap callee-saved registers and stacks
+        context_t* old_ctx = old_process->get_ctx();
+        context_t* next_ctx = next->get_ctx();
+        if (ctx_can_switch_fast(old_ctx, next_ctx)) ctx_switch_fast(old_ctx, next_ctx);
+        else ctx_switch(old_ctx, next_ctx);
+    }
+
+    if (flags & 0x200) asm volatile("sti" ::: "memory");
+}
+
+#pragma region Blocking
+
+// Timer callback of blocked processes
+static void wake_timer(void* data) {
+    sched::wake((Process*)data);
+}
+
+/// @brief Blocks the current process until sched::wake or tick <deadline> (0 waits without a timeout)
+/// @param lock Released once the process is marked blocked, so a waker that takes it can't be missed. Isn't taken again
+/// @return False if the deadline came first
+bool sched::block(Spinlock* lock, const uint64_t deadline) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+
+    // Work queued behind a sleeping work item would wait for as long as it sleeps
+    if (work::in_work()) kernel_panic("Work item tried to sleep in the kernel worker!");
+
+    // Blocked before the timer is armed, so a wake from another CPU can't slip in between and get lost
+    Process* curr = current();
+    curr->set_state(PROCESS_BLOCKED);
+    Timer timeout = {};
+    if (deadline) timer::add(&timeout, deadline, wake_timer, curr);
+    if (lock) lock->unlock();
+    schedule();
+    // A pending timer means something else woke us
+    bool woken = !deadline || timer::cancel(&timeout);
+
+    if (flags & 0x200) asm volatile("sti" ::: "memory");
+    return woken;
+}
+
+/// @brief Returns if the current context may block (a process other than idle, with interrupts on)
+bool sched::can_block() {
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r"(flags));
+    return can_block(flags);
+}
+
+/// @brief Same, but with interrupts judged by <flags>, like the ones lock_irqsave returns
+bool sched::can_block(const uint32_t flags) {
+    Process* curr = current();
+    return curr && curr != run_queues[curr->get_cpu()].idle && (flags & 0x200);
+}
+
+/// @brief Blocks the current process for at least <ms> milliseconds, other processes run meanwhile
+void sched::sleep_ms(const uint64_t ms) {
+    uint64_t target = ticks + timer::ms_to_ticks(ms);
+    if (!can_block()) {
+        pit::delay(ms);
+        return;
+    }
+    // Early wakes just block again for the rest
+    while (ticks < target) block(nullptr, target);
+}
+
+/// @brief Blocks the current process until sched::wake or until <ms> milliseconds pass
+/// @return False on timeout
+bool sched::block_timeout(const uint64_t ms) {
+    if (!can_block()) return false;
+    return block(nullptr, ticks + timer::ms_to_ticks(ms));
+}
+
+/// @brief Makes a blocked process ready again, safe to call from interrupt handlers and other CPUs
+void sched::wake(Process* proc) {
+    // A process only moves while its CPU's queue is locked, so its CPU is checked again once it is
+    uint32_t cpu, flags;
+    RunQueue* rq;
+    for (;;) {
+        cpu = proc->get_cpu();
+        rq = &run_queues[cpu];
+        flags = rq->lock.lock_irqsave();
+        if (proc->get_cpu() == cpu) break;
+        rq->lock.unlock_irqrestore(flags);
     }
+
+    if (proc->get_state() == PROCESS_BLOCKED) {
+        // Woken before it got to switch away, it just keeps running
+        if (smp::cpus[cpu].current == proc) proc->set_state(PROCESS_RUNNING);
+        else push_ready(rq, proc);
+    }
+    rq->lock.unlock_irqrestore(flags);
 }
+
+#pragma endregion
@@ -0,0 +1,165 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// sync.cpp
+// Wait queues, semaphores and mutexes for processes
+// ========================================
+
+#include <sched/sync.hpp>
+#include <sched/scheduler.hpp>
+#include <drivers/pit.hpp>
+#include <sched/timer.hpp>
+
+#pragma region Wait Queues
+
+/// @brief Blocks until woken or tick <deadline> (0 waits forever), <lock> has to be held with lock_irqsave
+/// @param flags EFLAGS lock_irqsave returned
+/// @return False on timeout
+bool WaitQueue::wait_locked(const uint32_t flags, const uint64_t deadline) {
+    if (deadline && ticks >= deadline) return false;
+
+    WaitQueueEntry entry = {};
+    bool in_time;
+    if (sched::can_block(flags)) {
+        entry.proc = sched::current();
+        waiters.push(&entry);
+        in_time = sched::block(&lock, deadline);
+        lock.lock();
+    }
+    else {
+        // Before the scheduler runs, in the idle process or with interrupts off the entry is polled
+        waiters.push(&entry);
+        while (!entry.woken && (!deadline || ticks < deadline)) {
+            lock.unlock_irqrestore(flags);
+            if (flags & 0x200) pit::delay(1);
+            else asm volatile("pause");
+            lock.lock_irqsave();
+        }
+        in_time = entry.woken;
+    }
+
+    // A waker takes the entry out itself, timeouts and other wakes leave it in
+    if (!entry.woken) waiters.remove(&entry);
+    return entry.woken || in_time;
+}
+
+/// @brief Blocks until woken or <ms> milliseconds pass (0 waits forever)
+/// @return False on timeout
+bool WaitQueue::wait(const uint64_t ms) {
+    uint32_t flags = lock.lock_irqsave();
+    bool woken = wait_locked(flags, ms ? ticks + timer::ms_to_ticks(ms) : 0);
+    lock.unlock_irqrestore(flags);
+    return woken;
+}
+
+/// @brief Wakes the first waiter, <lock> has to be held. Returns false if nobody waited
+bool WaitQueue::wake_one_locked(void) {
+    WaitQueueEntry* entry = waiters.pop();
+    if (!entry) return false;
+    // The waiter takes the lock before it returns, so its entry stays valid until we let go
+    entry->woken = true;
+    if (entry->proc) sched::wake(entry->proc);
+    return true;
+}
+
+/// @brief Wakes every waiter, <lock> has to be held
+void WaitQueue::wake_all_locked(void) {
+    while (wake_one_locked());
+}
+
+bool WaitQueue::wake_one(void) {
+    uint32_t flags = lock.lock_irqsave();
+    bool woken = wake_one_locked();
+    lock.unlock_irqrestore(flags);
+    return woken;
+}
+
+void WaitQueue::wake_all(void) {
+    uint32_t flags = lock.lock_irqsave();
+    wake_all_locked();
+    lock.unlock_irqrestore(flags);
+}
+
+#pragma endregion
+
+#pragma region Semaphores
+
+/// @brief Takes one unit, blocking until there is one or <ms> milliseconds pass (0 waits forever)
+/// @return False on timeout
+bool Semaphore::wait(const uint64_t ms) {
+    uint64_t deadline = ms ? ticks + timer::ms_to_ticks(ms) : 0;
+    uint32_t flags = waiters.lock.lock_irqsave();
+    while (!count) {
+        if (!waiters.wait_locked(flags, deadline)) {
+            waiters.lock.unlock_irqrestore(flags);
+            return false;
+        }
+    }
+    count--;
+    waiters.lock.unlock_irqrestore(flags);
+    return true;
+}
+
+/// @brief Takes one unit if there is one
+bool Semaphore::try_wait(void) {
+    uint32_t flags = waiters.lock.lock_irqsave();
+    bool taken = count > 0;
+    if (taken) count--;
+    waiters.lock.unlock_irqrestore(flags);
+    return taken;
+}
+
+/// @brief Gives one unit back and wakes a waiter, safe from interrupt handlers
+void Semaphore::post(void) {
+    uint32_t flags = waiters.lock.lock_irqsave();
+    count++;
+    waiters.wake_one_locked();
+    waiters.lock.unlock_irqrestore(flags);
+}
+
+#pragma endregion
+
+#pragma region Mutexes
+
+// Returns if the owner is running on a CPU right now, read without locks
+bool Mutex::owner_running(void) {
+    Process* proc = owner;
+    return proc && smp::cpus[proc->get_cpu()].current == proc;
+}
+
+/// @brief Takes the mutex, spinning while its owner runs and blocking after that
+void Mutex::lock(void) {
+    // A running owner likely unlocks before blocking would pay off
+    for (uint32_t i = 0; i < MUTEX_SPIN_LIMIT && locked && owner_running(); i++) asm volatile("pause");
+
+    uint32_t flags = waiters.lock.lock_irqsave();
+    // Woken lockers compete with new ones, so the lock is checked again every time
+    while (locked) waiters.wait_locked(flags, 0);
+    locked = true;
+    owner = sched::current();
+    waiters.lock.unlock_irqrestore(flags);
+}
+
+/// @brief Takes the mutex if it's free
+bool Mutex::try_lock(void) {
+    uint32_t flags = waiters.lock.lock_irqsave();
+    bool taken = !locked;
+    if (taken) {
+        locked = true;
+        owner = sched::current();
+    }
+    waiters.lock.unlock_irqrestore(flags);
+    return taken;
+}
+
+/// @brief Releases the mutex and wakes the first waiter
+void Mutex::unlock(void) {
+    uint32_t flags = waiters.lock.lock_irqsave();
+    locked = false;
+    owner = nullptr;
+    waiters.wake_one_locked();
+    waiters.lock.unlock_irqrestore(flags);
+}
+
+#pragma endregion
@@ -0,0 +1,138 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// timer.cpp
+// Hierarchical timer wheel driven by the PIT
+// ========================================
+
+#include <sched/timer.hpp>
+#include <drivers/pit.hpp>
+#include <sched/spinlock.hpp>
+#include <lib/math.hpp>
+
+// Every slot is a doubly linked list of timers
+static Timer* wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t wheel_base = 0; // Next tick the wheel processes
+static Spinlock wheel_lock;     // Timers are armed from every CPU, the boot CPU runs them
+static Timer* running = nullptr; // Timer whose callback runs right now, guarded by wheel_lock
+
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+#define SLOT_OF(tick, level) (((tick) >> LEVEL_SHIFT(level)) & (TIMER_WHEEL_SLOTS - 1))
+
+#pragma region Helpers
+
+static inline uint32_t save_irq(void) {
+    return wheel_lock.lock_irqsave();
+}
+
+static inline void restore_irq(const uint32_t flags) {
+    wheel_lock.unlock_irqrestore(flags);
+}
+
+// Puts a timer into the slot its distance from the wheel base belongs to
+static void place(Timer* t) {
+    uint64_t expires = t->expires;
+    uint64_t distance = expires > wheel_base ? expires - wheel_base : 0;
+    if(distance == 0) expires = wheel_base;
+
+    uint32_t level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && distance >= (1ULL << LEVEL_SHIFT(level + 1))) level++;
+    // Beyond the last level, the timer waits in its furthest slot and gets placed again when that comes up
+    if(distance >= (1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS))) expires = wheel_base + (1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1;
+
+    Timer** slot = &wheel[level][SLOT_OF(expires, level)];
+    t->slot = slot;
+    t->prev = nullptr;
+    t->next = *slot;
+    if(*slot) (*slot)->prev = t;
+    *slot = t;
+}
+
+// Removes a timer from its slot
+static void remove(Timer* t) {
+    if(t->prev) t->prev->next = t->next;
+    else *t->slot = t->next;
+    if(t->next) t->next->prev = t->prev;
+    t->next = t->prev = nullptr;
+}
+
+// Spreads a slot of a higher level into the levels below, returns the slot index
+static uint32_t cascade(const uint32_t level) {
+    uint32_t index = SLOT_OF(wheel_base, level);
+    Timer* t = wheel[level][index];
+    wheel[level][index] = nullptr;
+
+    while(t) {
+        Timer* next = t->next;
+        place(t);
+        t = next;
+    }
+    return index;
+}
+
+#pragma endregion
+
+/// @brief Arms a timer to run <callback> at tick <expires>, timers in the past run on the next tick
+void timer::add(Timer* t, const uint64_t expires, void (*callback)(void*), void* data) {
+    uint32_t flags = save_irq();
+    if(t->pending) remove(t);
+
+    t->expires = expires;
+    t->callback = callback;
+    t->data = data;
+    t->pending = true;
+    place(t);
+    restore_irq(flags);
+}
+
+/// @brief Disarms a timer, returns if it was still pending. Waits for its callback if that runs on another CPU
+bool timer::cancel(Timer* t) {
+    uint32_t flags = save_irq();
+    bool was_pending = t->pending;
+    if(was_pending) remove(t);
+    t->pending = false;
+    // The owner may let the timer and the callback's data go once this returns, so the callback has to be done
+    while(running == t) {
+        restore_irq(flags);
+        asm volatile("pause");
+        flags = save_irq();
+    }
+    restore_irq(flags);
+    return was_pending;
+}
+
+/// @brief Runs every timer that's due, called by the PIT every tick
+void timer::tick(void) {
+    uint32_t flags = save_irq();
+    while(wheel_base <= ticks) {
+        uint32_t index = SLOT_OF(wheel_base, 0);
+        // Level n's current slot comes up every time level n-1 wraps around
+        if(index == 0) {
+            for(uint32_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+                if(cascade(level) != 0) break;
+        }
+        wheel_base++;
+
+        /* Timers are taken off the slot one at a time and run without the lock, callbacks may arm timers
+         * again. Marked as running, timer::cancel waits for the callback before its owner can let it go */
+        while(wheel[0][index]) {
+            Timer* t = wheel[0][index];
+            remove(t);
+            t->pending = false;
+            void (*callback)(void*) = t->callback;
+            void* data = t->data;
+            running = t;
+            restore_irq(flags);
+            callback(data);
+            flags = save_irq();
+            running = nullptr;
+        }
+    }
+    restore_irq(flags);
+}
+
+/// @brief Converts milliseconds to PIT ticks
+uint64_t timer::ms_to_ticks(const uint64_t ms) {
+    return udiv64(ms * frequency, 1000);
+}
@@ -0,0 +1,93 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// workqueue.cpp
+// Runs work interrupt handlers defer in a kernel worker thread
+// ========================================
+
+#include <sched/workqueue.hpp>
+#include <sched/scheduler.hpp>
+#include <sched/sync.hpp>
+#include <graphics/vga_print.hpp>
+
+static data::intrusive_list<Work, &Work::node> pending_work;
+static WaitQueue work_waiters;               // The worker sleeps here while there's no work, its lock guards pending_work
+static volatile bool worker_running = false; // One worker, so work never runs concurrently with other work
+static bool draining = false;                // Work is being run outside the worker
+static Process* worker = nullptr;
+static volatile bool worker_busy = false;    // The worker runs a work item, it may only block between items
+
+#pragma region Helpers
+
+// Runs the first queued work with the lock released, returns false if there was none. The lock is held on return
+static bool run_next(uint32_t* flags) {
+    Work* w = pending_work.pop();
+    if(!w) return false;
+
+    // Once it isn't pending its owner may queue it again with something else, so it's read before that
+    void (*func)(void*) = w->func;
+    void* data = w->data;
+    w->pending = false;
+    work_waiters.lock.unlock_irqrestore(*flags);
+    func(data);
+    *flags = work_waiters.lock.lock_irqsave();
+    return true;
+}
+
+// Kernel worker, runs with interrupts on and sleeps while there's nothing to do
+static void worker_main(void) {
+    uint32_t flags = work_waiters.lock.lock_irqsave();
+    // From here on queued work is handed over, whatever is being run outside the worker finishes first
+    worker_running = true;
+    for(;;) {
+        while(pending_work.empty() || draining) work_waiters.wait_locked(flags, 0);
+        worker_busy = true;
+        run_next(&flags);
+        worker_busy = false;
+    }
+}
+
+#pragma endregion
+
+/// @brief Creates the kernel worker, work is run right away until it starts
+void work::init(void) {
+    Process* proc = Process::create(worker_main, WORK_WORKER_PRIORITY, "Kernel Worker");
+    if(!proc || proc->get_pid() == KERNEL_ERROR_PID) {
+        kprintf(LOG_WARNING, "Couldn't create the kernel worker, deferred work runs in interrupts\n");
+        return;
+    }
+    worker = proc;
+    worker->start();
+    kprintf(LOG_INFO, "Implemented work queue for deferred interrupt work\n");
+}
+
+/// @brief Queues <func> to run with <data> in the kernel worker, safe from interrupt handlers
+/// @return False if the work was still pending
+bool work::queue(Work* w, void (*func)(void*), void* data) {
+    uint32_t flags = work_waiters.lock.lock_irqsave();
+    if(w->pending) {
+        work_waiters.lock.unlock_irqrestore(flags);
+        return false;
+    }
+
+    w->func = func;
+    w->data = data;
+    w->pending = true;
+    pending_work.push(w);
+
+    if(worker_running) work_waiters.wake_one_locked();
+    else if(!draining) {
+        // Until the worker runs the work is run right away, work queued meanwhile runs after it
+        draining = true;
+        while(run_next(&flags));
+        draining = false;
+    }
+    work_waiters.lock.unlock_irqrestore(flags);
+    return true;
+}
+
+/// @brief Returns if the current process is the kernel worker running a work item
+bool work::in_work(void) {
+    return worker_busy && sched::current() == worker;
+}
@@ -0,0 +1,45 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// apic_u_test.cpp
+// Is in charge of unit testing LAPIC/IOAPIC setup and the LAPIC timer tick
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <drivers/pit.hpp>
+#include <x86/interrupts/apic.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+void unittsts::test_apic(void) {
+    if(!apic::enabled) {
+        kprintf(LOG_WARNING, "APIC test skipped, using the 8259 PIC\n");
+        return;
+    }
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // The boot CPU has to be one of the CPUs the MADT lists
+    bool listed = false;
+    for(uint32_t i = 0; i < apic::cpu_count; i++)
+        if(apic::cpu_ids[i] == apic::get_id()) listed = true;
+    if(!listed) {
+        kprintf(LOG_ERROR, "APIC Test 1 failed: boot CPU (LAPIC ID %u) isn't in the MADT!\n", apic::get_id());
+        passed = false; // Noting that the test failed
+    }
+
+    // Ticks have to keep coming with the PIT masked, waiting without hlt so a dead timer can't hang the test
+    if(apic::timer_enabled) {
+        uint64_t start = ticks;
+        for(uint32_t spins = 0; ticks - start < 5 && spins < 0x10000000; spins++) asm volatile("pause");
+        if(ticks - start < 5) {
+            kprintf(LOG_ERROR, "APIC Test 2 failed: LAPIC timer doesn't tick!\n");
+            passed = false; // Noting that the test failed
+        }
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("APIC failed!");
+    kprintf(LOG_INFO, "APIC test passed\n");
+}
@@ -0,0 +1,107 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// context_u_test.cpp
+// Is in charge of unit testing both context switch paths
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <sched/process.hpp>
+#include <x86/sched/context.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+#include <mm/heap.hpp>
+
+static context_t test_main_ctx, test_thread_ctx;
+static volatile uint32_t thread_runs;
+static volatile bool thread_fast;
+
+#define CANARY_EBX 0xB0B0B0B0
+#define CANARY_ESI 0x51515151
+#define CANARY_EDI 0xD1D1D1D1
+#define CANARY_EBP 0xEBEBEBEB
+
+// Counts how often it got switched to and switches back with the path under test
+static void test_thread(void) {
+    for(;;) {
+        thread_runs = thread_runs + 1;
+        // Overwriting the callee-saved registers, so a switch that doesn't restore them gets caught
+        asm volatile("xor %%ebx, %%ebx; xor %%esi, %%esi; xor %%edi, %%edi" ::: "ebx", "esi", "edi");
+        if(thread_fast) ctx_switch_fast(&test_thread_ctx, &test_main_ctx);
+        else ctx_switch(&test_thread_ctx, &test_main_ctx);
+    }
+}
+
+/* Switches to the thread and back with canaries in every callee-saved register, returns if they all came back.
+ * The call is made from asm, so the compiler can't keep or recompute the values anywhere else */
+static bool switch_with_canaries(void (*path)(context_t*, context_t*)) {
+    uint32_t ebx, esi, edi, ebp;
+    uint32_t old_ctx = (uint32_t)&test_main_ctx, new_ctx = (uint32_t)&test_thread_ctx;
+    uint32_t target = (uint32_t)path;
+    asm volatile(
+        "push %%ebp\n\t"
+        "mov %[cebx], %%ebx\n\t"
+        "mov %[cesi], %%esi\n\t"
+        "mov %[cedi], %%edi\n\t"
+        "mov %[cebp], %%ebp\n\t"
+        "push %%edx\n\t"
+        "push %%eax\n\t"
+        "call *%%ecx\n\t"
+        "add $8, %%esp\n\t"
+        "mov %%ebp, %%ecx\n\t"
+        "pop %%ebp"
+        : "=&b"(ebx), "=&S"(esi), "=&D"(edi), "+c"(target), "+a"(old_ctx), "+d"(new_ctx)
+        : [cebx] "i"(CANARY_EBX), [cesi] "i"(CANARY_ESI), [cedi] "i"(CANARY_EDI), [cebp] "i"(CANARY_EBP)
+        : "memory", "cc");
+    ebp = target;
+    return ebx == CANARY_EBX && esi == CANARY_ESI && edi == CANARY_EDI && ebp == CANARY_EBP;
+}
+
+// Switches to a new thread <rounds> times with one path, returns if it ran every time and no register got lost
+static bool switch_rounds(const bool fast, void* stack, const uint32_t rounds) {
+    thread_fast = fast;
+    thread_runs = 0;
+    ctx_init_kernel(&test_thread_ctx, (uint32_t)stack + KERNEL_PROCESS_STACK_SIZE, test_thread);
+
+    bool intact = true;
+    for(uint32_t i = 0; i < rounds; i++) {
+        if(!switch_with_canaries(fast ? ctx_switch_fast : ctx_switch)) intact = false;
+    }
+    return thread_runs == rounds && intact;
+}
+
+void unittsts::test_context(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    void* stack = kmalloc(KERNEL_PROCESS_STACK_SIZE);
+    if(!stack) kernel_panic("Context switch test couldn't allocate a stack!");
+
+    // The new thread starts through the fast layout either way
+    if(!switch_rounds(true, stack, 3)) {
+        kprintf(LOG_ERROR, "Context Test 1 failed: fast switches lost the thread or a register!\n");
+        passed = false; // Noting that the test failed
+    }
+    if(!switch_rounds(false, stack, 3)) {
+        kprintf(LOG_ERROR, "Context Test 2 failed: full switches lost the thread or a register!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Only contexts the fast path saved in the same address space may take it
+    context_t a = {}, b = {};
+    a.cs = b.cs = 0x08;
+    b.fast = 1;
+    bool same = ctx_can_switch_fast(&a, &b);
+    b.cr3 = 0x1000;
+    bool other_space = ctx_can_switch_fast(&a, &b);
+    if(!same || other_space || ctx_can_switch_fast(&b, &a)) {
+        kprintf(LOG_ERROR, "Context Test 3 failed: wrong switch path chosen!\n");
+        passed = false; // Noting that the test failed
+    }
+    kfree(stack);
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Context switching failed!");
+    kprintf(LOG_INFO, "Context switch test passed\n");
+}
@@ -0,0 +1,57 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// dma_u_test.cpp
+// Is in charge of unit testing the DMA pool
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <mm/dma.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+void unittsts::test_dma(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Allocating an aligned descriptor
+    DmaBuffer list = dma::alloc(1024, 1024);
+    if(!list.virt || ((uint32_t)list.virt & 1023) || list.phys != (uint32_t)vmm::virtual_to_physical((uint32_t)list.virt)) {
+        kprintf(LOG_ERROR, "DMA Test 1 failed: couldn't allocate aligned buffer! %x\n", list.virt);
+        passed = false; // Noting that the test failed
+    }
+
+    // Small buffers are packed into the same page
+    DmaBuffer small1 = dma::alloc(256, 128);
+    DmaBuffer small2 = dma::alloc(256, 128);
+    if(!small1.virt || !small2.virt || small1.virt == small2.virt ||
+       ((uint32_t)small1.virt & ~(FRAME_SIZE - 1)) != ((uint32_t)small2.virt & ~(FRAME_SIZE - 1))) {
+        kprintf(LOG_ERROR, "DMA Test 2 failed: small buffers weren't packed! %x %x\n", small1.virt, small2.virt);
+        passed = false; // Noting that the test failed
+    }
+
+    // Big buffers get frames of their own
+    DmaBuffer big = dma::alloc(FRAME_SIZE * 2, 16);
+    if(!big.virt || ((uint32_t)big.virt & (FRAME_SIZE - 1)) || big.size != FRAME_SIZE * 2) {
+        kprintf(LOG_ERROR, "DMA Test 3 failed: couldn't allocate big buffer! %x\n", big.virt);
+        passed = false; // Noting that the test failed
+    }
+
+    // Freed units are handed out again
+    dma::free(small2);
+    DmaBuffer small3 = dma::alloc(256, 128);
+    if(small3.virt != small2.virt) {
+        kprintf(LOG_ERROR, "DMA Test 4 failed: couldn't free buffer! %x isn't %x\n", small3.virt, small2.virt);
+        passed = false; // Noting that the test failed
+    }
+
+    // Freeing up memory
+    dma::free(list); dma::free(small1); dma::free(small3); dma::free(big);
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("DMA pool failed!");
+    kprintf(LOG_INFO, "DMA pool test passed\n");
+}
@@ -0,0 +1,76 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// fpu_u_test.cpp
+// Is in charge of unit testing lazy FPU switching and kernel SIMD sections
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <x86/fpu.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline uint32_t read_eflags(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r"(flags));
+    return flags;
+}
+
+void unittsts::test_fpu(void) {
+    if(!fpu::enabled) {
+        kprintf(LOG_WARNING, "FPU test skipped, no FPU\n");
+        return;
+    }
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Nobody owns the FPU after init, so its first user has to trap
+    if(!(read_cr0() & CR0_TS)) {
+        kprintf(LOG_ERROR, "FPU Test 1 failed: CR0.TS isn't set after init!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Sections clear TS and hold off interrupts, nested ones don't end the outer one
+    uint32_t flags = read_eflags();
+    if(fpu::begin()) {
+        fpu::begin();
+        fpu::end();
+        if((read_cr0() & CR0_TS) || (read_eflags() & 0x200)) {
+            kprintf(LOG_ERROR, "FPU Test 2 failed: a nested section ended the outer one!\n");
+            passed = false; // Noting that the test failed
+        }
+        fpu::end();
+        if(!(read_cr0() & CR0_TS) || (read_eflags() & 0x200) != (flags & 0x200)) {
+            kprintf(LOG_ERROR, "FPU Test 2 failed: fpu::end didn't set TS and restore interrupts!\n");
+            passed = false; // Noting that the test failed
+        }
+    }
+    else if(fpu::sse2) {
+        kprintf(LOG_ERROR, "FPU Test 2 failed: fpu::begin failed with SSE2!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // An FPU instruction with TS set goes through the #NM handler and comes back
+    uint64_t restores = fpu::lazy_restores;
+    asm volatile("fnop");
+    if(read_cr0() & CR0_TS) {
+        kprintf(LOG_ERROR, "FPU Test 3 failed: #NM didn't clear CR0.TS!\n");
+        passed = false; // Noting that the test failed
+    }
+    // Without a scheduler there's no process state to load
+    if(fpu::lazy_restores != restores || fpu::get_owner()) {
+        kprintf(LOG_ERROR, "FPU Test 3 failed: #NM loaded state without a process!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("FPU failed!");
+    kprintf(LOG_INFO, "FPU test passed\n");
+}
@@ -9,6 +9,7 @@
 #include <tests/unit_tests.hpp>
 #include <graphics/vga_print.hpp>
 #include <mm/heap.hpp>
+#include <lib/mem_util.hpp>
 #include <x86/interrupts/kernel_panic.hpp>
 
 #ifdef UNIT_TESTS_HPP
@@ -32,8 +33,8 @@ void unittsts::test_heap(void) {
     uint32_t block2 = uint32_t(kmalloc(block_size));
     uint32_t block2_addr = block2;
 
-    // If block2 is equal to block1 plus the difference and plus the metadata size 
-    if(block2 != block1 + block_size + sizeof(HeapBlock)) {
+    // If block2 is equal to block1 plus the aligned difference and plus the metadata size 
+    if(block2 != block1 + align_up(block_size + HEAP_HEADER_SIZE, HEAP_ALIGN)) {
         kprintf(LOG_ERROR, "Heap Test 2 failed: couldn't allocate block2 in heap!\n");
         passed = false; // Noting that the test failed
     }
@@ -50,12 +51,61 @@ void unittsts::test_heap(void) {
         passed = false; // Noting that the test failed
     }
     
+    // Allocating a block aligned past the heaps default alignment
+    uint32_t aligned = uint32_t(kmalloc_aligned(block_size, 256));
+    if(!aligned || (aligned & 255)) {
+        kprintf(LOG_ERROR, "Heap Test 4 failed: couldn't allocate an aligned block! %x\n", aligned);
+        passed = false; // Noting that the test failed
+    }
+
     // Freeing up heap
-    kfree((void*)block1); kfree((void*)block2);
+    kfree((void*)block1); kfree((void*)block2); kfree((void*)aligned);
 
     // If the test failed we will halt the system
     if(!passed) kernel_panic("Heap failed!");
     kprintf(LOG_INFO, "Kernel heap memory manager test passed\n");
 }
 
+// Heap growth unit test, needs the PMM and VMM
+void unittsts::test_heap_growth(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+    size_t extension_before = heap::extension_size;
+
+    // Allocating more than the initial window can hold
+    const size_t chunk_size = HEAP_SIZE / 2;
+    uint8_t* chunks[4];
+    for(uint32_t i = 0; i < 4; i++) {
+        chunks[i] = (uint8_t*)kmalloc(chunk_size);
+        if(!chunks[i]) {
+            kprintf(LOG_ERROR, "Heap Growth Test 1 failed: couldn't allocate chunk %u!\n", i);
+            passed = false; // Noting that the test failed
+        }
+    }
+
+    // The last chunk has to be in the extension and has to be writable
+    if(passed) {
+        if(heap::extension_size == extension_before || uint32_t(chunks[3]) < HEAP_EXT_START) {
+            kprintf(LOG_ERROR, "Heap Growth Test 2 failed: heap didn't grow!\n");
+            passed = false; // Noting that the test failed
+        }
+        memset(chunks[3], 0xAB, chunk_size);
+        if(chunks[3][chunk_size - 1] != 0xAB) {
+            kprintf(LOG_ERROR, "Heap Growth Test 3 failed: couldn't write to the extension!\n");
+            passed = false; // Noting that the test failed
+        }
+    }
+
+    // Freeing everything gives the extension back
+    for(uint32_t i = 0; i < 4; i++) kfree(chunks[i]);
+    if(heap::extension_size != extension_before) {
+        kprintf(LOG_ERROR, "Heap Growth Test 4 failed: extension wasn't trimmed (%x bytes left)!\n", heap::extension_size);
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Heap growth failed!");
+    kprintf(LOG_INFO, "Kernel heap growth test passed\n");
+}
+
 #endif // UNIT_TEST_HPP
@@ -0,0 +1,79 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// mem_util_u_test.cpp
+// Is in charge of unit testing memcpy, memset and memcmp
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <lib/mem_util.hpp>
+#include <mm/vmm.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+#define MEM_TEST_BUFFER (3 * PAGE_SIZE)
+
+alignas(PAGE_SIZE) static uint8_t test_src[MEM_TEST_BUFFER];
+alignas(PAGE_SIZE) static uint8_t test_dest[MEM_TEST_BUFFER];
+
+// Sizes around the word, string and page thresholds
+static const uint32_t test_sizes[] = {0, 1, 3, 7, 8, 9, MEM_STRING_MIN - 1, MEM_STRING_MIN, MEM_STRING_MIN + 5, PAGE_SIZE - 1, PAGE_SIZE, PAGE_SIZE + 1, 2 * PAGE_SIZE + 7};
+
+// Returns the byte expected at <i> after a copy of <size> bytes to offset <offset>, dest starts out as 0xEE
+static inline uint8_t expected(const uint32_t i, const uint32_t offset, const uint32_t src_offset, const uint32_t size) {
+    if(i < offset || i >= offset + size) return 0xEE;
+    return test_src[i - offset + src_offset];
+}
+
+void unittsts::test_mem_util(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+    for(uint32_t i = 0; i < MEM_TEST_BUFFER; i++) test_src[i] = uint8_t(i * 7 + (i >> 8));
+
+    // Every variant copies and fills exactly the requested bytes for any alignment
+    for(uint32_t v = 0; v < mem::VARIANT_COUNT && passed; v++) {
+        for(uint32_t size : test_sizes) {
+            for(uint32_t offset = 0; offset < 4 && passed; offset++) {
+                uint32_t src_offset = (offset * 3) & 3;
+                mem::fill(mem::BYTES, test_dest, 0xEE, MEM_TEST_BUFFER);
+                mem::copy(mem::Variant(v), test_dest + offset, test_src + src_offset, size);
+                for(uint32_t i = 0; i < MEM_TEST_BUFFER; i++) {
+                    if(test_dest[i] != expected(i, offset, src_offset, size)) {
+                        kprintf(LOG_ERROR, "mem_util Test 1 failed: %s copy of %u bytes at offset %u broke byte %u!\n", mem::variant_names[v], size, offset, i);
+                        passed = false; // Noting that the test failed
+                        break;
+                    }
+                }
+
+                mem::fill(mem::BYTES, test_dest, 0xEE, MEM_TEST_BUFFER);
+                mem::fill(mem::Variant(v), test_dest + offset, 0x3C, size);
+                for(uint32_t i = 0; i < MEM_TEST_BUFFER; i++) {
+                    uint8_t want = (i >= offset && i < offset + size) ? 0x3C : 0xEE;
+                    if(test_dest[i] != want) {
+                        kprintf(LOG_ERROR, "mem_util Test 2 failed: %s fill of %u bytes at offset %u broke byte %u!\n", mem::variant_names[v], size, offset, i);
+                        passed = false; // Noting that the test failed
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // memcmp finds the first differing byte, also inside of a word
+    memcpy(test_dest, test_src, MEM_TEST_BUFFER);
+    if(memcmp(test_dest, test_src, MEM_TEST_BUFFER) != 0) {
+        kprintf(LOG_ERROR, "mem_util Test 3 failed: equal buffers compare unequal!\n");
+        passed = false; // Noting that the test failed
+    }
+    test_dest[PAGE_SIZE + 6] = test_src[PAGE_SIZE + 6] + 1;
+    test_dest[PAGE_SIZE + 7] = test_src[PAGE_SIZE + 7] - 1;
+    if(memcmp(test_dest + 1, test_src + 1, MEM_TEST_BUFFER - 1) != 1) {
+        kprintf(LOG_ERROR, "mem_util Test 3 failed: memcmp didn't return the first difference!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("mem_util failed!");
+    kprintf(LOG_INFO, "mem_util test passed\n");
+}
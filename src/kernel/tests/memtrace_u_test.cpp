@@ -0,0 +1,57 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// memtrace_u_test.cpp
+// Is in charge of unit testing allocation tracing
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <mm/memtrace.hpp>
+#include <mm/heap.hpp>
+#include <mm/pmm.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+void unittsts::test_memtrace(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Nothing is recorded while tracing is off
+    memtrace::clear();
+    kfree(kmalloc(64));
+    if(memtrace::total != 0) {
+        kprintf(LOG_ERROR, "Memtrace Test 1 failed: recorded %llu calls while disabled!\n", memtrace::total);
+        passed = false; // Noting that the test failed
+    }
+
+    // Tracing a freed, a live and a frame allocation
+    memtrace::enabled = true;
+    void* freed = kmalloc(100);
+    void* live = kmalloc(5000);
+    kfree(freed);
+    void* frames = pmm::alloc_frame(2);
+    memtrace::enabled = false;
+
+    // Only the live heap allocation should hold heap bytes, frames may also come from the slab/heap refilling
+    static TraceSite sites[MEMTRACE_MAX_SITES];
+    uint32_t site_count = memtrace::get_sites(sites, MEMTRACE_MAX_SITES);
+    uint64_t heap_bytes = 0, frame_bytes = 0;
+    for(uint32_t i = 0; i < site_count; i++) {
+        if(sites[i].frames) frame_bytes += sites[i].live_bytes;
+        else heap_bytes += sites[i].live_bytes;
+    }
+    if(heap_bytes != 5000 || frame_bytes < 2 * FRAME_SIZE) {
+        kprintf(LOG_ERROR, "Memtrace Test 2 failed: %llu heap and %llu frame bytes live!\n", heap_bytes, frame_bytes);
+        passed = false; // Noting that the test failed
+    }
+
+    // Freeing up memory
+    kfree(live);
+    pmm::free_frame(frames);
+    memtrace::clear();
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Allocation tracing failed!");
+    kprintf(LOG_INFO, "Allocation tracing test passed\n");
+}
@@ -20,35 +20,44 @@ void unittsts::test_pmm(void) {
     // Allocating first block
     uint32_t block1 = uint32_t(pmm::alloc_frame(1));
 
-    if(block1 <= METADATA_ADDR) {
+    if(!block1 || VIRT_TO_PHYS(block1) < pmm::get_metadata_end()) {
         kprintf(LOG_ERROR, "PMM Test 1 failed: couldn't allocate frame!\n");
         passed = false; // Noting that the test failed
     }
 
-    // Allocating second block
-    uint32_t block2 = uint32_t(pmm::alloc_frame(1));
-    uint32_t block2_addr = block2; // Saving the second blocks address
-
-    // If block2 is equal to block1 plus the difference and plus the metadata size 
-    if(block2 != block1 + FRAME_SIZE) {
-        kprintf(LOG_ERROR, "PMM Test 2 failed: couldn't allocate block2! %x\n", block2);
+    // Blocks are aligned to their own size
+    uint32_t block2 = uint32_t(pmm::alloc_frame(2));
+    if(!block2 || (block2 & (FRAME_SIZE * 2 - 1))) {
+        kprintf(LOG_ERROR, "PMM Test 2 failed: order 1 block isn't aligned! %x\n", block2);
         passed = false; // Noting that the test failed
     }
 
-    // Freeing block2
-    pmm::free_frame((void*)block2);
+    // Allocations that aren't a power of two only take up the frames they need
+    uint64_t used_before = pmm::total_used_ram;
+    uint32_t block3 = uint32_t(pmm::alloc_frame(3));
+    if(pmm::total_used_ram != used_before + FRAME_SIZE * 3) {
+        kprintf(LOG_ERROR, "PMM Test 3 failed: allocating 3 frames used %x bytes!\n", uint32_t(pmm::total_used_ram - used_before));
+        passed = false; // Noting that the test failed
+    }
 
-    // Reallocating second block
-    block2 = uint32_t(pmm::alloc_frame(2));
+    // Freeing gives the frames back, freeing twice doesn't change anything
+    pmm::free_frame((void*)block3);
+    pmm::free_frame((void*)block3);
+    if(pmm::total_used_ram != used_before) {
+        kprintf(LOG_ERROR, "PMM Test 4 failed: couldn't free block3!\n");
+        passed = false; // Noting that the test failed
+    }
 
-    // If block2 is equal to block1 plus the difference and plus the metadata size 
-    if(block2 != block2_addr) { 
-        kprintf(LOG_ERROR, "PMM Test 3 failed: couldn't free block2! %x isn't %x\n", block2, block2_addr);
+    // Freed frames are merged with their buddies and handed out again
+    pmm::free_frame((void*)block2);
+    uint32_t block4 = uint32_t(pmm::alloc_frame(2));
+    if(block4 != block2) {
+        kprintf(LOG_ERROR, "PMM Test 5 failed: couldn't free block2! %x isn't %x\n", block4, block2);
         passed = false; // Noting that the test failed
     }
 
     // Freeing up memory
-    pmm::free_frame((void*)block1); pmm::free_frame((void*)block2);
+    pmm::free_frame((void*)block1); pmm::free_frame((void*)block4);
 
     // If the test failed we will halt the system
     if(!passed) kernel_panic("PMM failed!");
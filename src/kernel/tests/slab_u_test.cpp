@@ -0,0 +1,60 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// slab_u_test.cpp
+// Is in charge of unit testing the slab allocator
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <mm/heap.hpp>
+#include <mm/slab.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+void unittsts::test_slab(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Allocating two small objects
+    size_t object_size = 40;
+    uint32_t obj1 = uint32_t(kmalloc(object_size));
+    uint32_t obj2 = uint32_t(kmalloc(object_size));
+
+    if(!slab::owns((void*)obj1) || !slab::owns((void*)obj2) || obj1 == obj2) {
+        kprintf(LOG_ERROR, "Slab Test 1 failed: small allocations weren't served by a slab!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Freeing and reallocating obj2, the size class should hand the same object back
+    uint32_t obj2_addr = obj2;
+    kfree((void*)obj2);
+    obj2 = uint32_t(kmalloc(object_size));
+    if(obj2 != obj2_addr) {
+        kprintf(LOG_ERROR, "Slab Test 2 failed: freed object wasn't reused! (%x isn't %x)\n", obj2, obj2_addr);
+        passed = false;
+    }
+
+    // A double free shouldn't put an object on the free list twice
+    kfree((void*)obj2); kfree((void*)obj2);
+    uint32_t obj3 = uint32_t(kmalloc(object_size));
+    uint32_t obj4 = uint32_t(kmalloc(object_size));
+    if(obj3 == obj4) {
+        kprintf(LOG_ERROR, "Slab Test 3 failed: double free handed out the same object twice!\n");
+        passed = false;
+    }
+
+    // Requests above the largest size class go to the block allocator
+    uint32_t large = uint32_t(kmalloc(SLAB_MAX_SIZE + 1));
+    if(slab::owns((void*)large) || !heap::owns((void*)large)) {
+        kprintf(LOG_ERROR, "Slab Test 4 failed: large allocation didn't reach the block allocator!\n");
+        passed = false;
+    }
+
+    // Freeing up memory
+    kfree((void*)obj1); kfree((void*)obj3); kfree((void*)obj4); kfree((void*)large);
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Slab allocator failed!");
+    kprintf(LOG_INFO, "Slab allocator test passed\n");
+}
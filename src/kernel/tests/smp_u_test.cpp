@@ -0,0 +1,79 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// smp_u_test.cpp
+// Is in charge of unit testing per-CPU data, AP bring-up and spinlocks
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <x86/smp.hpp>
+#include <sched/scheduler.hpp>
+#include <sched/spinlock.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+static inline uint32_t read_eflags(void) {
+    uint32_t flags;
+    asm volatile("pushf; pop %0" : "=r"(flags));
+    return flags;
+}
+
+void unittsts::test_smp(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // GS has to point at the boot CPU's struct
+    if(smp::this_cpu() != &smp::cpus[0] || smp::cpu_index() != 0) {
+        kprintf(LOG_ERROR, "SMP Test 1 failed: GS doesn't point at the boot CPU!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Every online AP needs its own idle process and LAPIC ID
+    uint32_t online = 0;
+    for(uint32_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if(!smp::cpus[i].online) continue;
+        online++;
+        if(i == 0) continue;
+        Process* idle = run_queues[i].idle;
+        if(!idle || idle->get_cpu() != i || smp::cpus[i].current != idle || smp::cpus[i].apic_id == smp::cpus[0].apic_id) {
+            kprintf(LOG_ERROR, "SMP Test 2 failed: CPU %u isn't set up right!\n", i);
+            passed = false; // Noting that the test failed
+        }
+    }
+    if(online != smp::cpu_count) {
+        kprintf(LOG_ERROR, "SMP Test 2 failed: %u CPU(s) online but %u counted!\n", online, smp::cpu_count);
+        passed = false; // Noting that the test failed
+    }
+
+    // A shootdown only returns once every other CPU flushed
+    smp::shootdown_tlb();
+
+    // Spinlocks have to hold off interrupts and give them back
+    Spinlock lock;
+    uint32_t flags = read_eflags();
+    uint32_t saved = lock.lock_irqsave();
+    if(!lock.is_locked() || (read_eflags() & 0x200)) {
+        kprintf(LOG_ERROR, "SMP Test 3 failed: lock_irqsave didn't lock with interrupts off!\n");
+        passed = false; // Noting that the test failed
+    }
+    lock.unlock_irqrestore(saved);
+    if(lock.is_locked() || (read_eflags() & 0x200) != (flags & 0x200)) {
+        kprintf(LOG_ERROR, "SMP Test 3 failed: unlock_irqrestore didn't restore interrupts!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Work stealing only tries locks, a held one has to be left alone
+    lock.lock();
+    bool taken = lock.try_lock();
+    lock.unlock();
+    if(taken || !lock.try_lock()) {
+        kprintf(LOG_ERROR, "SMP Test 4 failed: try_lock took a held lock or missed a free one!\n");
+        passed = false; // Noting that the test failed
+    }
+    lock.unlock();
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("SMP failed!");
+    kprintf(LOG_INFO, "SMP test passed\n");
+}
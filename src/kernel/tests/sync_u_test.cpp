@@ -0,0 +1,59 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// sync_u_test.cpp
+// Is in charge of unit testing wait queues, semaphores and mutexes
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <drivers/pit.hpp>
+#include <sched/sync.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+// Runs before the scheduler, so waits poll instead of blocking
+void unittsts::test_sync(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Units are counted, waits take them one at a time
+    Semaphore sem(1);
+    sem.post();
+    if(sem.get_count() != 2 || !sem.wait() || !sem.try_wait() || sem.try_wait()) {
+        kprintf(LOG_ERROR, "Sync Test 1 failed: semaphore lost or made up a unit!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // An empty semaphore times out, but not early
+    uint64_t start = ticks;
+    if(sem.wait(5) || ticks - start < 5) {
+        kprintf(LOG_ERROR, "Sync Test 2 failed: empty semaphore didn't time out right! (%u ticks)\n", (uint32_t)(ticks - start));
+        passed = false; // Noting that the test failed
+    }
+
+    // A held mutex can't be taken twice
+    Mutex mutex;
+    mutex.lock();
+    if(!mutex.is_locked() || mutex.try_lock()) {
+        kprintf(LOG_ERROR, "Sync Test 3 failed: mutex was taken twice!\n");
+        passed = false; // Noting that the test failed
+    }
+    mutex.unlock();
+    if(!mutex.try_lock()) {
+        kprintf(LOG_ERROR, "Sync Test 3 failed: free mutex couldn't be taken!\n");
+        passed = false; // Noting that the test failed
+    }
+    mutex.unlock();
+
+    // Nobody waits, so there's nobody to wake and waits only end by timing out
+    WaitQueue queue;
+    if(queue.wake_one() || queue.wait(3)) {
+        kprintf(LOG_ERROR, "Sync Test 4 failed: empty wait queue woke someone!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Synchronization primitives failed!");
+    kprintf(LOG_INFO, "Synchronization test passed\n");
+}
@@ -0,0 +1,52 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// timer_u_test.cpp
+// Is in charge of unit testing the timer wheel
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <drivers/pit.hpp>
+#include <sched/timer.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+// Records the tick a timer ran at
+static void record_tick(void* data) {
+    *(volatile uint64_t*)data = ticks;
+}
+
+void unittsts::test_timer(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // A level 0 timer and one that has to be cascaded down from level 1
+    volatile uint64_t near_fired = 0, far_fired = 0, cancelled_fired = 0;
+    Timer near = {}, far = {}, cancelled = {};
+    uint64_t start = ticks;
+    timer::add(&near, start + 3, record_tick, (void*)&near_fired);
+    timer::add(&far, start + TIMER_WHEEL_SLOTS + 6, record_tick, (void*)&far_fired);
+    timer::add(&cancelled, start + 5, record_tick, (void*)&cancelled_fired);
+
+    // A cancelled timer shouldn't run
+    if(!timer::cancel(&cancelled) || timer::cancel(&cancelled)) {
+        kprintf(LOG_ERROR, "Timer Test 1 failed: cancel didn't report the pending timer!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    pit::delay(TIMER_WHEEL_SLOTS + 10);
+    if(near_fired != start + 3 || far_fired != start + TIMER_WHEEL_SLOTS + 6) {
+        kprintf(LOG_ERROR, "Timer Test 2 failed: timers ran at the wrong tick! (%u and %u)\n",
+            (uint32_t)(near_fired - start), (uint32_t)(far_fired - start));
+        passed = false; // Noting that the test failed
+    }
+    if(cancelled_fired || near.pending || far.pending) {
+        kprintf(LOG_ERROR, "Timer Test 3 failed: a cancelled timer ran or an expired one is still pending!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Timer wheel failed!");
+    kprintf(LOG_INFO, "Timer wheel test passed\n");
+}
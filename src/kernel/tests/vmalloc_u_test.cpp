@@ -0,0 +1,71 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// vmalloc_u_test.cpp
+// Is in charge of unit testing vmalloc
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <mm/vmalloc.hpp>
+#include <mm/vmm.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+void unittsts::test_vmalloc(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+    uint32_t used_before = vmalloc_stats.used_pages;
+
+    // An area spanning several pages is usable from start to end
+    const uint32_t pages = 9;
+    uint32_t* area = (uint32_t*)vmalloc(pages * PAGE_SIZE - 100);
+    if(!area || (uint32_t)area < VMALLOC_START || ((uint32_t)area & (PAGE_SIZE - 1))) {
+        kprintf(LOG_ERROR, "vmalloc Test 1 failed: couldn't allocate area! %x\n", area);
+        passed = false; // Noting that the test failed
+    }
+    else {
+        for(uint32_t i = 0; i < pages; i++) area[i * PAGE_SIZE / 4] = 0xA110C000 + i;
+        for(uint32_t i = 0; i < pages; i++) {
+            if(area[i * PAGE_SIZE / 4] != 0xA110C000 + i) {
+                kprintf(LOG_ERROR, "vmalloc Test 2 failed: page %u of the area lost its data!\n", i);
+                passed = false; // Noting that the test failed
+                break;
+            }
+        }
+
+        // Overruns run into an unmapped guard page
+        if(vmm::is_mapped((uint32_t)area + pages * PAGE_SIZE)) {
+            kprintf(LOG_ERROR, "vmalloc Test 3 failed: no guard page after the area!\n");
+            passed = false; // Noting that the test failed
+        }
+    }
+
+    // Areas don't overlap
+    void* second = vmalloc(1);
+    if(!second || ((uint32_t)second >= (uint32_t)area && (uint32_t)second < (uint32_t)area + pages * PAGE_SIZE)) {
+        kprintf(LOG_ERROR, "vmalloc Test 4 failed: areas overlap! %x\n", second);
+        passed = false; // Noting that the test failed
+    }
+
+    // Freeing unmaps every page, pointers inside an area and double frees are ignored
+    vfree((void*)((uint32_t)area + PAGE_SIZE));
+    vfree(area);
+    vfree(area);
+    for(uint32_t i = 0; i < pages; i++) {
+        if(vmm::is_mapped((uint32_t)area + i * PAGE_SIZE)) {
+            kprintf(LOG_ERROR, "vmalloc Test 5 failed: page %u is still mapped after vfree!\n", i);
+            passed = false; // Noting that the test failed
+            break;
+        }
+    }
+    vfree(second);
+    if(vmalloc_stats.used_pages != used_before) {
+        kprintf(LOG_ERROR, "vmalloc Test 5 failed: %u pages leaked!\n", vmalloc_stats.used_pages - used_before);
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("vmalloc failed!");
+    kprintf(LOG_INFO, "vmalloc test passed\n");
+}
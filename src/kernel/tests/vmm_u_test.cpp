@@ -24,8 +24,9 @@ void unittsts::test_vmm(void) {
 
     // Testing mapping
     uint32_t address = 0x1000;
-    uint32_t phys_addr = (uint32_t)pmm::alloc_frame(1);
-    vmm::alloc_page(address, phys_addr, PRESENT | WRITABLE); // Mapping VGA address to 0
+    uint16_t* frame = (uint16_t*)pmm::alloc_frame(1);
+    uint32_t phys_addr = VIRT_TO_PHYS((uint32_t)frame);
+    vmm::alloc_page(address, phys_addr, PRESENT | WRITABLE); // Mapping the frame a second time in user space
     bool is_mapped = vmm::is_mapped(address); // Getting if the page is mapped
     if(!is_mapped) {
         kprintf(LOG_ERROR, "VMM Test 1 failed: couldn't map page at v. address: %x!\n", address);
@@ -36,8 +37,8 @@ void unittsts::test_vmm(void) {
     uint16_t value = 0x072D;
     uint16_t original_val = *(uint16_t*)(address);
     *(uint16_t*)(address) = value; // Writing in a value
-    if(*(uint16_t*)(phys_addr) != value) { // If the value at the physical corresponding address is the same
-        kprintf(LOG_ERROR, "VMM Test 2 failed: it set the wrong value (Set: %x Expected: %x Original value: %x)!\n", *(uint32_t*)(phys_addr), value, original_val);
+    if(*frame != value) { // If the value is seen through the frame's direct map address
+        kprintf(LOG_ERROR, "VMM Test 2 failed: it set the wrong value (Set: %x Expected: %x Original value: %x)!\n", *frame, value, original_val);
         passed = false;
     }
     *(uint16_t*)(address) = original_val;
@@ -57,22 +58,93 @@ void unittsts::test_vmm(void) {
         passed = false; // Noting that the test failed
     }
 
-    // Testing 4MiB pages
-    uint32_t* virt_4mb = (uint32_t*)0x2000000;
-    
-    vmm::alloc_page_4mib((uint32_t)virt_4mb, (uint32_t)virt_4mb, PRESENT | WRITABLE); // Map 4 MiB page
-    
-    // Check if virtual address is mapped (naive check: dereference test)
-    *virt_4mb = 0xDEADBEEF;
+    // Testing 4MiB pages, a 4 MiB allocation is aligned and should be in the direct map with a single page
+    uint32_t* virt_4mb = (uint32_t*)pmm::alloc_frame(LARGE_PAGE_SIZE / FRAME_SIZE);
+    if((vmm::pse_paging || vmm::pae_paging) && virt_4mb) {
+        uint32_t offset = 0x12344;
+        *(uint32_t*)((uint32_t)virt_4mb + offset) = 0xDEADBEEF;
 
-    if (*(uint32_t*)virt_4mb != 0xDEADBEEF) {
-        kprintf(LOG_ERROR, "VMM Test 5 failed: 4MiB page did not map correctly!\n");
+        if(!vmm::is_large_page((uint32_t)virt_4mb) || *(uint32_t*)((uint32_t)virt_4mb + offset) != 0xDEADBEEF ||
+           (uint32_t)vmm::virtual_to_physical((uint32_t)virt_4mb + offset) != VIRT_TO_PHYS((uint32_t)virt_4mb) + offset) {
+            kprintf(LOG_ERROR, "VMM Test 5 failed: 4MiB page did not map correctly!\n");
+            passed = false;
+        }
+
+        // Remapping a single page inside of it splits it into a page table
+        vmm::alloc_page((uint32_t)virt_4mb, phys_addr, PRESENT | WRITABLE);
+        if(vmm::is_large_page((uint32_t)virt_4mb) || (uint32_t)vmm::virtual_to_physical((uint32_t)virt_4mb) != phys_addr ||
+           *(uint32_t*)((uint32_t)virt_4mb + offset) != 0xDEADBEEF) {
+            kprintf(LOG_ERROR, "VMM Test 6 failed: couldn't split a 4MiB page!\n");
+            passed = false;
+        }
+        vmm::alloc_page((uint32_t)virt_4mb, VIRT_TO_PHYS((uint32_t)virt_4mb), PRESENT | WRITABLE);
+    }
+
+    // Frames that may lie above 4GiB are reached through temporary mappings
+    uint64_t high_frame = pmm::alloc_high_frame(1);
+    uint32_t* window = (uint32_t*)vmm::kmap(high_frame + 0x10);
+    if(!high_frame || !window) {
+        kprintf(LOG_ERROR, "VMM Test 7 failed: couldn't map frame %llx!\n", high_frame);
+        passed = false;
+    }
+    else {
+        *window = 0xCAFEBABE;
+        vmm::kunmap(window);
+        uint32_t* second = (uint32_t*)vmm::kmap(high_frame + 0x10);
+        if(!second || *second != 0xCAFEBABE) {
+            kprintf(LOG_ERROR, "VMM Test 7 failed: temporary mapping of %llx lost its data!\n", high_frame);
+            passed = false;
+        }
+        vmm::kunmap(second);
+        if(vmm::is_mapped((uint32_t)second)) {
+            kprintf(LOG_ERROR, "VMM Test 7 failed: couldn't remove temporary mapping at %x!\n", second);
+            passed = false;
+        }
+    }
+    pmm::free_high_frame(high_frame);
+
+    // Mapping and unmapping a region with batched TLB flushes (more pages than a batch holds)
+    uint32_t region_pages = VMM_TLB_BATCH_MAX + 8;
+    uint32_t region_virt = 0x40000000;
+    uint32_t* region_phys = (uint32_t*)pmm::alloc_frame(region_pages);
+    if(region_phys) {
+        region_phys[(region_pages - 1) * PAGE_SIZE / 4] = 0x1BADB002;
+        vmm::map_region(region_virt, VIRT_TO_PHYS((uint32_t)region_phys), region_pages * PAGE_SIZE, PRESENT | WRITABLE);
+        if(*(uint32_t*)(region_virt + (region_pages - 1) * PAGE_SIZE) != 0x1BADB002) {
+            kprintf(LOG_ERROR, "VMM Test 8 failed: couldn't map a region!\n");
+            passed = false;
+        }
+        vmm::unmap_region(region_virt, region_pages * PAGE_SIZE);
+        if(vmm::is_mapped(region_virt) || vmm::is_mapped(region_virt + (region_pages - 1) * PAGE_SIZE)) {
+            kprintf(LOG_ERROR, "VMM Test 8 failed: couldn't unmap a region!\n");
+            passed = false;
+        }
+        pmm::free_frame(region_phys);
+    }
+
+    // Paging structures map themselves, so the PTE of any page sits at its page number in the recursive window
+    uint32_t dir_virt = vmm::pae_paging ? VMM_PAE_DIRS_ADDR : VMM_PD_ADDR;
+    uint32_t dir_phys = vmm::pae_paging ? VIRT_TO_PHYS((uint32_t)vmm::pae::active) : vmm::get_cr3();
+    vmm::alloc_page(address, phys_addr, PRESENT | WRITABLE);
+    uint32_t pte_phys = vmm::pae_paging ? uint32_t(((uint64_t*)VMM_PAE_RECURSIVE_ADDR)[address / PAGE_SIZE] & PAE_ADDR_MASK)
+                                        : FRAME_TO_PHYS(uint32_t(((page_4kb*)VMM_RECURSIVE_ADDR)[address / PAGE_SIZE].address));
+    if((uint32_t)vmm::virtual_to_physical(dir_virt) != dir_phys || pte_phys != phys_addr) {
+        kprintf(LOG_ERROR, "VMM Test 9 failed: page tables aren't reachable through the recursive mapping!\n");
+        passed = false;
+    }
+    vmm::free_page(address);
+
+    // The kernel runs in the higher half, its physical load address isn't mapped anymore
+    uint32_t kernel_code = (uint32_t)&unittsts::test_vmm;
+    if(kernel_code < KERNEL_LOAD_ADDRESS || (uint32_t)vmm::virtual_to_physical(kernel_code) != VIRT_TO_PHYS(kernel_code) ||
+       vmm::is_mapped(pmm::get_kernel_addr())) {
+        kprintf(LOG_ERROR, "VMM Test 10 failed: kernel isn't mapped at %x!\n", KERNEL_LOAD_ADDRESS);
         passed = false;
     }
 
-    // Freeing page
-    vmm::free_page((uint32_t)virt_4mb);
-    pmm::free_frame((void*)phys_addr);
+    // Freeing pages
+    pmm::free_frame(virt_4mb);
+    pmm::free_frame(frame);
 
     // If this didn't pass al test we'll initialize kernel panic
     if(!passed) kernel_panic("VMM failed!");
@@ -0,0 +1,58 @@
+// ========================================
+// Copyright Ioane Baidoshvili 2025.
+// Distributed under the terms of the MIT License.
+// ========================================
+// workqueue_u_test.cpp
+// Is in charge of unit testing the work queue
+// ========================================
+
+#include <tests/unit_tests.hpp>
+#include <graphics/vga_print.hpp>
+#include <sched/workqueue.hpp>
+#include <x86/interrupts/kernel_panic.hpp>
+
+static Work first_work, second_work;
+static volatile uint32_t order[4];
+static volatile uint32_t runs = 0;
+static volatile bool requeued = false, coalesced = false;
+
+// Records the order work ran in
+static void record_work(void* data) {
+    order[runs] = (uint32_t)(uintptr_t)data;
+    runs = runs + 1;
+}
+
+// Queues more work while it runs, which has to wait until it's done instead of nesting
+static void queue_more(void* data) {
+    requeued = work::queue(&first_work, record_work, (void*)3);
+    coalesced = work::queue(&second_work, record_work, (void*)2) && !work::queue(&second_work, record_work, (void*)4);
+    record_work(data);
+}
+
+// Runs before the worker, so queued work runs right away
+void unittsts::test_workqueue(void) {
+    // Final status (passed or failed)
+    bool passed = true;
+
+    // Queued work runs with its data and can be queued again afterwards
+    if(!work::queue(&first_work, record_work, (void*)0) || runs != 1 || order[0] != 0 || first_work.pending) {
+        kprintf(LOG_ERROR, "Work Queue Test 1 failed: queued work didn't run!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // Work queued by work runs after it in FIFO order, queueing pending work again doesn't run it twice
+    runs = 0;
+    work::queue(&first_work, queue_more, (void*)1);
+    if(!requeued || !coalesced || runs != 3 || order[0] != 1 || order[1] != 3 || order[2] != 2) {
+        kprintf(LOG_ERROR, "Work Queue Test 2 failed: work ran nested, twice or out of order! (%u runs)\n", runs);
+        passed = false; // Noting that the test failed
+    }
+    if(first_work.pending || second_work.pending) {
+        kprintf(LOG_ERROR, "Work Queue Test 3 failed: work that ran is still pending!\n");
+        passed = false; // Noting that the test failed
+    }
+
+    // If the test failed we will halt the system
+    if(!passed) kernel_panic("Work queue failed!");
+    kprintf(LOG_INFO, "Work queue test passed\n");
+}